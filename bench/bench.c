@@ -0,0 +1,964 @@
+/**
+ * bench.c - Throughput benchmarks and synthetic memory images for the MIPS-lite simulator
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * A separate program from the simulator, with three commands:
+ *
+ *				gen:		Writes a synthetic memory image: a loop of
+ *							'body' instructions run 'trips' times, with a
+ *							tunable instruction mix, RAW hazard density
+ *							and LDW/STW footprint.
+ *
+ *				run:		Runs the simulator on a suite of images in
+ *							every functional mode and measures the host's
+ *							throughput: simulated instructions and cycles
+ *							per second, ns per instruction and peak RSS.
+ *							The results go to a JSON file, and can be
+ *							compared with an earlier build's file.
+ *
+ *				check:		Runs the simulator's consistency checks and
+ *							fails if any of them does: every image
+ *							shipped with it validates clean against the
+ *							reference in every mode, and a sampled run
+ *							of a long generated image executes exactly
+ *							the full run's instructions, with a cycle
+ *							estimate whose interval covers the full run,
+ *							and a sliced run of it adds up to exactly
+ *							the full run's counts, and a store one core
+ *							makes into the code reaches the other core.
+ *
+ * Every run is timed around the whole simulator process (best of 'runs'),
+ * and the instruction and cycle counts come from its --stats=json output.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <glob.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "../mips.h"
+
+
+// Defaults for 'run'
+#define DEFAULT_SIMULATOR "./mips.exe"
+#define DEFAULT_OUTPUT "bench.json"
+#define DEFAULT_RUNS 3
+#define DEFAULT_THRESHOLD 10.0          // % slower per instruction that counts as a regression
+
+// Defaults for 'check'
+#define DEFAULT_ROOT "."
+#define CHECK_SLICE_LENGTH "10000"      // instructions per interval of the sliced runs
+#define CHECK_SAMPLE_SLACK (2 * NUMPIPES)  // cycles filling and draining the pipeline, which no CPI sample sees
+
+#define MAX_IMAGES 64
+#define MAX_RESULTS (MAX_IMAGES * 3)
+
+// Instruction mix classes for 'gen'
+#define MIX_ARITH 0
+#define MIX_LOGIC 1
+#define MIX_MUL 2
+#define MIX_LOAD 3
+#define MIX_STORE 4
+#define MIX_CLASSES 5
+
+// Registers the generator never uses as a destination
+#define ZERO_REG 0                      // always 0: the LDW/STW base
+#define LOOP_REG 1                      // loop counter
+#define FIRST_POOL_REG 2
+
+
+extern char **environ;
+
+
+// struct to hold the shape of a synthetic image
+typedef struct gen_config {
+	int body;               // instructions in the loop body
+	int trips;              // times the loop runs
+	int mix[MIX_CLASSES];   // relative weight of each class
+	int hazard;             // % of sources that read the previous line's result
+	int footprint;          // memory words LDW/STW spread over
+	unsigned seed;
+} genConfig;
+
+// struct to hold one workload of the default suite
+typedef struct workload {
+	const char *name;
+	genConfig config;
+} workload;
+
+// struct to hold one benchmark result
+typedef struct bench_result {
+	char workload[64];
+	char mode[8];
+	long long instructions;
+	long long cycles;
+	double seconds;
+	long peak_rss_kb;
+} benchResult;
+
+
+static const char *mix_names[MIX_CLASSES] = {"arith", "logic", "mul", "load", "store"};
+static const char *mode_names[3] = {"NO_PIPE", "NO_FWD", "FWD"};
+
+// Default suite: one image per kind of work the simulator does
+static const workload suite[] = {
+	{"alu",       {.body=200, .trips=10000, .mix={60, 40, 0, 0, 0},    .hazard=10, .footprint=1,   .seed=1}},
+	{"hazards",   {.body=200, .trips=10000, .mix={50, 30, 20, 0, 0},   .hazard=80, .footprint=1,   .seed=2}},
+	{"memory",    {.body=200, .trips=10000, .mix={40, 0, 0, 35, 25},   .hazard=20, .footprint=512, .seed=3}},
+	{"mixed",     {.body=200, .trips=10000, .mix={35, 20, 10, 20, 15}, .hazard=40, .footprint=256, .seed=4}},
+	{"tightloop", {.body=4,   .trips=200000, .mix={100, 0, 0, 0, 0},  .hazard=50, .footprint=1,   .seed=5}},
+};
+
+#define SUITE_SIZE (int)(sizeof(suite) / sizeof(suite[0]))
+
+
+
+
+// Image generator
+
+static uint32_t r_type(int opcode, int rd, int rs, int rt) {
+	return ((uint32_t)opcode << 26) | ((uint32_t)rs << 21) | ((uint32_t)rt << 16) | ((uint32_t)rd << 11);
+}
+
+
+static uint32_t i_type(int opcode, int rt, int rs, int imm) {
+	return ((uint32_t)opcode << 26) | ((uint32_t)rs << 21) | ((uint32_t)rt << 16) | ((uint32_t)imm & 0xFFFF);
+}
+
+
+static int random_below(int n) {
+	return (n > 1) ? rand() % n : 0;
+}
+
+
+// A source register: the last result with probability 'hazard'%, otherwise
+// a pool register that hasn't been written for at least two lines
+static int pick_source(const genConfig *config, int last_dest, int before_last) {
+	int pool = NUM_REGISTERS - FIRST_POOL_REG;
+	int r;
+
+	if (last_dest >= 0 && random_below(100) < config->hazard)
+		return last_dest;
+
+	do {
+		r = FIRST_POOL_REG + random_below(pool);
+	} while (r == last_dest || r == before_last);
+	return r;
+}
+
+
+static int pick_class(const genConfig *config) {
+	int total = 0, n;
+
+	for (int c = 0; c < MIX_CLASSES; c++)
+		total += config->mix[c];
+	if (total <= 0)
+		return MIX_ARITH;
+
+	n = random_below(total);
+	for (int c = 0; c < MIX_CLASSES; c++) {
+		if (n < config->mix[c])
+			return c;
+		n -= config->mix[c];
+	}
+	return MIX_ARITH;
+}
+
+
+// Lines around the body: 3 to load the trip count and 4 to close the loop
+#define GEN_OVERHEAD 7
+
+static bool generate_image(const genConfig *config, FILE *fp) {
+	uint32_t lines[MEMORY_SIZE];
+	int n = 0, body_start;
+	int last_dest = -1, before_last = -1;
+
+	// Code and data share memory: the LDW/STW words start after the program
+	int data_base = config->body + GEN_OVERHEAD;
+
+	if (config->body < 1 || config->trips < 1 || config->footprint < 1
+	  || data_base + config->footprint > MEMORY_SIZE) {
+		fprintf(stderr, "Image doesn't fit: body >= 1, trips >= 1, footprint >= 1, body + footprint <= %d.\n", MEMORY_SIZE - GEN_OVERHEAD);
+		return false;
+	}
+
+	srand(config->seed);
+
+	// LOOP_REG = trips, built as hi * 10000 + lo so it fits ADDI/MULI immediates
+	lines[n++] = i_type(ADDI, LOOP_REG, ZERO_REG, config->trips / 10000);
+	lines[n++] = i_type(MULI, LOOP_REG, LOOP_REG, 10000);
+	lines[n++] = i_type(ADDI, LOOP_REG, LOOP_REG, config->trips % 10000);
+
+	body_start = n;
+	for (int i = 0; i < config->body; i++) {
+		int dest = FIRST_POOL_REG + random_below(NUM_REGISTERS - FIRST_POOL_REG);
+		int src1 = pick_source(config, last_dest, before_last);
+		int src2 = pick_source(config, last_dest, before_last);
+		int offset = 4 * (data_base + random_below(config->footprint));
+
+		switch (pick_class(config)) {
+			case MIX_ARITH:
+				lines[n++] = (random_below(2) == 0)
+					? r_type(random_below(2) ? ADD : SUB, dest, src1, src2)
+					: i_type(random_below(2) ? ADDI : SUBI, dest, src1, random_below(100));
+				break;
+			case MIX_LOGIC: {
+				static const int ops[6] = {OR, ORI, AND, ANDI, XOR, XORI};
+				int op = ops[random_below(6)];
+				lines[n++] = (op % 2 == 0) ? r_type(op, dest, src1, src2) : i_type(op, dest, src1, random_below(0x7FFF));
+				break;
+			}
+			case MIX_MUL:
+				lines[n++] = (random_below(2) == 0) ? r_type(MUL, dest, src1, src2) : i_type(MULI, dest, src1, 1 + random_below(7));
+				break;
+			case MIX_LOAD:
+				lines[n++] = i_type(LDW, dest, ZERO_REG, offset);
+				break;
+			case MIX_STORE:
+				lines[n++] = i_type(STW, src1, ZERO_REG, offset);
+				dest = -1;
+				break;
+		}
+
+		before_last = last_dest;
+		last_dest = dest;
+	}
+
+	// Count down, leave once it reaches 0, otherwise branch back to the body
+	lines[n++] = i_type(SUBI, LOOP_REG, LOOP_REG, 1);
+	lines[n++] = i_type(BZ, 0, LOOP_REG, 4);
+	lines[n] = i_type(BEQ, ZERO_REG, ZERO_REG, (body_start - (n + 1)) * 4);
+	n++;
+	lines[n++] = i_type(HALT, 0, 0, 0);
+
+	for (int i = 0; i < n; i++)
+		fprintf(fp, "%08X\n", lines[i]);
+
+	return true;
+}
+
+
+// Reads "class:N,class:N,..." into config->mix
+static bool parse_mix(const char *spec, genConfig *config) {
+	char buffer[128];
+	char *item, *save;
+
+	snprintf(buffer, sizeof(buffer), "%s", spec);
+	memset(config->mix, 0, sizeof(config->mix));
+
+	for (item = strtok_r(buffer, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+		char *colon = strchr(item, ':');
+		int c;
+
+		if (colon == NULL)
+			return false;
+		*colon = '\0';
+
+		for (c = 0; c < MIX_CLASSES; c++) {
+			if (strcmp(item, mix_names[c]) == 0)
+				break;
+		}
+		if (c == MIX_CLASSES)
+			return false;
+		config->mix[c] = atoi(colon + 1);
+	}
+
+	return true;
+}
+
+
+static int gen_main(int argc, char **argv) {
+	genConfig config = suite[3].config;
+	FILE *fp = stdout;
+	const char *out = NULL;
+
+	for (int i = 0; i < argc; i++) {
+		if (strncmp(argv[i], "--body=", 7) == 0)
+			config.body = atoi(argv[i] + 7);
+		else if (strncmp(argv[i], "--trips=", 8) == 0)
+			config.trips = atoi(argv[i] + 8);
+		else if (strncmp(argv[i], "--hazard=", 9) == 0)
+			config.hazard = atoi(argv[i] + 9);
+		else if (strncmp(argv[i], "--footprint=", 12) == 0)
+			config.footprint = atoi(argv[i] + 12);
+		else if (strncmp(argv[i], "--seed=", 7) == 0)
+			config.seed = (unsigned)strtoul(argv[i] + 7, NULL, 10);
+		else if (strncmp(argv[i], "--out=", 6) == 0)
+			out = argv[i] + 6;
+		else if (strncmp(argv[i], "--mix=", 6) == 0) {
+			if (!parse_mix(argv[i] + 6, &config)) {
+				fprintf(stderr, "Unknown mix %s (use arith:N,logic:N,mul:N,load:N,store:N).\n", argv[i] + 6);
+				return EXIT_FAILURE;
+			}
+		}
+		else {
+			fprintf(stderr, "Unknown option %s.\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (out != NULL && (fp = fopen(out, "w")) == NULL) {
+		perror("Error opening image");
+		return EXIT_FAILURE;
+	}
+
+	if (!generate_image(&config, fp))
+		return EXIT_FAILURE;
+
+	if (fp != stdout && fclose(fp) != 0) {
+		perror("Error writing image");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+
+
+// Benchmark runner
+
+static double now_seconds() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// Reads the number after "key": in the simulator's JSON stats
+static long long json_number(const char *json, const char *key) {
+	const char *p = strstr(json, key);
+
+	if (p == NULL)
+		return -1;
+	p = strchr(p + strlen(key), ':');
+	return (p == NULL) ? -1 : atoll(p + 1);
+}
+
+
+// Runs the simulator once on 'image' in 'mode', its stdout going to 'stats_path'
+static bool run_once(const char *simulator, const char *image, const char *mode, const char *stats_path, benchResult *result) {
+	char *args[] = {(char *)simulator, "NORMAL", (char *)mode, (char *)image, "--branch-limit=0", "--stats=json", NULL};
+	posix_spawn_file_actions_t actions;
+	struct rusage usage;
+	pid_t pid;
+	int status;
+	double start;
+	char json[4096];
+	size_t length;
+	FILE *fp;
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, 1, stats_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	start = now_seconds();
+	if (posix_spawn(&pid, simulator, &actions, NULL, args, environ) != 0) {
+		perror("Error starting the simulator");
+		posix_spawn_file_actions_destroy(&actions);
+		return false;
+	}
+	wait4(pid, &status, 0, &usage);
+	result->seconds = now_seconds() - start;
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "%s %s %s failed.\n", simulator, mode, image);
+		return false;
+	}
+
+	fp = fopen(stats_path, "r");
+	if (fp == NULL)
+		return false;
+	length = fread(json, 1, sizeof(json) - 1, fp);
+	json[length] = '\0';
+	fclose(fp);
+
+	result->instructions = json_number(json, "\"total\"");
+	result->cycles = json_number(json, "\"cycles\"");
+	result->peak_rss_kb = usage.ru_maxrss;
+	return result->instructions >= 0 && result->cycles >= 0;
+}
+
+
+static void write_result(FILE *fp, const benchResult *r, bool last) {
+	double ips = (r->seconds > 0) ? r->instructions / r->seconds : 0.0;
+	double cps = (r->seconds > 0) ? r->cycles / r->seconds : 0.0;
+	double ns = (r->instructions > 0) ? 1e9 * r->seconds / r->instructions : 0.0;
+
+	// One result per line, so compare() can read it back without a JSON parser
+	fprintf(fp, "    {\"workload\": \"%s\", \"mode\": \"%s\", \"instructions\": %lld, \"cycles\": %lld, "
+		"\"seconds\": %.6f, \"instructions_per_second\": %.0f, \"cycles_per_second\": %.0f, "
+		"\"ns_per_instruction\": %.3f, \"peak_rss_kb\": %ld}%s\n",
+		r->workload, r->mode, r->instructions, r->cycles, r->seconds, ips, cps, ns, r->peak_rss_kb, last ? "" : ",");
+}
+
+
+// Prints each result's change from the same workload and mode in 'path'.
+// Returns the number that got slower per instruction by more than 'threshold'%
+static int compare(const char *path, const benchResult *results, int count, double threshold) {
+	char line[1024];
+	int regressions = 0;
+	FILE *fp = fopen(path, "r");
+
+	if (fp == NULL) {
+		perror("Error opening baseline");
+		return 0;
+	}
+
+	printf("\n %-12s %-8s %14s %14s %9s\n", "Workload", "Mode", "Baseline ns/i", "Current ns/i", "Change");
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char name[64], mode[8];
+		double base_ns;
+		const char *p = strstr(line, "\"ns_per_instruction\":");
+
+		if (p == NULL || sscanf(line, " {\"workload\": \"%63[^\"]\", \"mode\": \"%7[^\"]\"", name, mode) != 2)
+			continue;
+		base_ns = atof(p + strlen("\"ns_per_instruction\":"));
+
+		for (int i = 0; i < count; i++) {
+			const benchResult *r = &results[i];
+			double ns, change;
+
+			if (strcmp(r->workload, name) != 0 || strcmp(r->mode, mode) != 0 || r->instructions <= 0 || base_ns <= 0)
+				continue;
+
+			ns = 1e9 * r->seconds / r->instructions;
+			change = 100.0 * (ns - base_ns) / base_ns;
+			printf(" %-12s %-8s %14.3f %14.3f %+8.1f%%%s\n", name, mode, base_ns, ns, change, (change > threshold) ? "  REGRESSION" : "");
+			if (change > threshold)
+				regressions++;
+		}
+	}
+
+	fclose(fp);
+	return regressions;
+}
+
+
+static int run_main(int argc, char **argv) {
+	const char *simulator = DEFAULT_SIMULATOR;
+	const char *output = DEFAULT_OUTPUT;
+	const char *baseline = NULL;
+	const char *label = "";
+	const char *images[MAX_IMAGES];
+	char names[MAX_IMAGES][64];
+	bool generated[MAX_IMAGES];
+	int image_count = 0;
+	int runs = DEFAULT_RUNS;
+	int scale = 1;
+	double threshold = DEFAULT_THRESHOLD;
+	static benchResult results[MAX_RESULTS];
+	int result_count = 0;
+	char dir[] = "/tmp/mips-bench-XXXXXX";
+	char stats_path[64];
+	int regressions = 0;
+	FILE *fp;
+
+	for (int i = 0; i < argc; i++) {
+		if (strncmp(argv[i], "--sim=", 6) == 0)
+			simulator = argv[i] + 6;
+		else if (strncmp(argv[i], "--out=", 6) == 0)
+			output = argv[i] + 6;
+		else if (strncmp(argv[i], "--runs=", 7) == 0)
+			runs = atoi(argv[i] + 7);
+		else if (strncmp(argv[i], "--scale=", 8) == 0)
+			scale = atoi(argv[i] + 8);
+		else if (strncmp(argv[i], "--label=", 8) == 0)
+			label = argv[i] + 8;
+		else if (strncmp(argv[i], "--compare=", 10) == 0)
+			baseline = argv[i] + 10;
+		else if (strncmp(argv[i], "--threshold=", 12) == 0)
+			threshold = atof(argv[i] + 12);
+		else if (strncmp(argv[i], "--", 2) == 0) {
+			fprintf(stderr, "Unknown option %s.\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+		else if (image_count < MAX_IMAGES) {
+			const char *base = strrchr(argv[i], '/');
+			snprintf(names[image_count], sizeof(names[0]), "%s", (base != NULL) ? base + 1 : argv[i]);
+			generated[image_count] = false;
+			images[image_count++] = argv[i];
+		}
+	}
+
+	if (runs < 1)
+		runs = 1;
+	if (scale < 1)
+		scale = 1;
+
+	if (mkdtemp(dir) == NULL) {
+		perror("Error making a scratch directory");
+		return EXIT_FAILURE;
+	}
+	snprintf(stats_path, sizeof(stats_path), "%s/stats.json", dir);
+
+	// Without image files, generate the default suite
+	if (image_count == 0) {
+		for (int w = 0; w < SUITE_SIZE; w++) {
+			genConfig config = suite[w].config;
+			char *path = malloc(64);
+
+			config.trips *= scale;
+			snprintf(path, 64, "%s/%s.txt", dir, suite[w].name);
+			snprintf(names[image_count], sizeof(names[0]), "%s", suite[w].name);
+
+			fp = fopen(path, "w");
+			if (fp == NULL || !generate_image(&config, fp)) {
+				perror("Error writing image");
+				return EXIT_FAILURE;
+			}
+			fclose(fp);
+			generated[image_count] = true;
+			images[image_count++] = path;
+		}
+	}
+
+	printf(" %-12s %-8s %12s %12s %12s %10s %10s\n", "Workload", "Mode", "Instructions", "MIPS", "MCycles/s", "ns/inst", "RSS (KiB)");
+
+	for (int i = 0; i < image_count; i++) {
+		for (int m = 0; m < 3; m++) {
+			benchResult *best = &results[result_count];
+			bool ok = true;
+
+			best->seconds = -1;
+			for (int run = 0; run < runs && ok; run++) {
+				benchResult r;
+
+				ok = run_once(simulator, images[i], mode_names[m], stats_path, &r);
+				if (ok && (best->seconds < 0 || r.seconds < best->seconds))
+					*best = r;
+			}
+			if (!ok)
+				continue;
+
+			snprintf(best->workload, sizeof(best->workload), "%.63s", names[i]);
+			snprintf(best->mode, sizeof(best->mode), "%s", mode_names[m]);
+			printf(" %-12s %-8s %12lld %12.2f %12.2f %10.2f %10ld\n", best->workload, best->mode, best->instructions,
+				best->instructions / best->seconds / 1e6, best->cycles / best->seconds / 1e6,
+				1e9 * best->seconds / best->instructions, best->peak_rss_kb);
+			result_count++;
+		}
+	}
+
+	fp = fopen(output, "w");
+	if (fp == NULL) {
+		perror("Error writing results");
+		return EXIT_FAILURE;
+	}
+	fprintf(fp, "{\n  \"label\": \"%s\",\n  \"simulator\": \"%s\",\n  \"runs\": %d,\n  \"scale\": %d,\n  \"results\": [\n", label, simulator, runs, scale);
+	for (int i = 0; i < result_count; i++)
+		write_result(fp, &results[i], i == result_count - 1);
+	fprintf(fp, "  ]\n}\n");
+	fclose(fp);
+	printf("\nResults written to %s\n", output);
+
+	if (baseline != NULL)
+		regressions = compare(baseline, results, result_count, threshold);
+
+	// Clean up the scratch directory
+	for (int i = 0; i < image_count; i++) {
+		if (generated[i]) {
+			remove(images[i]);
+			free((char *)images[i]);
+		}
+	}
+	remove(stats_path);
+	remove(dir);
+
+	return (regressions > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+
+
+// Consistency checks
+
+// Images shipped with the simulator, relative to its source directory
+static const char *shipped_images[] = {"Test_cases/*.txt", "testCases/*.txt", "Documents/*.txt"};
+
+#define SHIPPED_PATTERNS (int)(sizeof(shipped_images) / sizeof(shipped_images[0]))
+
+// Long images the sampled and sliced runs are checked on: a one-line loop
+// body, which branches every other instruction, and a long mixed one
+static const workload check_suite[] = {
+	{"branchy",   {.body=1,   .trips=30000, .mix={35, 20, 10, 20, 15}, .hazard=40, .footprint=256, .seed=7}},
+	{"mixed",     {.body=200, .trips=600,   .mix={35, 20, 10, 20, 15}, .hazard=40, .footprint=256, .seed=4}},
+};
+
+#define CHECK_SUITE_SIZE (int)(sizeof(check_suite) / sizeof(check_suite[0]))
+
+
+// Runs 'args' with its stdout going to 'out_path'. Returns its exit status,
+// -1 if it couldn't be started or didn't exit
+static int run_command(char **args, const char *out_path) {
+	posix_spawn_file_actions_t actions;
+	pid_t pid;
+	int status;
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, 1, out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (posix_spawn(&pid, args[0], &actions, NULL, args, environ) != 0) {
+		perror("Error starting the simulator");
+		posix_spawn_file_actions_destroy(&actions);
+		return -1;
+	}
+	waitpid(pid, &status, 0);
+	posix_spawn_file_actions_destroy(&actions);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+
+// Copies what a failed check's simulator printed, so the failure can be read
+static void print_output(const char *out_path) {
+	char line[1024];
+	FILE *fp = fopen(out_path, "r");
+
+	if (fp == NULL)
+		return;
+	while (fgets(line, sizeof(line), fp) != NULL)
+		fputs(line, stdout);
+	fclose(fp);
+}
+
+
+// Reads the number after 'label' in what the simulator printed, -1 if
+// it isn't there
+static double text_number(const char *text, const char *label) {
+	const char *p = strstr(text, label);
+
+	return (p == NULL) ? -1 : atof(p + strlen(label));
+}
+
+
+// Runs the simulator on 'image' in 'mode' with no branch limit and 'option'
+// (or none), its stdout read into 'text'. Returns false if it failed
+static bool run_text(const char *simulator, const char *image, const char *mode, const char *option, const char *out_path, char *text, size_t size) {
+	char *args[] = {(char *)simulator, "NORMAL", (char *)mode, (char *)image, "--branch-limit=0", (char *)option, NULL};
+	size_t length;
+	FILE *fp;
+
+	if (run_command(args, out_path) != 0)
+		return false;
+
+	fp = fopen(out_path, "r");
+	if (fp == NULL)
+		return false;
+	length = fread(text, 1, size - 1, fp);
+	text[length] = '\0';
+	fclose(fp);
+	return true;
+}
+
+
+// Writes check_suite[w] into 'dir'. Returns its path (malloc'd), or NULL
+static char *write_check_image(const char *dir, int w) {
+	char *path = malloc(64);
+	FILE *fp;
+
+	snprintf(path, 64, "%s/%s.txt", dir, check_suite[w].name);
+	fp = fopen(path, "w");
+	if (fp == NULL || !generate_image(&check_suite[w].config, fp)) {
+		perror("Error writing image");
+		if (fp != NULL)
+			fclose(fp);
+		free(path);
+		return NULL;
+	}
+	fclose(fp);
+	return path;
+}
+
+
+// Every shipped image runs through each mode's --validate. Returns the
+// number of modes that failed
+static int check_validation(const char *simulator, const char *root, const char *out_path) {
+	glob_t images;
+	char pattern[1024];
+	char **args;
+	int failed = 0;
+
+	memset(&images, 0, sizeof(images));
+	for (int p = 0; p < SHIPPED_PATTERNS; p++) {
+		snprintf(pattern, sizeof(pattern), "%s/%s", root, shipped_images[p]);
+		glob(pattern, (p > 0) ? GLOB_APPEND : 0, NULL, &images);
+	}
+	if (images.gl_pathc == 0) {
+		printf(" %-10s %-8s FAIL (no images under %s)\n", "validate", "", root);
+		globfree(&images);
+		return 3;
+	}
+
+	args = malloc((images.gl_pathc + 5) * sizeof(char *));
+	for (int m = 0; m < 3; m++) {
+		int a = 0, status;
+
+		args[a++] = (char *)simulator;
+		args[a++] = "NORMAL";
+		args[a++] = (char *)mode_names[m];
+		for (size_t i = 0; i < images.gl_pathc; i++)
+			args[a++] = images.gl_pathv[i];
+		args[a++] = "--validate";
+		args[a] = NULL;
+
+		status = run_command(args, out_path);
+		printf(" %-10s %-8s %s (%zu images)\n", "validate", mode_names[m], (status == 0) ? "PASS" : "FAIL", images.gl_pathc);
+		if (status != 0) {
+			print_output(out_path);
+			failed++;
+		}
+	}
+
+	free(args);
+	globfree(&images);
+	return failed;
+}
+
+
+// Each long image runs in NO_FWD and FWD in full and with --sample: the
+// sampled run has to execute exactly as many instructions, and its cycle
+// estimate's confidence interval, give or take CHECK_SAMPLE_SLACK, has to
+// take in the full run's cycles.
+// Returns the number of runs that failed
+static int check_sampling(const char *simulator, char **images, const char *out_path) {
+	static char text[1 << 16];
+	int failed = 0;
+
+	for (int w = 0; w < CHECK_SUITE_SIZE; w++) {
+		for (int m = 1; m < 3; m++) {
+			double full_insts, full_cycles, insts, estimate, error = -1;
+			const char *est;
+			bool ok;
+
+			ok = run_text(simulator, images[w], mode_names[m], NULL, out_path, text, sizeof(text));
+			full_insts = text_number(text, "Total Instructions:");
+			full_cycles = text_number(text, "Cycles:");
+
+			ok = ok && run_text(simulator, images[w], mode_names[m], "--sample", out_path, text, sizeof(text));
+			insts = text_number(text, "Total Instructions:");
+			estimate = text_number(text, "Est. Cycles:");
+			est = strstr(text, "Est. Cycles:");
+			if (est != NULL && (est = strstr(est, "+/-")) != NULL)
+				error = atof(est + 3);
+
+			ok = ok && full_insts > 0 && insts == full_insts && error >= 0
+				&& estimate - error - CHECK_SAMPLE_SLACK <= full_cycles && full_cycles <= estimate + error + CHECK_SAMPLE_SLACK;
+			printf(" %-10s %-8s %s (%s: %.0f instructions, %.0f +/- %.0f cycles; full run %.0f instructions, %.0f cycles)\n",
+				"sample", mode_names[m], ok ? "PASS" : "FAIL", check_suite[w].name, insts, estimate, error, full_insts, full_cycles);
+			if (!ok)
+				failed++;
+		}
+	}
+
+	return failed;
+}
+
+
+// Each long image runs in NO_FWD and FWD in full and with --slice: the
+// intervals have to add up to the full run's instructions, their cycles
+// have to be within the reported bound of the full run's, and with every
+// boundary exact the cycles and hazards have to be the full run's.
+// Returns the number of runs that failed
+static int check_slicing(const char *simulator, char **images, const char *out_path) {
+	static char text[1 << 16];
+	static const char *counts[] = {"Total Instructions:", "Cycles:", "Total Hazards:"};
+	int failed = 0;
+
+	for (int w = 0; w < CHECK_SUITE_SIZE; w++) {
+		for (int m = 1; m < 3; m++) {
+			double full[3], sliced[3], error = -1;
+			const char *bound;
+			bool ok;
+
+			ok = run_text(simulator, images[w], mode_names[m], NULL, out_path, text, sizeof(text));
+			for (int c = 0; c < 3; c++)
+				full[c] = text_number(text, counts[c]);
+
+			ok = ok && run_text(simulator, images[w], mode_names[m], "--slice=" CHECK_SLICE_LENGTH, out_path, text, sizeof(text));
+			for (int c = 0; c < 3; c++)
+				sliced[c] = text_number(text, counts[c]);
+			bound = strstr(text, "Inexact Boundaries:");
+			if (bound != NULL && (bound = strstr(bound, "+/-")) != NULL)
+				error = atof(bound + 3);
+
+			ok = ok && full[0] > 0 && sliced[0] == full[0] && error >= 0
+				&& sliced[1] - error <= full[1] && full[1] <= sliced[1] + error
+				&& (error > 0 || sliced[2] == full[2]);
+			printf(" %-10s %-8s %s (%s: %.0f instructions, %.0f +/- %.0f cycles, %.0f hazards; full run %.0f, %.0f, %.0f)\n",
+				"slice", mode_names[m], ok ? "PASS" : "FAIL", check_suite[w].name,
+				sliced[0], sliced[1], error, sliced[2], full[0], full[1], full[2]);
+			if (!ok)
+				failed++;
+		}
+	}
+
+	return failed;
+}
+
+
+// Core 0 spins on line 0 until core 1 (entering at line 3) stores the
+// word at line 10 over it, so the loop only ends if core 1's store
+// reaches core 0's decoded copy of the line
+static const uint32_t shared_code_image[] = {
+	0x04030000,	// 0:  ADDI R3, R0, 0
+	0x3860FFF8,	// 1:  BZ R3, back to line 0
+	0x44000000,	// 2:  HALT
+	0x30050028,	// 3:  LDW R5, 40(R0)
+	0x34050000,	// 4:  STW R5, 0(R0)
+	0x44000000,	// 5:  HALT
+	0, 0, 0, 0,
+	0x04030001,	// 10: ADDI R3, R0, 1
+};
+
+#define SHARED_CODE_WORDS (int)(sizeof(shared_code_image) / sizeof(shared_code_image[0]))
+#define SHARED_CODE_LIMIT "1000"
+
+
+// Two cores run shared_code_image in every mode: core 0 has to leave its
+// loop long before the branch limit would end it. Returns the number of
+// modes that failed
+static int check_multicore(const char *simulator, const char *dir, const char *out_path) {
+	static char text[1 << 16];
+	char image[64], entry[80];
+	int failed = 0;
+	FILE *fp;
+
+	snprintf(image, sizeof(image), "%s/shared_code.txt", dir);
+	snprintf(entry, sizeof(entry), "%s@3", image);
+	fp = fopen(image, "w");
+	if (fp == NULL) {
+		perror("Error writing image");
+		return 3;
+	}
+	for (int i = 0; i < SHARED_CODE_WORDS; i++)
+		fprintf(fp, "%08X\n", shared_code_image[i]);
+	fclose(fp);
+
+	for (int m = 0; m < 3; m++) {
+		char *args[] = {(char *)simulator, "NORMAL", (char *)mode_names[m], image, entry, "--cores=2",
+			"--deterministic", "--quantum=7", "--branch-limit=" SHARED_CODE_LIMIT, NULL};
+		const char *core0;
+		double insts = -1;
+		bool ok = false;
+		size_t length;
+
+		if (run_command(args, out_path) == 0 && (fp = fopen(out_path, "r")) != NULL) {
+			length = fread(text, 1, sizeof(text) - 1, fp);
+			text[length] = '\0';
+			fclose(fp);
+
+			core0 = strstr(text, "Core 0:");
+			if (core0 != NULL)
+				insts = text_number(core0, "Total Instructions:");
+			ok = insts > 0 && insts < atof(SHARED_CODE_LIMIT);
+		}
+
+		printf(" %-10s %-8s %s (core 0: %.0f instructions)\n", "multicore", mode_names[m], ok ? "PASS" : "FAIL", insts);
+		if (!ok) {
+			print_output(out_path);
+			failed++;
+		}
+	}
+
+	remove(image);
+	return failed;
+}
+
+
+static int check_main(int argc, char **argv) {
+	const char *simulator = DEFAULT_SIMULATOR;
+	const char *root = DEFAULT_ROOT;
+	char dir[] = "/tmp/mips-check-XXXXXX";
+	char out_path[64];
+	char *images[CHECK_SUITE_SIZE];
+	int failed = 0;
+
+	for (int i = 0; i < argc; i++) {
+		if (strncmp(argv[i], "--sim=", 6) == 0)
+			simulator = argv[i] + 6;
+		else if (strncmp(argv[i], "--root=", 7) == 0)
+			root = argv[i] + 7;
+		else {
+			fprintf(stderr, "Unknown option %s.\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (mkdtemp(dir) == NULL) {
+		perror("Error making a scratch directory");
+		return EXIT_FAILURE;
+	}
+	snprintf(out_path, sizeof(out_path), "%s/out.txt", dir);
+
+	failed += check_validation(simulator, root, out_path);
+
+	for (int w = 0; w < CHECK_SUITE_SIZE; w++) {
+		if ((images[w] = write_check_image(dir, w)) == NULL)
+			return EXIT_FAILURE;
+	}
+	failed += check_sampling(simulator, images, out_path);
+	failed += check_slicing(simulator, images, out_path);
+	failed += check_multicore(simulator, dir, out_path);
+
+	for (int w = 0; w < CHECK_SUITE_SIZE; w++) {
+		remove(images[w]);
+		free(images[w]);
+	}
+	remove(out_path);
+	remove(dir);
+
+	printf("\n %s\n", (failed == 0) ? "All checks passed." : "Some checks FAILED.");
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+
+
+int main(int argc, char **argv) {
+
+	if (argc >= 2 && strcmp(argv[1], "gen") == 0)
+		return gen_main(argc - 2, argv + 2);
+	if (argc >= 2 && strcmp(argv[1], "run") == 0)
+		return run_main(argc - 2, argv + 2);
+	if (argc >= 2 && strcmp(argv[1], "check") == 0)
+		return check_main(argc - 2, argv + 2);
+
+	printf("Usage: %s gen [OPTIONS]        Write a synthetic memory image\n", argv[0]);
+	printf("       %s run [OPTIONS] [IMAGE ...]   Benchmark the simulator (default: generated suite)\n", argv[0]);
+	printf("       %s check [OPTIONS]      Run the simulator's consistency checks\n", argv[0]);
+	printf("gen options:\n");
+	printf("  --body=N           Instructions in the loop body (1-%d, less the footprint)\n", MEMORY_SIZE - GEN_OVERHEAD - 1);
+	printf("  --trips=N          Times the loop runs\n");
+	printf("  --mix=M            Instruction mix weights, e.g. arith:40,logic:20,mul:10,load:15,store:15\n");
+	printf("  --hazard=P         %% of sources that read the previous line's result\n");
+	printf("  --footprint=N      Memory words after the program LDW/STW spread over (1-%d, less the body)\n", MEMORY_SIZE - GEN_OVERHEAD - 1);
+	printf("  --seed=N           Random seed\n");
+	printf("  --out=FILE         Write the image to FILE instead of stdout\n");
+	printf("run options:\n");
+	printf("  --sim=PATH         Simulator to run (default %s)\n", DEFAULT_SIMULATOR);
+	printf("  --out=FILE         Results file (default %s)\n", DEFAULT_OUTPUT);
+	printf("  --runs=N           Runs per workload and mode; the fastest counts (default %d)\n", DEFAULT_RUNS);
+	printf("  --scale=N          Multiply the suite's loop trip counts by N\n");
+	printf("  --label=NAME       Name for this build in the results\n");
+	printf("  --compare=FILE     Compare with an earlier results file\n");
+	printf("  --threshold=P      %% slower per instruction that fails --compare (default %.0f)\n", DEFAULT_THRESHOLD);
+	printf("check options:\n");
+	printf("  --sim=PATH         Simulator to check (default %s)\n", DEFAULT_SIMULATOR);
+	printf("  --root=DIR         Simulator source directory holding the shipped images (default %s)\n", DEFAULT_ROOT);
+	return EXIT_FAILURE;
+}
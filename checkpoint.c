@@ -0,0 +1,389 @@
+/**
+ * checkpoint.c - Machine state checkpoints for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * A checkpoint file is a header followed by the raw bytes of every piece
+ * of simulator state, in the order checkpoint_regions() lists them:
+ *
+ *				HEADER:		Magic, version, functional mode, and a hash
+ *							of the loaded program so a checkpoint can't
+ *							be restored onto a different trace file.
+ *
+ *				STATE:		Registers, memory and their used flags, PC,
+ *							statistic counters and the pipeline latches.
+ *
+ * Saving is one writev() straight out of the live variables, and
+ * restoring maps the file and copies each region back in place.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "mips.h"
+
+// Files are opened with stdio rather than <unistd.h>, whose pipe()
+// would clash with the pipeline global of the same name
+
+
+// Most regions a checkpoint is made of
+#define MAX_REGIONS 40
+
+
+// struct to hold the checkpoint file header
+typedef struct checkpoint_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t state_size;        // bytes of state after the header
+	int32_t functional_mode;
+	int32_t program_length;
+	uint32_t program_hash;
+	int32_t resume_line;        // line to restart at in another mode
+} checkpointHeader;
+
+
+static const char *checkpoint_path = NULL;
+static int checkpoint_at = -1;
+volatile sig_atomic_t checkpoint_signalled = 0;
+
+
+
+
+// Points iov[] at every piece of state a checkpoint holds, leaving out
+// memory and its used flags unless 'with_memory'.
+// Built on each call so the thread-local addresses are the caller's.
+static int checkpoint_regions(struct iovec *iov, bool with_memory) {
+	int n = 0;
+
+#define REGION(x) do { iov[n].iov_base = (void *)&(x); iov[n].iov_len = sizeof(x); n++; } while (0)
+#define ARRAY_REGION(p, count) do { iov[n].iov_base = (void *)(p); iov[n].iov_len = (count) * sizeof(*(p)); n++; } while (0)
+	REGION(registers);
+	REGION(register_used);
+	if (with_memory) {
+		ARRAY_REGION(memory, MEMORY_SIZE);
+		ARRAY_REGION(memory_used, MEMORY_SIZE);
+	}
+
+	REGION(pc);
+	REGION(cycle_counter);
+	REGION(total_inst_count);
+	REGION(opcode_count);
+	REGION(total_stalls);
+	REGION(hazard_count);
+	REGION(cpi);
+	REGION(successful_branch_limiter);
+	REGION(last_executed_line);
+
+	REGION(pipe);
+	REGION(newinst);
+	REGION(newInstAdded);
+	REGION(end_of_fetch);
+	REGION(hazard);
+	REGION(was_control_flow);
+	REGION(halt_executed);
+	REGION(ready_to_end);
+#undef REGION
+#undef ARRAY_REGION
+
+	return n;
+}
+
+
+// FNV-1a hash of the image as it was loaded (program_store changes when
+// the program stores into itself)
+static uint32_t program_hash() {
+	const unsigned char *bytes = (const unsigned char *)rawHex_array;
+	size_t size = (size_t)program_length * sizeof(uint32_t);
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+
+// Line a run restarts at when the checkpoint's pipeline isn't restored:
+// the oldest line in the pipeline that hasn't reached EX yet, or else the
+// line after the last one executed
+static int resume_line() {
+	const decodedLine *slots[5] = {&pipe.pipe1, &pipe.pipe2, &pipe.pipe3, &pipe.pipe4, &pipe.pipe5};
+	const decodedLine *oldest = NULL;
+
+	if (functional_mode == NO_PIPE)
+		return pc;
+
+	for (int i = 0; i < 5; i++) {
+		if (slots[i]->pipe_stage >= IF && slots[i]->pipe_stage <= EX && slots[i]->line_index >= 0
+		  && (oldest == NULL || slots[i]->pipe_stage > oldest->pipe_stage))
+			oldest = slots[i];
+	}
+
+	if (oldest != NULL)
+		return oldest->line_index;
+	return next_line();
+}
+
+
+
+
+static size_t regions_size(bool with_memory) {
+	struct iovec iov[MAX_REGIONS];
+	size_t size = 0;
+	int n = checkpoint_regions(iov, with_memory);
+
+	for (int i = 0; i < n; i++)
+		size += iov[i].iov_len;
+	return size;
+}
+
+
+static void capture_regions(void *buf, bool with_memory) {
+	struct iovec iov[MAX_REGIONS];
+	unsigned char *out = buf;
+	int n = checkpoint_regions(iov, with_memory);
+
+	for (int i = 0; i < n; i++) {
+		memcpy(out, iov[i].iov_base, iov[i].iov_len);
+		out += iov[i].iov_len;
+	}
+}
+
+
+static void apply_regions(const void *buf, bool with_memory) {
+	struct iovec iov[MAX_REGIONS];
+	const unsigned char *in = buf;
+	int n = checkpoint_regions(iov, with_memory);
+
+	for (int i = 0; i < n; i++) {
+		memcpy(iov[i].iov_base, in, iov[i].iov_len);
+		in += iov[i].iov_len;
+	}
+}
+
+
+size_t state_size() {
+	return regions_size(true);
+}
+
+
+void capture_state(void *buf) {
+	capture_regions(buf, true);
+}
+
+
+void apply_state(const void *buf) {
+	apply_regions(buf, true);
+	rebuild_dirty_map();
+
+	// The restored memory may hold code stored since the program loaded
+	invalidate_code();
+}
+
+
+size_t core_state_size() {
+	return regions_size(false);
+}
+
+
+void capture_core_state(void *buf) {
+	capture_regions(buf, false);
+}
+
+
+void apply_core_state(const void *buf) {
+	apply_regions(buf, false);
+}
+
+
+
+
+bool save_checkpoint(const char *path) {
+	struct iovec iov[MAX_REGIONS + 1];
+	checkpointHeader header;
+	char temp_path[FILENAME_MAX];
+	size_t total;
+	FILE *fp;
+	int n;
+
+	n = checkpoint_regions(iov + 1, true);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.functional_mode = functional_mode;
+	header.program_length = program_length;
+	header.program_hash = program_hash();
+	header.resume_line = resume_line();
+	for (int i = 1; i <= n; i++)
+		header.state_size += iov[i].iov_len;
+
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	total = sizeof(header) + header.state_size;
+
+	// Write next to the old checkpoint and rename over it, so a crash
+	// mid-write never leaves a half-written file behind
+	snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+	fp = fopen(temp_path, "wb");
+	if (fp == NULL) {
+		perror("Error writing checkpoint");
+		return false;
+	}
+
+	if (writev(fileno(fp), iov, n + 1) != (ssize_t)total) {
+		perror("Error writing checkpoint");
+		fclose(fp);
+		remove(temp_path);
+		return false;
+	}
+
+	fclose(fp);
+	if (rename(temp_path, path) != 0) {
+		perror("Error writing checkpoint");
+		remove(temp_path);
+		return false;
+	}
+
+	return true;
+}
+
+
+bool restore_checkpoint(const char *path) {
+	checkpointHeader header;
+	struct stat st;
+	const unsigned char *base;
+	size_t size = state_size();
+	FILE *fp;
+
+	fp = fopen(path, "rb");
+	if (fp == NULL) {
+		perror("Error opening checkpoint");
+		return false;
+	}
+
+	if (fstat(fileno(fp), &st) != 0 || (size_t)st.st_size != sizeof(header) + size) {
+		printf("\n%s is not a checkpoint from this simulator.\n", path);
+		fclose(fp);
+		return false;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+	fclose(fp);
+	if (base == MAP_FAILED) {
+		perror("Error reading checkpoint");
+		return false;
+	}
+
+	memcpy(&header, base, sizeof(header));
+
+	if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0
+	  || header.version != CHECKPOINT_VERSION || header.state_size != size) {
+		printf("\n%s is not a checkpoint from this simulator.\n", path);
+		munmap((void *)base, st.st_size);
+		return false;
+	}
+
+	if (header.program_length != program_length || header.program_hash != program_hash()) {
+		printf("\n%s was taken from a different trace file.\n", path);
+		munmap((void *)base, st.st_size);
+		return false;
+	}
+
+	apply_state(base + sizeof(header));
+	munmap((void *)base, st.st_size);
+
+	// A checkpoint from another mode only carries over the architectural
+	// state; the pipeline starts empty at the next unexecuted line
+	if (header.functional_mode != functional_mode) {
+		if (mode == DEBUG) printf("\nCheckpoint was taken in another mode, restarting at line %d\n", header.resume_line);
+		reset_pipeline(header.resume_line);
+		if (functional_mode == NO_PIPE)
+			pc = header.resume_line;
+	}
+
+	if (mode == DEBUG) printf("\nRestored %s at instruction %d, cycle %d\n", path, total_inst_count, cycle_counter);
+
+	return true;
+}
+
+
+void resume_simulation() {
+
+	if (ready_to_end)
+		return;
+
+	if (functional_mode == NO_PIPE)
+		run_nopipe(pc);
+	else
+		run_pipeline();
+}
+
+
+
+
+// Only the flag is written here; the run loop sees it before its next
+// instruction and takes the checkpoint from inst_event()
+static void checkpoint_signal(int sig) {
+	(void)sig;
+	checkpoint_signalled = 1;
+}
+
+
+void start_checkpoints(const char *path, int at) {
+	struct sigaction action;
+
+	checkpoint_path = path;
+	checkpoint_at = at;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = checkpoint_signal;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &action, NULL);
+
+	if (checkpoint_at >= 0)
+		schedule_inst_event(checkpoint_at);
+}
+
+
+void checkpoint_inst_event() {
+	bool due = false;
+
+	if (checkpoint_path == NULL)
+		return;
+
+	if (checkpoint_signalled) {
+		checkpoint_signalled = 0;
+		due = true;
+	}
+
+	if (checkpoint_at >= 0 && total_inst_count >= checkpoint_at) {
+		checkpoint_at = -1;
+		due = true;
+	}
+
+	if (due && save_checkpoint(checkpoint_path)) {
+		flush_debug_log();
+		printf("\nCheckpoint written to %s at instruction %d, cycle %d\n", checkpoint_path, total_inst_count, cycle_counter);
+	}
+
+	if (checkpoint_at >= 0)
+		schedule_inst_event(checkpoint_at);
+}
@@ -0,0 +1,194 @@
+/**
+ * debuglog.c - Asynchronous DEBUG output for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * DEBUG messages are logged as fixed-size binary records instead of being
+ * printed where they happen:
+ *
+ *				RECORD:		The printf format (whose address is the event
+ *							id, since every format is a string literal)
+ *							and up to DEBUG_LOG_ARGS int arguments.
+ *
+ *				RING:		A bounded lock-free queue of records. Any
+ *							thread (every core of a multi-core run) can
+ *							add to it; a producer only waits if it's full.
+ *
+ *				PRINTER:	A background thread takes records off the
+ *							ring in order and printf()s them, so the text
+ *							is exactly what the simulator used to print.
+ *
+ * Anything printed straight to stdout while the run is going has to call
+ * flush_debug_log() first, or it would come out ahead of older messages.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "mips.h"
+
+
+// Records in the ring (a power of two)
+#define DEBUG_LOG_RECORDS 65536
+
+// How long the printer sleeps when the ring is empty
+#define DEBUG_LOG_IDLE_NS 50000
+
+
+// struct to hold one DEBUG message
+typedef struct debug_record {
+	size_t sequence;            // which lap of the ring the record is on
+	const char *format;
+	int32_t args[DEBUG_LOG_ARGS];
+} debugRecord;
+
+
+static debugRecord *ring = NULL;
+static size_t add_position = 0;         // next record a producer claims
+static size_t printed_position = 0;     // records the printer has finished
+static bool stopping = false;
+static bool started = false;
+static pthread_t printer;
+
+
+
+
+static void print_record(const debugRecord *r) {
+	printf(r->format, r->args[0], r->args[1], r->args[2], r->args[3],
+		r->args[4], r->args[5], r->args[6], r->args[7], r->args[8], r->args[9]);
+}
+
+
+static void *printer_main(void *arg) {
+	const struct timespec idle = {0, DEBUG_LOG_IDLE_NS};
+	size_t position = 0;
+
+	(void)arg;
+
+	while (1) {
+		debugRecord *r = &ring[position & (DEBUG_LOG_RECORDS - 1)];
+
+		// The producer publishes a record by setting its sequence to position + 1
+		if (__atomic_load_n(&r->sequence, __ATOMIC_ACQUIRE) == position + 1) {
+			print_record(r);
+			__atomic_store_n(&r->sequence, position + DEBUG_LOG_RECORDS, __ATOMIC_RELEASE);
+			position++;
+			__atomic_store_n(&printed_position, position, __ATOMIC_RELEASE);
+			continue;
+		}
+
+		if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)
+		  && position == __atomic_load_n(&add_position, __ATOMIC_ACQUIRE))
+			break;
+
+		fflush(stdout);
+		nanosleep(&idle, NULL);
+	}
+
+	fflush(stdout);
+	return NULL;
+}
+
+
+static void stop_debug_log() {
+	if (!started)
+		return;
+
+	flush_debug_log();
+	__atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+	pthread_join(printer, NULL);
+	started = false;
+}
+
+
+
+
+bool start_debug_log() {
+
+	if (started)
+		return true;
+
+	ring = malloc(DEBUG_LOG_RECORDS * sizeof(debugRecord));
+	if (ring == NULL)
+		return false;
+
+	for (size_t i = 0; i < DEBUG_LOG_RECORDS; i++)
+		ring[i].sequence = i;
+
+	if (pthread_create(&printer, NULL, printer_main, NULL) != 0) {
+		free(ring);
+		ring = NULL;
+		return false;
+	}
+
+	started = true;
+	atexit(stop_debug_log);
+	return true;
+}
+
+
+void debug_log_record(const char *format, const int32_t *args) {
+	size_t position;
+	debugRecord *r;
+
+	// Without the printer thread, print it straight away
+	if (!started) {
+		debugRecord now;
+		now.format = format;
+		memcpy(now.args, args, sizeof(now.args));
+		print_record(&now);
+		return;
+	}
+
+	position = __atomic_load_n(&add_position, __ATOMIC_RELAXED);
+
+	while (1) {
+		r = &ring[position & (DEBUG_LOG_RECORDS - 1)];
+		size_t sequence = __atomic_load_n(&r->sequence, __ATOMIC_ACQUIRE);
+
+		// Free on this lap: try to claim it
+		if (sequence == position) {
+			if (__atomic_compare_exchange_n(&add_position, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+
+		// Still holding last lap's record: the ring is full
+		else if ((ptrdiff_t)(sequence - position) < 0) {
+			sched_yield();
+			position = __atomic_load_n(&add_position, __ATOMIC_RELAXED);
+		}
+
+		// Another producer claimed it first
+		else
+			position = __atomic_load_n(&add_position, __ATOMIC_RELAXED);
+	}
+
+	r->format = format;
+	memcpy(r->args, args, sizeof(r->args));
+	__atomic_store_n(&r->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+
+void flush_debug_log() {
+
+	if (!started)
+		return;
+
+	while (__atomic_load_n(&printed_position, __ATOMIC_ACQUIRE) != __atomic_load_n(&add_position, __ATOMIC_ACQUIRE))
+		sched_yield();
+
+	fflush(stdout);
+}
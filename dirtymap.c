@@ -0,0 +1,206 @@
+/**
+ * dirtymap.c - Dirty-word bitmaps and state deltas for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Keeps track of which memory words a run has used, so the end of a run
+ * only looks at those instead of all MEMORY_SIZE of them:
+ *
+ *				WORDS:		One bit per memory word, set the first time
+ *							a LDW or STW uses it (or a checkpoint or lane
+ *							puts back a used word).
+ *
+ *				PAGES:		One bit per 64 word page, set with the first
+ *							word bit in it. Finding the next used word
+ *							skips empty pages 64 at a time and empty
+ *							words in a page with one count of trailing
+ *							zeros.
+ *
+ * A bit may stay set after a word's used flag is put back (a rewind, a
+ * loop fast-forward that didn't pan out), so memory_used[] still has the
+ * last say; the bitmaps only ever add words to look at.
+ *
+ * They also give a compact binary delta of the final memory (--delta=FILE):
+ *
+ *				HEADER:		deltaHeader ("MIPSDLTA", version, memory
+ *							size, image length, runs), in host byte
+ *							order.
+ *
+ *				RUNS:		For each run of consecutive words that ended
+ *							different from the initial image (0 past its
+ *							end): the first word, the word count, then
+ *							that many int32 contents.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mips.h"
+
+
+// struct to hold the delta file header
+typedef struct delta_header {
+	char magic[8];              // DELTA_MAGIC
+	uint32_t version;
+	uint32_t memory_size;       // words in memory[]
+	uint32_t image_length;      // words in the initial image
+	uint32_t runs;              // runs after the header
+} deltaHeader;
+
+
+bool delta_dump = false;
+
+static const char *delta_path = NULL;
+
+
+
+
+void mark_dirty(int w) {
+	uint64_t bit = 1ULL << (w & 63);
+
+	// Cores share memory[] and its bitmaps
+	if (!(__atomic_load_n(&dirty_map->words[w >> 6], __ATOMIC_RELAXED) & bit)) {
+		__atomic_fetch_or(&dirty_map->words[w >> 6], bit, __ATOMIC_RELAXED);
+		__atomic_fetch_or(&dirty_map->pages[w >> 12], 1ULL << ((w >> 6) & 63), __ATOMIC_RELAXED);
+	}
+}
+
+
+void clear_dirty_map() {
+	memset(dirty_map, 0, sizeof(dirtyMap));
+}
+
+
+void rebuild_dirty_map() {
+
+	clear_dirty_map();
+	for (int w = 0; w < MEMORY_SIZE; w++) {
+		if (memory_used[w])
+			mark_dirty(w);
+	}
+}
+
+
+
+
+// First page at or after 'page' with a dirty word in it, -1 if none
+static int next_dirty_page(int page) {
+	int p = page >> 6;
+	uint64_t bits;
+
+	if (page >= DIRTY_PAGES)
+		return -1;
+
+	bits = dirty_map->pages[p] & (~0ULL << (page & 63));
+	while (bits == 0) {
+		if (++p >= DIRTY_PAGE_MASKS)
+			return -1;
+		bits = dirty_map->pages[p];
+	}
+	return p * 64 + __builtin_ctzll(bits);
+}
+
+
+int next_used_word(int w) {
+	int page = w >> 6;
+	uint64_t bits;
+
+	if (w < 0 || w >= MEMORY_SIZE)
+		return -1;
+
+	bits = dirty_map->words[page] & (~0ULL << (w & 63));
+	for (;;) {
+		while (bits != 0) {
+			w = page * 64 + __builtin_ctzll(bits);
+			if (memory_used[w])
+				return w;
+			bits &= bits - 1;
+		}
+
+		page = next_dirty_page(page + 1);
+		if (page < 0)
+			return -1;
+		bits = dirty_map->words[page];
+	}
+}
+
+
+
+
+void start_delta(const char *path) {
+	delta_path = path;
+	delta_dump = true;
+}
+
+
+// What word 'w' held when the image was loaded
+static int32_t initial_word(int w) {
+	return (w < program_length) ? (int32_t)rawHex_array[w] : 0;
+}
+
+
+bool write_delta() {
+	deltaHeader header;
+	int32_t *buffer;
+	size_t used = 0;
+	int dirty = 0;
+	int run_start = -1;         // buffer index of the open run's header, -1 if none
+	int last = -2;              // last word added to the open run
+	bool ok;
+	FILE *fp;
+
+	// Every changed word is dirty, so the dirty words bound the delta:
+	// at worst a run of its own each (two header words and the contents)
+	for (int p = 0; p < DIRTY_PAGES; p++)
+		dirty += __builtin_popcountll(dirty_map->words[p]);
+	buffer = malloc((3 * (size_t)dirty + 1) * sizeof(int32_t));
+	if (buffer == NULL) {
+		printf("\nNot enough memory for the delta of %d words.\n", dirty);
+		return false;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DELTA_MAGIC, sizeof(header.magic));
+	header.version = DELTA_VERSION;
+	header.memory_size = MEMORY_SIZE;
+	header.image_length = program_length;
+
+	for (int w = next_used_word(0); w >= 0; w = next_used_word(w + 1)) {
+		if (memory[w] == initial_word(w))
+			continue;
+
+		if (w != last + 1) {
+			run_start = (int)used;
+			buffer[used++] = w;
+			buffer[used++] = 0;
+			header.runs++;
+		}
+		buffer[used++] = memory[w];
+		buffer[run_start + 1]++;
+		last = w;
+	}
+
+	fp = fopen(delta_path, "wb");
+	if (fp == NULL) {
+		perror("Error writing the memory delta");
+		free(buffer);
+		return false;
+	}
+	ok = fwrite(&header, sizeof(header), 1, fp) == 1
+		&& fwrite(buffer, sizeof(int32_t), used, fp) == used;
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok)
+		perror("Error writing the memory delta");
+
+	free(buffer);
+	return ok;
+}
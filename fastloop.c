@@ -0,0 +1,422 @@
+/**
+ * fastloop.c - Loop fast-forwarding for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Skips most of the iterations of a loop that has settled into a steady
+ * state, in any functional mode:
+ *
+ *				DETECTION:	Going back to an earlier line closes an
+ *							iteration. Every executed line of it is
+ *							recorded with its branch outcome (and a JR's
+ *							target). When the last few iterations (the
+ *							pipeline can alternate between them) follow
+ *							the same paths as the ones before, end with
+ *							the pipeline in the same state and add the
+ *							same cycles, stalls, hazards and CPI stack
+ *							cycles, the next ones will too.
+ *
+ *				BULK:		The recorded paths are then executed over and
+ *							over through the opcode table alone, with no
+ *							pipeline, while every branch goes the way it
+ *							did and no line of them is stored to. The
+ *							counters are advanced by the recorded amounts
+ *							for every repetition, so they end up exactly
+ *							where a full run puts them.
+ *
+ *				FALL BACK:	A repetition that would leave the paths is
+ *							undone (registers, limiter and stores) and run
+ *							by the engine as normal. A skip never crosses
+ *							a scheduled instruction or cycle event, so
+ *							events still fire at the same instruction.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mips.h"
+
+
+// Longest iteration (executed lines) that is tracked. An iteration only
+// moves forward through the program, so this is room for any program
+#define FAST_LOOP_BODY (MEMORY_SIZE + 1)
+
+// Longest run of iterations the pipeline can take to come back to the same
+// state: a line goes into whichever of the five slots is free, so the slots
+// an iteration sits in can shift from one iteration to the next
+#define FAST_LOOP_PERIOD 5
+
+// Iteration boundaries remembered: two periods and the one before them
+#define FAST_LOOP_HISTORY (2 * FAST_LOOP_PERIOD + 1)
+
+
+// struct to hold one executed line of an iteration
+typedef struct loop_step {
+	int line;
+	bool taken;                     // it changed the flow of control
+	int32_t target;                 // a JR's register value
+} loopStep;
+
+// struct to hold the state an iteration boundary is compared on
+typedef struct loop_signature {
+	pipeline pipe;
+	decodedLine newinst;
+	int pc;
+	bool newInstAdded;
+	bool hazard;
+	bool end_of_fetch;
+	bool was_jrfunc_for_nopipe;
+	int8_t pending[CPI_PENDING];
+	int pending_count;
+	int last_cause;
+	bool filled;
+} loopSignature;
+
+// struct to hold the counters an iteration advances
+typedef struct loop_counters {
+	int cycles;
+	int insts;
+	int stalls;
+	int hazards;
+	int cpi[CPI_CAUSES];
+} loopCounters;
+
+// struct to hold one iteration boundary and the iteration it closed
+typedef struct loop_boundary {
+	loopStep path[FAST_LOOP_BODY];
+	int path_length;
+	loopSignature signature;
+	loopCounters counters;
+} loopBoundary;
+
+// struct to hold a word an undone iteration stored to
+typedef struct loop_undo {
+	int word;
+	int32_t value;
+	bool used;
+} loopUndo;
+
+
+bool fast_loops = false;
+SIM_LOCAL bool fast_loops_held = false;
+
+// Totals across every thread that ran a program
+static long long loops_skipped = 0;
+static long long iterations_skipped = 0;
+static long long insts_skipped = 0;
+
+// The loop being watched: its back edge and the line it goes back to
+static SIM_LOCAL int back_line = -1;
+static SIM_LOCAL int head_line = -1;
+
+static SIM_LOCAL int prev_line = -1;
+
+// The iteration being executed
+static SIM_LOCAL loopStep path[FAST_LOOP_BODY];
+static SIM_LOCAL int path_length;
+static SIM_LOCAL bool path_overflow;
+
+// The last boundaries of the watched loop, history[boundaries % FAST_LOOP_HISTORY]
+// being the next one
+static SIM_LOCAL loopBoundary history[FAST_LOOP_HISTORY];
+static SIM_LOCAL int boundaries;
+
+
+
+
+static void read_signature(loopSignature *s) {
+	memset(s, 0, sizeof(loopSignature));
+	s->pipe = pipe;
+	s->newinst = newinst;
+	s->pc = pc;
+	s->newInstAdded = newInstAdded;
+	s->hazard = hazard;
+	s->end_of_fetch = end_of_fetch;
+	s->was_jrfunc_for_nopipe = was_jrfunc_for_nopipe;
+	memcpy(s->pending, cpi.pending, sizeof(s->pending));
+	s->pending_count = cpi.pending_count;
+	s->last_cause = cpi.last_cause;
+	s->filled = cpi.filled;
+}
+
+
+static void read_counters(loopCounters *c) {
+	c->cycles = cycle_counter;
+	c->insts = total_inst_count;
+	c->stalls = total_stalls;
+	c->hazards = hazard_count;
+	memcpy(c->cpi, cpi.cycles, sizeof(c->cpi));
+}
+
+
+// The boundary 'back' before the latest one
+static loopBoundary *boundary(int back) {
+	return &history[(boundaries - 1 - back) % FAST_LOOP_HISTORY];
+}
+
+
+static bool same_path(const loopBoundary *a, const loopBoundary *b) {
+	if (a->path_length < 0 || a->path_length != b->path_length)
+		return false;
+
+	for (int s = 0; s < a->path_length; s++) {
+		if (a->path[s].line != b->path[s].line || a->path[s].taken != b->path[s].taken || a->path[s].target != b->path[s].target)
+			return false;
+	}
+	return true;
+}
+
+
+// What the counters advanced by between two boundaries
+static void counters_between(loopCounters *delta, const loopBoundary *from, const loopBoundary *to) {
+	delta->cycles = to->counters.cycles - from->counters.cycles;
+	delta->insts = to->counters.insts - from->counters.insts;
+	delta->stalls = to->counters.stalls - from->counters.stalls;
+	delta->hazards = to->counters.hazards - from->counters.hazards;
+	for (int k = 0; k < CPI_CAUSES; k++)
+		delta->cpi[k] = to->counters.cpi[k] - from->counters.cpi[k];
+}
+
+
+// Looks for the shortest run of iterations that the loop repeats exactly:
+// the same paths, back at the same state, advancing the counters by the
+// same amounts twice in a row. Returns its length, or 0
+static int find_period(loopCounters *delta) {
+	for (int p = 1; p <= FAST_LOOP_PERIOD && 2 * p < boundaries; p++) {
+		loopCounters before;
+		int insts = 0;
+		bool same = true;
+
+		for (int k = 0; k < p && same; k++) {
+			same = same_path(boundary(k), boundary(k + p));
+			insts += boundary(k)->path_length;
+		}
+		if (!same)
+			continue;
+
+		if (memcmp(&boundary(0)->signature, &boundary(p)->signature, sizeof(loopSignature)) != 0
+		  || memcmp(&boundary(p)->signature, &boundary(2 * p)->signature, sizeof(loopSignature)) != 0)
+			continue;
+
+		counters_between(delta, boundary(p), boundary(0));
+		counters_between(&before, boundary(2 * p), boundary(p));
+		if (memcmp(delta, &before, sizeof(loopCounters)) == 0 && delta->insts == insts)
+			return p;
+	}
+	return 0;
+}
+
+
+
+
+// Executes the paths of the last 'period' iterations, oldest first, up to
+// 'count' times. Returns how many times they were followed all the way;
+// the time they weren't is undone
+static int run_periods(int period, int count) {
+	int32_t saved_registers[NUM_REGISTERS];
+	bool saved_used[NUM_REGISTERS];
+	loopUndo undo[FAST_LOOP_PERIOD * FAST_LOOP_BODY];
+	int saved_pc = pc;
+	bool saved_control_flow = was_control_flow;
+	bool saved_jr = was_jrfunc_for_nopipe;
+	int n;
+
+	for (n = 0; n < count; n++) {
+		int saved_limiter = successful_branch_limiter;
+		int stores = 0;
+		bool same = true;
+
+		memcpy(saved_registers, registers, sizeof(saved_registers));
+		memcpy(saved_used, register_used, sizeof(saved_used));
+
+		for (int k = period - 1; k >= 0 && same; k--) {
+			const loopBoundary *iteration = boundary(k);
+
+			for (int s = 0; s < iteration->path_length && same; s++) {
+				const loopStep *step = &iteration->path[s];
+				const decodedLine *line = &program_store[step->line];
+				const opcodeInfo *info = OPCODE_INFO(line->instruction);
+
+				// A line stored to since it was recorded isn't the same line, and
+				// a branch past the branch limit flags control flow without jumping
+				if (code_stale[step->line] || info->execute == NULL || line->instruction == HALT
+				  || (info->class == CLASS_CONTROL && successful_branch_limiter >= successful_branch_limiter_count)
+				  || (line->instruction == JR && registers[line->first_reg_val] != step->target)) {
+					same = false;
+					break;
+				}
+
+				if (line->instruction == STW) {
+					int w = MEMORY_INDEX((uint32_t)registers[line->first_reg_val] + (int16_t)line->immediate);
+
+					undo[stores].word = w;
+					undo[stores].value = memory[w];
+					undo[stores].used = memory_used[w];
+					stores++;
+				}
+
+				rtype = 0;
+				was_control_flow = 0;
+				info->execute(line);
+
+				// A store into the program ends the run; the engine decodes
+				// the line again and carries on from there
+				if (was_control_flow != step->taken
+				  || (line->instruction == STW && undo[stores - 1].word < program_length && code_stale[undo[stores - 1].word]))
+					same = false;
+			}
+		}
+
+		// The branches only steered the paths; the engine's pc is untouched
+		pc = saved_pc;
+		was_control_flow = saved_control_flow;
+		was_jrfunc_for_nopipe = saved_jr;
+
+		if (!same) {
+			while (stores-- > 0) {
+				memory[undo[stores].word] = undo[stores].value;
+				memory_used[undo[stores].word] = undo[stores].used;
+			}
+			memcpy(registers, saved_registers, sizeof(saved_registers));
+			memcpy(register_used, saved_used, sizeof(saved_used));
+			successful_branch_limiter = saved_limiter;
+			break;
+		}
+	}
+
+	return n;
+}
+
+
+// The loop repeats every 'period' iterations: skip as many of those as
+// follow the same paths before the next scheduled event
+static void skip_periods(int period, const loopCounters *delta) {
+	int count = (inst_event_count - 1 - total_inst_count) / delta->insts;
+	int n;
+
+	if (delta->cycles > 0 && (cycle_event_count - 1 - cycle_counter) / delta->cycles < count)
+		count = (cycle_event_count - 1 - cycle_counter) / delta->cycles;
+	if (count <= 0)
+		return;
+
+	n = run_periods(period, count);
+	if (n == 0)
+		return;
+
+	cycle_counter += n * delta->cycles;
+	total_inst_count += n * delta->insts;
+	total_stalls += n * delta->stalls;
+	hazard_count += n * delta->hazards;
+	for (int k = 0; k < CPI_CAUSES; k++)
+		cpi.cycles[k] += n * delta->cpi[k];
+	for (int k = 0; k < period; k++) {
+		for (int s = 0; s < boundary(k)->path_length; s++)
+			opcode_count[(uint8_t)program_store[boundary(k)->path[s].line].instruction] += n;
+	}
+
+	__atomic_add_fetch(&loops_skipped, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&iterations_skipped, (long long)n * period, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&insts_skipped, (long long)n * delta->insts, __ATOMIC_RELAXED);
+}
+
+
+// The watched loop went round again: remember the iteration and skip ahead
+// once the loop repeats
+static void iteration_boundary() {
+	loopBoundary *latest = &history[boundaries % FAST_LOOP_HISTORY];
+	loopCounters delta;
+	int period;
+
+	memcpy(latest->path, path, path_length * sizeof(loopStep));
+	latest->path_length = path_overflow ? -1 : path_length;
+	read_signature(&latest->signature);
+	read_counters(&latest->counters);
+	if (++boundaries == 2 * FAST_LOOP_HISTORY)
+		boundaries = FAST_LOOP_HISTORY;
+
+	path_length = 0;
+	path_overflow = false;
+
+	period = find_period(&delta);
+	if (period > 0) {
+		skip_periods(period, &delta);
+
+		// Learn the loop again from here
+		boundaries = 0;
+	}
+}
+
+
+
+
+void start_fast_loops() {
+	fast_loops = true;
+}
+
+
+void reset_fast_loops() {
+	back_line = -1;
+	head_line = -1;
+	prev_line = -1;
+	path_length = 0;
+	path_overflow = false;
+	boundaries = 0;
+}
+
+
+void fast_loop_executed(const decodedLine *line) {
+	int from = prev_line;
+
+	// Whoever is stepping counts every line; start over afterwards
+	if (fast_loops_held) {
+		reset_fast_loops();
+		return;
+	}
+
+	// NOPs aren't counted as instructions, so they aren't part of the path
+	if (OPCODE_INFO(line->instruction)->execute == NULL)
+		return;
+
+	if (path_length < FAST_LOOP_BODY) {
+		path[path_length].line = line->line_index;
+		path[path_length].taken = was_control_flow;
+		path[path_length].target = (line->instruction == JR) ? registers[line->first_reg_val] : 0;
+		path_length++;
+	}
+	else
+		path_overflow = true;
+
+	prev_line = line->line_index;
+
+	// Only control flow goes back to an earlier line
+	if (line->line_index > from || ready_to_end || halt_executed)
+		return;
+
+	// A different back edge: start watching that loop
+	if (from != back_line || line->line_index != head_line) {
+		back_line = from;
+		head_line = line->line_index;
+		boundaries = 0;
+	}
+
+	iteration_boundary();
+}
+
+
+void print_fast_loop_stats() {
+	printf("\n\n\n Loop Fast-Forwarding:\n");
+	printf("================================================\n");
+	printf(" Skips:			%lld\n", loops_skipped);
+	printf(" Iterations Skipped:	%lld\n", iterations_skipped);
+	printf(" Instructions Skipped:	%lld\n", insts_skipped);
+	printf("================================================\n");
+}
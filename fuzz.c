@@ -0,0 +1,351 @@
+/**
+ * fuzz.c - Fuzzing harness for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Runs a fuzzer's inputs through the decoder and every execution engine,
+ * looking for crashes and for engines that disagree:
+ *
+ *				INPUT:		The bytes are the image itself, one 32 bit
+ *							instruction word per 4 bytes in host byte
+ *							order, up to MEMORY_SIZE words.
+ *
+ *				RUNS:		The image runs through the reference
+ *							(functional_step()) and then NO_PIPE, NO_FWD
+ *							and FWD, each for at most FUZZ_MAX_INSTS
+ *							instructions, with no branch limit.
+ *
+ *				CHECK:		A crash or a sanitizer report is a finding,
+ *							and so is a mode that doesn't end having
+ *							executed as many instructions as the
+ *							reference did, with the same registers and
+ *							memory: both states are printed and the
+ *							harness aborts, so the fuzzer keeps the input.
+ *
+ *				RESET:		The image is decoded once per input. Between
+ *							runs only what a run can have changed is put
+ *							back: the memory words its loads and stores
+ *							reached, the lines decoded from them, and the
+ *							registers and counters. Nothing is cleared
+ *							MEMORY_SIZE words at a time.
+ *
+ * Built with -DFUZZING, mips.c leaves out its main(). With libFuzzer
+ * (clang -fsanitize=fuzzer) the fuzzer supplies one; with -DFUZZ_MAIN
+ * this file does, running the files named on the command line once each,
+ * or with none, a stream of random instruction-shaped images:
+ *
+ *		./fuzz [-runs=N] [-seed=N] [input ...]
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include "mips.h"
+
+
+// Engines each input runs through; the reference comes first
+#define FUZZ_REFERENCE 0
+#define FUZZ_ENGINES 4
+
+
+// struct to hold the state an engine ended an input with
+typedef struct fuzz_result {
+	int insts;
+	bool halted;
+	int32_t registers[NUM_REGISTERS];
+	uint64_t memory;            // signature of the non-zero memory words
+} fuzzResult;
+
+
+bool fuzzing = false;
+
+static const int engine_modes[FUZZ_ENGINES] = {NO_PIPE, NO_PIPE, NO_FWD, FWD};
+static const char *engine_names[FUZZ_ENGINES] = {"Reference", "NO_PIPE", "NO_FWD", "FWD"};
+
+// Memory words a LDW/STW has reached since the last reset
+static int touched[MEMORY_SIZE];
+static bool is_touched[MEMORY_SIZE];
+static int touched_count;
+
+
+
+
+void fuzz_access(int w) {
+	if (!is_touched[w]) {
+		is_touched[w] = true;
+		touched[touched_count++] = w;
+	}
+}
+
+
+void fuzz_inst_event() {
+	if (total_inst_count >= FUZZ_MAX_INSTS)
+		ready_to_end = true;
+	else
+		schedule_inst_event(FUZZ_MAX_INSTS);
+}
+
+
+
+
+// Mixes a memory word and its address into one value, so the words can
+// be added up in any order
+static uint64_t mix(int w, int32_t value) {
+	uint64_t x = ((uint64_t)(uint32_t)w << 32) | (uint32_t)value;
+
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+
+// Every memory word that isn't 0 is in the image or was touched, so only
+// those are looked at
+static uint64_t memory_signature() {
+	uint64_t sum = 0;
+
+	for (int w = 0; w < program_length; w++) {
+		if (memory[w] != 0)
+			sum += mix(w, memory[w]);
+	}
+	for (int i = 0; i < touched_count; i++) {
+		int w = touched[i];
+
+		if (w >= program_length && memory[w] != 0)
+			sum += mix(w, memory[w]);
+	}
+	return sum;
+}
+
+
+// Puts back what a run changed: the memory words its loads and stores
+// reached (and the lines decoded from them), the registers and counters
+static void restore_image() {
+
+	for (int i = 0; i < touched_count; i++) {
+		int w = touched[i];
+
+		memory_used[w] = false;
+		is_touched[w] = false;
+		if (w < program_length) {
+			memory[w] = (int32_t)rawHex_array[w];
+			decode_word(&program_store[w], w, rawHex_array[w]);
+			code_stale[w] = false;
+		}
+		else
+			memory[w] = 0;
+	}
+	touched_count = 0;
+
+	reset_core_state();
+}
+
+
+// Clears the image, ready to load the next one
+static void clear_image() {
+
+	for (int w = 0; w < program_length; w++) {
+		memory[w] = 0;
+		rawHex_array[w] = 0;
+	}
+	memset(program_store, 0, (program_length + 1) * sizeof(decodedLine));
+	program_length = 0;
+}
+
+
+static void run_engine(int e, fuzzResult *result) {
+
+	functional_mode = engine_modes[e];
+	schedule_inst_event(FUZZ_MAX_INSTS);
+
+	if (e == FUZZ_REFERENCE) {
+		pc = 0;
+		for (;;) {
+			if (total_inst_count >= inst_event_count)
+				inst_event();
+			if (ready_to_end || !functional_step())
+				break;
+		}
+	}
+	else
+		run_simulation(0);
+
+	result->insts = total_inst_count;
+	result->halted = halt_executed;
+	memcpy(result->registers, registers, sizeof(result->registers));
+	result->memory = memory_signature();
+
+	restore_image();
+}
+
+
+static bool same_state(const fuzzResult *a, const fuzzResult *b) {
+	return a->insts == b->insts
+		&& a->halted == b->halted
+		&& a->memory == b->memory
+		&& memcmp(a->registers, b->registers, sizeof(a->registers)) == 0;
+}
+
+
+static void print_divergence(const fuzzResult *results, int e, int count) {
+	const fuzzResult *ref = &results[FUZZ_REFERENCE], *got = &results[e];
+
+	printf("\n %s differs from the reference on an image of %d words:\n", engine_names[e], count);
+	printf(" %-22s%-14s%s\n", "", engine_names[FUZZ_REFERENCE], engine_names[e]);
+	printf(" %-22s%-14d%d\n", "Instructions:", ref->insts, got->insts);
+	printf(" %-22s%-14s%s\n", "Halted:", ref->halted ? "yes" : "no", got->halted ? "yes" : "no");
+	printf(" %-22s%-14s%s\n", "Memory:", "", (ref->memory == got->memory) ? "same" : "differs");
+	for (int r = 0; r < NUM_REGISTERS; r++) {
+		if (ref->registers[r] != got->registers[r])
+			printf(" R%-21d%-14d%d\n", r, ref->registers[r], got->registers[r]);
+	}
+	fflush(stdout);
+}
+
+
+
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	static uint32_t words[MEMORY_SIZE];
+	fuzzResult results[FUZZ_ENGINES];
+	int count = (int)((size / 4 < MEMORY_SIZE) ? size / 4 : MEMORY_SIZE);
+
+	if (!fuzzing) {
+		mode = NORMAL;
+		successful_branch_limiter_count = INT_MAX;
+		reset_simulation();
+		fuzzing = true;
+	}
+
+	// Every engine runs the image decoded once; each one's changes to it
+	// are put back before the next
+	memcpy(words, data, count * sizeof(uint32_t));
+	load_words(words, count);
+	load_memory_image();
+
+	for (int e = 0; e < FUZZ_ENGINES; e++)
+		run_engine(e, &results[e]);
+
+	clear_image();
+
+	for (int e = 0; e < FUZZ_ENGINES; e++) {
+		if (e != FUZZ_REFERENCE && !same_state(&results[FUZZ_REFERENCE], &results[e])) {
+			print_divergence(results, e, count);
+			abort();
+		}
+	}
+
+	return 0;
+}
+
+
+
+
+#ifdef FUZZ_MAIN
+
+#include <signal.h>
+#include <time.h>
+
+// Where the input that crashed is saved, for running again
+#define CRASH_FILE "fuzz-crash.bin"
+
+static uint8_t input[MEMORY_SIZE * 4];
+static size_t input_size;
+
+
+static void save_crash(int sig) {
+	FILE *fp = fopen(CRASH_FILE, "wb");
+
+	if (fp != NULL) {
+		fwrite(input, 1, input_size, fp);
+		fclose(fp);
+		printf("Input saved to %s\n", CRASH_FILE);
+	}
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+
+static uint64_t next_random(uint64_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+
+// A short image of valid opcodes with small branch and memory offsets,
+// which runs far longer than random bytes would
+static void random_image(uint64_t *state) {
+	int count = 1 + (int)(next_random(state) % 64);
+
+	for (int i = 0; i < count; i++) {
+		uint64_t r = next_random(state);
+		uint32_t word = ((uint32_t)(r % 0x12) << 26)
+			| ((uint32_t)(r >> 8) & 0x03FFF800)
+			| ((uint32_t)((int16_t)((int)((r >> 40) % 64) - 32) * 4) & 0xFFFF);
+
+		memcpy(&input[4 * i], &word, 4);
+	}
+	input_size = 4 * count;
+}
+
+
+int main(int argc, char *argv[]) {
+	long runs = 100000;
+	uint64_t state = 1;
+	int files = 0;
+	struct timespec start, end;
+	double seconds;
+
+	signal(SIGABRT, save_crash);
+	signal(SIGSEGV, save_crash);
+
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "-runs=", 6) == 0)
+			runs = atol(argv[i] + 6);
+		else if (strncmp(argv[i], "-seed=", 6) == 0)
+			state = strtoull(argv[i] + 6, NULL, 0) | 1;
+		else {
+			FILE *fp = fopen(argv[i], "rb");
+
+			if (fp == NULL) {
+				perror(argv[i]);
+				return EXIT_FAILURE;
+			}
+			input_size = fread(input, 1, sizeof(input), fp);
+			fclose(fp);
+			LLVMFuzzerTestOneInput(input, input_size);
+			printf("%s: ok\n", argv[i]);
+			files++;
+		}
+	}
+	if (files > 0)
+		return EXIT_SUCCESS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long n = 0; n < runs; n++) {
+		random_image(&state);
+		LLVMFuzzerTestOneInput(input, input_size);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%ld inputs in %.2f s (%.0f per second)\n", runs, seconds, runs / seconds);
+	return EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,521 @@
+/**
+ * history.c - Reverse execution for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Lets a run go back to an earlier instruction or cycle once it ends,
+ * from two records kept while it runs:
+ *
+ *				UNDO LOG:	A ring of the last N entries. Every
+ *							instruction adds a step entry with its line,
+ *							and every register write, store and first
+ *							load of a word adds the value and used flag
+ *							it is about to overwrite. A register an
+ *							instruction reads for the first time adds
+ *							an entry too, for its used flag.
+ *
+ *				SNAPSHOTS:	Every K instructions, everything a checkpoint
+ *							holds except memory (registers, counters, the
+ *							pipeline latches) and the log position. Only
+ *							the snapshots the ring still reaches back to
+ *							are kept.
+ *
+ * Going back undoes the log down to the latest snapshot at or before the
+ * target, puts the snapshot back and runs forward to the exact target.
+ * A condition target (the last time R5==3 held, say) first walks the log
+ * backwards one instruction at a time, checking it at every instruction
+ * boundary, to find which instruction to go back to.
+ *
+ * With the target "interactive", the run instead stops at its end and
+ * takes commands from stdin to step back, run back to a target and
+ * step forward again, as far as the end of the run.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mips.h"
+
+
+// Undo log entry kinds
+#define HISTORY_STEP 0          // an instruction starts; 'where' is its line
+#define HISTORY_REGISTER 1
+#define HISTORY_MEMORY 2
+
+// Most snapshots kept at once; the interval grows to stay under it
+#define MAX_SNAPSHOTS 4096
+
+
+// struct to hold one undo log entry
+typedef struct history_entry {
+	int32_t old;            // value before the write
+	int32_t where;          // register, memory word or line
+	uint8_t kind;
+	bool used;              // register_used or memory_used before the access
+} historyEntry;
+
+
+// struct to hold one snapshot
+typedef struct history_snapshot {
+	long long position;     // log entries written before it
+	int insts;
+	int cycles;
+	unsigned char *state;   // core_state_size() bytes
+} historySnapshot;
+
+
+bool recording = false;
+
+static historyEntry *ring;
+static long long ring_mask;         // ring size - 1 (a power of two)
+static long long head;              // log entries written so far
+
+static historySnapshot *snapshots;
+static int snapshot_capacity;
+static int first_snapshot;
+static int snapshot_count;
+static int interval;
+static int next_snapshot;
+
+// Where the replay after an undo stops (-1 for no limit)
+static int stop_insts = -1;
+static int stop_cycles = -1;
+
+static const char *target_spec;
+static traceTrigger target;
+static int back = -1;               // back:N, instructions before the end
+static bool interactive = false;
+
+// Where the recorded run ended; nothing past it can be gone to
+static int end_insts;
+static int end_cycles;
+
+
+
+
+static historyEntry *append(int kind, int where) {
+	historyEntry *e = &ring[head++ & ring_mask];
+
+	e->kind = kind;
+	e->where = where;
+	return e;
+}
+
+
+static void undo(const historyEntry *e) {
+	switch (e->kind) {
+		case HISTORY_REGISTER:
+			registers[e->where] = e->old;
+			register_used[e->where] = e->used;
+			break;
+		case HISTORY_MEMORY:
+			memory[e->where] = e->old;
+			memory_used[e->where] = e->used;
+			break;
+		default:
+			break;
+	}
+}
+
+
+static historySnapshot *snapshot(int i) {
+	return &snapshots[(first_snapshot + i) % snapshot_capacity];
+}
+
+
+// Forgets the snapshots whose log entries the ring has overwritten
+static void drop_unreachable() {
+	while (snapshot_count > 0 && snapshot(0)->position < head - ring_mask - 1) {
+		first_snapshot = (first_snapshot + 1) % snapshot_capacity;
+		snapshot_count--;
+	}
+}
+
+
+static void take_snapshot() {
+	historySnapshot *s;
+
+	drop_unreachable();
+	if (snapshot_count == snapshot_capacity) {
+		first_snapshot = (first_snapshot + 1) % snapshot_capacity;
+		snapshot_count--;
+	}
+
+	s = snapshot(snapshot_count++);
+	s->position = head;
+	s->insts = total_inst_count;
+	s->cycles = cycle_counter;
+	capture_core_state(s->state);
+}
+
+
+
+
+// Reads a target: back:N into 'n', anything else into 't'. Returns false
+// if it can't be parsed
+static bool parse_target(const char *spec, traceTrigger *t, int *n) {
+
+	*n = -1;
+	if (strncmp(spec, "back:", 5) == 0) {
+		char *end;
+		long count = strtol(spec + 5, &end, 0);
+
+		if (end == spec + 5 || *end != '\0' || count < 0)
+			return false;
+		*n = (int)count;
+		return true;
+	}
+	return parse_trigger(spec, t) && t->kind != TRIGGER_NONE;
+}
+
+
+bool start_history(const char *spec, int entries, int snapshot_interval) {
+	long long size = 1;
+	size_t state = core_state_size();
+
+	target_spec = spec;
+	if (strcmp(spec, "interactive") == 0)
+		interactive = true;
+	else if (!parse_target(spec, &target, &back)) {
+		printf("\nUnknown rewind target %s.\n", spec);
+		return false;
+	}
+
+	// A power of two, so positions map to slots with a mask
+	if (entries < 64)
+		entries = 64;
+	while (size < entries)
+		size <<= 1;
+	ring_mask = size - 1;
+
+	// Every instruction logs at least its step entry, so the ring never
+	// spans more than 'size' instructions. Snapshots further apart than
+	// an eighth of that could leave nothing to go back to
+	interval = (snapshot_interval > 0) ? snapshot_interval : DEFAULT_SNAPSHOT_INTERVAL;
+	if (interval > size / 8)
+		interval = (int)(size / 8);
+	if (size / interval + 2 > MAX_SNAPSHOTS)
+		interval = (int)(size / (MAX_SNAPSHOTS - 2)) + 1;
+	snapshot_capacity = (int)(size / interval) + 2;
+
+	if (snapshot_interval > 0 && interval != snapshot_interval)
+		printf("\nA snapshot interval of %d doesn't fit a history of %lld entries; using %d.\n", snapshot_interval, size, interval);
+
+	ring = malloc(size * sizeof(historyEntry));
+	snapshots = malloc(snapshot_capacity * sizeof(historySnapshot));
+	if (ring == NULL || snapshots == NULL) {
+		printf("\nNot enough memory for a history of %lld entries.\n", size);
+		return false;
+	}
+	for (int i = 0; i < snapshot_capacity; i++) {
+		snapshots[i].state = malloc(state);
+		if (snapshots[i].state == NULL) {
+			printf("\nNot enough memory for a history of %lld entries.\n", size);
+			return false;
+		}
+	}
+
+	head = 0;
+	first_snapshot = 0;
+	snapshot_count = 0;
+	recording = true;
+
+	// The first snapshot is taken where the run starts
+	next_snapshot = total_inst_count;
+	schedule_inst_event(next_snapshot);
+	return true;
+}
+
+
+
+
+static void log_register(int32_t r) {
+	historyEntry *e = append(HISTORY_REGISTER, r);
+
+	e->old = registers[r];
+	e->used = register_used[r];
+}
+
+
+void history_step(const decodedLine *line) {
+	append(HISTORY_STEP, line->line_index);
+
+	// The instruction may mark any register it names as used, reads (and
+	// STW's rt) included. Undoing an entry for one it leaves alone puts
+	// back what was already there
+	if (line->first_reg_val >= 0 && !register_used[line->first_reg_val])
+		log_register(line->first_reg_val);
+	if (line->second_reg_val >= 0 && !register_used[line->second_reg_val])
+		log_register(line->second_reg_val);
+	if (line->dest_register >= 0 && !register_used[line->dest_register])
+		log_register(line->dest_register);
+}
+
+
+void history_register(int32_t r) {
+	log_register(r);
+}
+
+
+void history_load(int32_t rt, int w) {
+	historyEntry *e;
+
+	log_register(rt);
+
+	// Only the first load of a word changes anything a load can
+	if (!memory_used[w]) {
+		e = append(HISTORY_MEMORY, w);
+		e->old = memory[w];
+		e->used = false;
+	}
+}
+
+
+void history_store(int w) {
+	historyEntry *e = append(HISTORY_MEMORY, w);
+
+	e->old = memory[w];
+	e->used = memory_used[w];
+}
+
+
+
+
+void history_inst_event() {
+	if (!recording)
+		return;
+
+	if (stop_insts >= 0 && total_inst_count >= stop_insts) {
+		stop_insts = -1;
+		ready_to_end = true;
+		return;
+	}
+
+	if (total_inst_count >= next_snapshot) {
+		take_snapshot();
+		next_snapshot = total_inst_count + interval;
+	}
+
+	schedule_inst_event(next_snapshot);
+	if (stop_insts >= 0)
+		schedule_inst_event(stop_insts);
+}
+
+
+void history_cycle_event() {
+	if (!recording || stop_cycles < 0)
+		return;
+
+	if (cycle_counter >= stop_cycles) {
+		stop_cycles = -1;
+		ready_to_end = true;
+	}
+	else
+		schedule_cycle_event(stop_cycles);
+}
+
+
+
+
+// Walks the log back to the last instruction boundary at which 't' held,
+// the one the run stands at included only at the end of the run. Returns
+// how many instructions had executed there, or -1 if it never held as far
+// back as the oldest snapshot
+static int search_back(const traceTrigger *t, bool at_end) {
+	long long floor = snapshot(0)->position;
+	int insts = total_inst_count;
+
+	// The end of the run is a boundary too, with no line about to execute
+	if (at_end && trigger_holds(t, -1))
+		return insts;
+
+	while (head > floor) {
+		const historyEntry *e = &ring[--head & ring_mask];
+
+		undo(e);
+		if (e->kind == HISTORY_STEP) {
+			insts--;
+			if (trigger_holds(t, e->where))
+				return insts;
+		}
+	}
+	return -1;
+}
+
+
+// Goes back to the latest snapshot at or before instruction 'insts' (or
+// cycle 'cycles') and runs forward to it. Returns the instruction count
+// of the snapshot it ran from, or -1 if none is that old
+static int rewind_to(int insts, int cycles) {
+	const historySnapshot *s = NULL;
+	int saved_mode = mode;
+	int from;
+	int i;
+
+	for (i = snapshot_count - 1; i >= 0; i--) {
+		s = snapshot(i);
+		if ((insts >= 0 && s->insts <= insts) || (cycles >= 0 && s->cycles <= cycles))
+			break;
+	}
+	if (i < 0)
+		return -1;
+
+	from = s->insts;
+	while (head > s->position)
+		undo(&ring[--head & ring_mask]);
+	apply_core_state(s->state);
+	invalidate_code();
+
+	// Later snapshots are of a future that is about to be run again
+	snapshot_count = i + 1;
+	next_snapshot = s->insts + interval;
+
+	// Every event user picks up again from the snapshot
+	stop_insts = insts;
+	stop_cycles = cycles;
+	inst_event_count = 0;
+	cycle_event_count = 0;
+
+	// The run up to the target was already shown once
+	mode = NORMAL;
+	resume_simulation();
+	mode = saved_mode;
+
+	return from;
+}
+
+
+// Goes to 't' (or 'n' instructions back, for back:N) from where the run
+// stands. Returns the instruction count of the snapshot it ran from, or
+// -1 after printing why it can't go there
+static int seek(const traceTrigger *t, int n, bool at_end) {
+	int insts = -1, cycles = -1;
+	int kept;
+	int from;
+
+	drop_unreachable();
+	if (snapshot_count == 0) {
+		printf(" The history doesn't reach back to any snapshot.\n");
+		return -1;
+	}
+	kept = end_insts - snapshot(0)->insts;
+
+	if (n >= 0)
+		insts = (n < total_inst_count) ? total_inst_count - n : 0;
+	else if (t->kind == TRIGGER_INST)
+		insts = t->target;
+	else if (t->kind == TRIGGER_CYCLE)
+		cycles = t->target;
+	else {
+		insts = search_back(t, at_end);
+		if (insts < 0) {
+			printf(" Never held in the last %d instructions kept.\n", kept);
+			return -1;
+		}
+	}
+
+	if (insts > end_insts || cycles > end_cycles) {
+		printf(" Past the end of the run (instruction %d, cycle %d).\n", end_insts, end_cycles);
+		return -1;
+	}
+
+	// Keep the replay's own snapshots and stops out of the way
+	recording = true;
+	from = rewind_to(insts, cycles);
+	recording = false;
+
+	if (from < 0)
+		printf(" Older than the last %d instructions kept.\n", kept);
+	return from;
+}
+
+
+// Takes commands from stdin until quit (or the end of input):
+//   back [N]   goes back N instructions (default 1)
+//   step [N]   goes forward N instructions (default 1)
+//   to T       goes to T as --rewind would: inst:N, cycle:N, back:N, or
+//              back to the last time pc:LINE, R5==3 or mem[400]>=1 held
+//   stats      prints the registers, memory and counters
+static void rewind_interactive() {
+	char command[256];
+	traceTrigger t;
+	int n;
+
+	printf(" Commands:		back [N], step [N], to T, stats, quit\n");
+	printf(" At:			instruction %d, cycle %d\n", total_inst_count, cycle_counter);
+
+	while (printf("rewind> "), fflush(stdout), fgets(command, sizeof(command), stdin) != NULL) {
+		char word[16] = "", arg[224] = "";
+		int count = 1;
+
+		if (sscanf(command, "%15s %223s", word, arg) < 1)
+			continue;
+		if (arg[0] != '\0' && strcmp(word, "to") != 0)
+			count = atoi(arg);
+
+		if (strcmp(word, "quit") == 0)
+			break;
+		else if (strcmp(word, "stats") == 0) {
+			print_stats();
+			continue;
+		}
+		else if (strcmp(word, "back") == 0 && count >= 0)
+			n = count;
+		else if (strcmp(word, "step") == 0 && count >= 0) {
+			t.kind = TRIGGER_INST;
+			t.target = total_inst_count + count;
+			n = -1;
+		}
+		else if (strcmp(word, "to") == 0 && parse_target(arg, &t, &n))
+			;
+		else {
+			printf(" Unknown command. Commands: back [N], step [N], to T, stats, quit\n");
+			continue;
+		}
+
+		if (seek(&t, n, false) >= 0)
+			printf(" At:			instruction %d, cycle %d, next line %d\n", total_inst_count, cycle_counter, next_line() + 1);
+	}
+	printf("\n================================================\n");
+}
+
+
+void rewind_history() {
+	int from;
+
+	end_insts = total_inst_count;
+	end_cycles = cycle_counter;
+	recording = false;
+
+	printf("\n\n\n Reverse Execution:\n");
+	printf("================================================\n");
+	printf(" Target:		%s\n", target_spec);
+
+	if (interactive) {
+		rewind_interactive();
+		return;
+	}
+
+	from = seek(&target, back, true);
+	if (from < 0) {
+		printf("================================================\n");
+		return;
+	}
+
+	printf(" Rewound To:		instruction %d, cycle %d\n", total_inst_count, cycle_counter);
+	printf(" Next Line:		%d\n", next_line() + 1);
+	printf(" Replayed From:		snapshot at instruction %d\n", from);
+	printf(" History Kept:		%d instructions\n", end_insts - snapshot(0)->insts);
+	printf("================================================\n");
+
+	print_stats();
+}
@@ -0,0 +1,201 @@
+/**
+ * ilp.c - Dataflow-limit ILP study for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Works out how fast the executed instruction stream could run on an
+ * ideal machine:
+ *
+ *				ISSUE:		Unlimited; an instruction starts as soon as
+ *							its operands are ready.
+ *
+ *				BRANCHES:	Perfectly predicted, so nothing waits on them.
+ *
+ *				RENAMING:	Perfect, so only true (read-after-write)
+ *							dependences through registers and memory
+ *							words count.
+ *
+ * Every register and memory word keeps the cycle its value is ready. As
+ * opcode_master() executes a line, the line finishes at the latest ready
+ * time of its sources plus its class's latency. The longest finish time
+ * is the critical path and instructions / critical path is the dataflow
+ * limit IPC.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mips.h"
+
+
+// Latency classes
+#define ILP_ALU 0
+#define ILP_MUL 1
+#define ILP_LOAD 2
+#define ILP_STORE 3
+#define ILP_BRANCH 4
+#define ILP_CLASSES 5
+
+
+bool ilp_analysis = false;
+
+static int latency[ILP_CLASSES] = {1, 1, 1, 1, 1};
+static const char *class_names[ILP_CLASSES] = {"alu", "mul", "load", "store", "branch"};
+
+static long long register_ready[NUM_REGISTERS];
+static long long memory_ready[MEMORY_SIZE];
+static long long critical_path = 0;
+static long long instructions = 0;
+
+
+
+
+static long long latest(long long a, long long b) {
+	return (a > b) ? a : b;
+}
+
+
+// Reads "class:N,class:N,..." into latency[]
+static bool parse_latencies(const char *spec) {
+	char buffer[128];
+	char *item, *save;
+
+	if (spec == NULL)
+		return true;
+
+	snprintf(buffer, sizeof(buffer), "%s", spec);
+
+	for (item = strtok_r(buffer, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+		char *colon = strchr(item, ':');
+		char *end;
+		int c;
+		long n;
+
+		if (colon == NULL)
+			return false;
+		*colon = '\0';
+
+		for (c = 0; c < ILP_CLASSES; c++) {
+			if (strcmp(item, class_names[c]) == 0)
+				break;
+		}
+
+		n = strtol(colon + 1, &end, 10);
+		if (c == ILP_CLASSES || end == colon + 1 || *end != '\0' || n < 0)
+			return false;
+		latency[c] = (int)n;
+	}
+
+	return true;
+}
+
+
+
+
+bool start_ilp_analysis(const char *latencies) {
+
+	if (!parse_latencies(latencies)) {
+		printf("\nUnknown latency list %s (use alu:N,mul:N,load:N,store:N,branch:N).\n", latencies);
+		return false;
+	}
+
+	ilp_analysis = true;
+	return true;
+}
+
+
+void ilp_execute(const decodedLine *line) {
+	int rs = line->first_reg_val;
+	int rt = line->second_reg_val;
+	int dest = line->dest_register;
+	long long start, finish;
+	int word;
+
+	switch (line->instruction) {
+		// R-type: dest = rs op rt
+		case ADD: case SUB: case OR: case AND: case XOR:
+			finish = latest(register_ready[rs], register_ready[rt]) + latency[ILP_ALU];
+			register_ready[dest] = finish;
+			break;
+
+		case MUL:
+			finish = latest(register_ready[rs], register_ready[rt]) + latency[ILP_MUL];
+			register_ready[dest] = finish;
+			break;
+
+		// I-type: dest = rs op immediate
+		case ADDI: case SUBI: case ORI: case ANDI: case XORI:
+			finish = register_ready[rs] + latency[ILP_ALU];
+			register_ready[dest] = finish;
+			break;
+
+		case MULI:
+			finish = register_ready[rs] + latency[ILP_MUL];
+			register_ready[dest] = finish;
+			break;
+
+		// The address is worked out before ldwfunc()/stwfunc() run,
+		// from the same registers they will use
+		case LDW:
+			word = MEMORY_INDEX(registers[rs] + (int16_t)line->immediate);
+			start = latest(register_ready[rs], memory_ready[word]);
+			finish = start + latency[ILP_LOAD];
+			register_ready[dest] = finish;
+			break;
+
+		case STW:
+			word = MEMORY_INDEX(registers[rs] + (int16_t)line->immediate);
+			finish = latest(register_ready[rs], register_ready[dest]) + latency[ILP_STORE];
+			memory_ready[word] = finish;
+			break;
+
+		case BZ: case JR:
+			finish = register_ready[rs] + latency[ILP_BRANCH];
+			break;
+
+		case BEQ:
+			finish = latest(register_ready[rs], register_ready[rt]) + latency[ILP_BRANCH];
+			break;
+
+		case HALT:
+			finish = 0;
+			break;
+
+		// NOPs and end-of-program markers aren't instructions
+		default:
+			return;
+	}
+
+	instructions++;
+	critical_path = latest(critical_path, finish);
+}
+
+
+void print_ilp_stats() {
+	double limit = (critical_path > 0) ? (double)instructions / critical_path : 0.0;
+	double ipc = (cycle_counter > 0) ? (double)total_inst_count / cycle_counter : 0.0;
+	const char *run = (functional_mode == NO_PIPE) ? "NO_PIPE" : (functional_mode == NO_FWD) ? "NO_FWD" : "FWD";
+
+	printf("\n\n\n Dataflow Limit (unlimited issue, perfect branches):\n");
+	printf("================================================\n");
+	printf(" Instructions:		%lld\n", instructions);
+	printf(" Critical Path:		%lld cycles\n", critical_path);
+	printf(" Latencies:		");
+	for (int c = 0; c < ILP_CLASSES; c++)
+		printf("%s%s %d", (c > 0) ? ", " : "", class_names[c], latency[c]);
+	printf("\n");
+	printf("------------------------------------------------\n");
+	printf(" Dataflow IPC:		%.3f\n", limit);
+	printf(" %s IPC:		%.3f\n", run, ipc);
+	printf(" Headroom:		%.2fx\n", (ipc > 0) ? limit / ipc : 0.0);
+	printf("================================================\n");
+}
@@ -0,0 +1,568 @@
+/**
+ * lockstep.c - SIMD lockstep execution of many independent MIPS-lite programs
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Runs K trace files ("lanes") at once with NO_PIPE semantics. State is kept
+ * as a struct of arrays: register r of lane l lives at lane_regs[r][l], so a
+ * register of every lane is one contiguous row.
+ *
+ * Every step advances each live lane by exactly one instruction:
+ *
+ *				CONVERGED:	Lanes that sit on the same PC as the first live
+ *							lane and hold the same ALU instruction (ADD..XORI,
+ *							same registers, immediates may differ) execute it
+ *							together as AVX2 / SSE4.1 vector operations.
+ *
+ *				DIVERGED:	Every other lane executes its instruction on its
+ *							own, exactly as run_nopipe()/opcode_master() would.
+ *
+ * Each lane ends with the same registers, memory, statistics and PC as an
+ * individual NO_PIPE run of its trace file.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "mips.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOCKSTEP_X86 1
+#endif
+
+
+// Lanes are padded to a whole AVX2 vector
+#define LANE_VECTOR 8
+
+
+// struct to hold per-lane statistics and control state
+typedef struct lane_information {
+	const char *trace_file;
+	bool loaded;
+	bool done;
+	int pc;
+	int program_length;
+	int cycle_counter;
+	int branch_limiter;
+	int opcode_count[OPCODES];
+	int total_inst_count;
+} laneInfo;
+
+
+static int num_lanes;
+static int padded_lanes;
+static laneInfo *lanes;
+
+// Struct-of-arrays state: lane_regs[r * padded_lanes + l]
+static int32_t *lane_regs;
+static uint32_t *lane_reg_used;              // bit r set = register r used
+static int32_t *lane_memory;                 // MEMORY_SIZE words per lane
+static bool *lane_memory_used;
+static decodedLine *lane_program;            // MEMORY_SIZE+1 lines per lane
+
+// Scratch rows for the converged ALU step
+static int32_t *step_operand;
+static int32_t *step_mask;
+
+#define LANE_REG(r, l)		lane_regs[(r) * padded_lanes + (l)]
+#define LANE_MEM(l, a)		lane_memory[(size_t)(l) * MEMORY_SIZE + (a)]
+#define LANE_MEM_USED(l, a)	lane_memory_used[(size_t)(l) * MEMORY_SIZE + (a)]
+#define LANE_LINE(l, p)		lane_program[(size_t)(l) * (MEMORY_SIZE + 1) + (p)]
+
+
+
+
+static bool is_alu_opcode(int32_t instruction) {
+	int class = OPCODE_INFO(instruction)->class;
+
+	return class == CLASS_ARITH || class == CLASS_LOGIC;
+}
+
+
+// Two lines are the same ALU instruction if everything but the immediate matches
+static bool same_alu_shape(const decodedLine *a, const decodedLine *b) {
+	if (a->instruction != b->instruction || a->dest_register != b->dest_register || a->first_reg_val != b->first_reg_val)
+		return false;
+
+	// R-types also read rt
+	if (OPCODE_INFO(a->instruction)->format == FORMAT_R && a->second_reg_val != b->second_reg_val)
+		return false;
+
+	return true;
+}
+
+
+static int32_t alu_scalar(int32_t instruction, int32_t val1, int32_t val2) {
+	switch (instruction) {
+		case ADD: case ADDI:	return (int32_t)((uint32_t)val1 + (uint32_t)val2);
+		case SUB: case SUBI:	return (int32_t)((uint32_t)val1 - (uint32_t)val2);
+		case MUL: case MULI:	return (int32_t)((uint32_t)val1 * (uint32_t)val2);
+		case OR:  case ORI:		return val1 | val2;
+		case AND: case ANDI:	return val1 & val2;
+		default:				return val1 ^ val2;
+	}
+}
+
+
+
+
+// Vector kernels: dst[l] = a[l] op b[l] wherever mask[l] is all ones.
+// n is always a multiple of LANE_VECTOR.
+
+static void alu_rows_scalar(int32_t instruction, int32_t *dst, const int32_t *a, const int32_t *b, const int32_t *mask, int n) {
+	for (int l = 0; l < n; l++) {
+		if (mask[l])
+			dst[l] = alu_scalar(instruction, a[l], b[l]);
+	}
+}
+
+
+#ifdef LOCKSTEP_X86
+__attribute__((target("avx2")))
+static void alu_rows_avx2(int32_t instruction, int32_t *dst, const int32_t *a, const int32_t *b, const int32_t *mask, int n) {
+	for (int l = 0; l < n; l += 8) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)(a + l));
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + l));
+		__m256i vm = _mm256_loadu_si256((const __m256i *)(mask + l));
+		__m256i vd = _mm256_loadu_si256((const __m256i *)(dst + l));
+		__m256i vr;
+
+		switch (instruction) {
+			case ADD: case ADDI:	vr = _mm256_add_epi32(va, vb); break;
+			case SUB: case SUBI:	vr = _mm256_sub_epi32(va, vb); break;
+			case MUL: case MULI:	vr = _mm256_mullo_epi32(va, vb); break;
+			case OR:  case ORI:		vr = _mm256_or_si256(va, vb); break;
+			case AND: case ANDI:	vr = _mm256_and_si256(va, vb); break;
+			default:				vr = _mm256_xor_si256(va, vb); break;
+		}
+
+		_mm256_storeu_si256((__m256i *)(dst + l), _mm256_blendv_epi8(vd, vr, vm));
+	}
+}
+
+
+__attribute__((target("sse4.1")))
+static void alu_rows_sse(int32_t instruction, int32_t *dst, const int32_t *a, const int32_t *b, const int32_t *mask, int n) {
+	for (int l = 0; l < n; l += 4) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + l));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + l));
+		__m128i vm = _mm_loadu_si128((const __m128i *)(mask + l));
+		__m128i vd = _mm_loadu_si128((const __m128i *)(dst + l));
+		__m128i vr;
+
+		switch (instruction) {
+			case ADD: case ADDI:	vr = _mm_add_epi32(va, vb); break;
+			case SUB: case SUBI:	vr = _mm_sub_epi32(va, vb); break;
+			case MUL: case MULI:	vr = _mm_mullo_epi32(va, vb); break;
+			case OR:  case ORI:		vr = _mm_or_si128(va, vb); break;
+			case AND: case ANDI:	vr = _mm_and_si128(va, vb); break;
+			default:				vr = _mm_xor_si128(va, vb); break;
+		}
+
+		_mm_storeu_si128((__m128i *)(dst + l), _mm_blendv_epi8(vd, vr, vm));
+	}
+}
+#endif
+
+
+static void (*alu_rows)(int32_t, int32_t *, const int32_t *, const int32_t *, const int32_t *, int) = alu_rows_scalar;
+
+
+static const char *select_alu_kernel() {
+#ifdef LOCKSTEP_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		alu_rows = alu_rows_avx2;
+		return "AVX2";
+	}
+	if (__builtin_cpu_supports("sse4.1")) {
+		alu_rows = alu_rows_sse;
+		return "SSE4.1";
+	}
+#endif
+	alu_rows = alu_rows_scalar;
+	return "scalar";
+}
+
+
+
+
+// One NO_PIPE iteration for a single lane (run_nopipe + opcode_master)
+static void lane_step(int l) {
+	laneInfo *lane = &lanes[l];
+	decodedLine line = LANE_LINE(l, lane->pc);
+	bool control_flow = false;
+	bool jump = false;
+	int32_t addr;
+	int index;
+
+	switch (line.instruction) {
+		case ADD: case SUB: case MUL:
+		case OR:  case AND: case XOR:
+			LANE_REG(line.dest_register, l) = alu_scalar(line.instruction, LANE_REG(line.first_reg_val, l), LANE_REG(line.second_reg_val, l));
+			lane_reg_used[l] |= (1u << line.dest_register) | (1u << line.first_reg_val) | (1u << line.second_reg_val);
+			lane->opcode_count[line.instruction]++;
+			lane->total_inst_count++;
+			break;
+
+		case ADDI: case SUBI: case MULI:
+		case ORI:  case ANDI: case XORI:
+			LANE_REG(line.dest_register, l) = alu_scalar(line.instruction, LANE_REG(line.first_reg_val, l), line.immediate);
+			lane_reg_used[l] |= (1u << line.dest_register) | (1u << line.first_reg_val);
+			lane->opcode_count[line.instruction]++;
+			lane->total_inst_count++;
+			break;
+
+		case LDW:
+			addr = (int32_t)((uint32_t)LANE_REG(line.first_reg_val, l) + (int16_t)line.immediate);
+			index = MEMORY_INDEX(addr);
+			LANE_REG(line.dest_register, l) = LANE_MEM(l, index);
+			LANE_MEM_USED(l, index) = true;
+			lane_reg_used[l] |= (1u << line.dest_register) | (1u << line.first_reg_val);
+			lane->opcode_count[line.instruction]++;
+			lane->total_inst_count++;
+			break;
+
+		case STW:
+			addr = (int32_t)((uint32_t)LANE_REG(line.first_reg_val, l) + (int16_t)line.immediate);
+			index = MEMORY_INDEX(addr);
+			LANE_MEM(l, index) = LANE_REG(line.dest_register, l);
+			LANE_MEM_USED(l, index) = true;
+			// A store into the lane's program changes the line it fetches
+			if (index < lane->program_length)
+				decode_word(&LANE_LINE(l, index), index, (uint32_t)LANE_MEM(l, index));
+			lane_reg_used[l] |= (1u << line.dest_register) | (1u << line.first_reg_val);
+			lane->opcode_count[line.instruction]++;
+			lane->total_inst_count++;
+			break;
+
+		case BZ:
+			lane->opcode_count[line.instruction]++;
+			lane->total_inst_count++;
+			lane_reg_used[l] |= (1u << line.first_reg_val);
+			if ((LANE_REG(line.first_reg_val, l) == 0) && (lane->branch_limiter < successful_branch_limiter_count)) {
+				lane->pc -= 2;
+				lane->pc += ((int16_t)line.immediate/4);
+				control_flow = true;
+				lane->branch_limiter++;
+			}
+			break;
+
+		case BEQ:
+			lane->opcode_count[line.instruction]++;
+			lane->total_inst_count++;
+			lane_reg_used[l] |= (1u << line.first_reg_val) | (1u << line.second_reg_val);
+			if ((LANE_REG(line.first_reg_val, l) == LANE_REG(line.second_reg_val, l)) && (lane->branch_limiter < successful_branch_limiter_count)) {
+				lane->pc -= 2;
+				lane->pc += ((int16_t)line.immediate/4);
+				control_flow = true;
+				lane->branch_limiter++;
+			}
+			break;
+
+		case JR:
+			lane->opcode_count[line.instruction]++;
+			lane->total_inst_count++;
+			control_flow = true;
+			jump = true;
+			if (lane->branch_limiter < successful_branch_limiter_count) {
+				lane->pc = ((int16_t)LANE_REG(line.first_reg_val, l)/4);
+				lane_reg_used[l] |= (1u << line.first_reg_val);
+				lane->branch_limiter++;
+			}
+			break;
+
+		case HALT:
+			lane->opcode_count[line.instruction]++;
+			lane->total_inst_count++;
+			break;
+
+		case EOP:
+			lane->done = true;
+			return;
+
+		default:
+			// NOP and unknown opcodes do nothing but still take their cycles
+			break;
+	}
+
+	if (control_flow && !jump)
+		lane->pc += 2;
+
+	lane->cycle_counter += 5;
+
+	if (!control_flow && line.instruction == HALT) {
+		lane->done = true;
+		return;
+	}
+
+	lane->pc++;
+
+	// Ran off the end of the program (or jumped in front of it)
+	if (lane->pc > lane->program_length || lane->pc < 0)
+		lane->done = true;
+}
+
+
+// Execute the first live lane's ALU instruction on every lane that holds
+// the same instruction at the same PC. Returns false if there is nothing
+// to vectorise this step.
+static bool converged_alu_step(bool *stepped) {
+	int leader = -1;
+	int matches = 0;
+	const decodedLine *shape;
+
+	for (int l = 0; l < num_lanes; l++) {
+		if (!lanes[l].done) {
+			leader = l;
+			break;
+		}
+	}
+	if (leader < 0)
+		return false;
+
+	shape = &LANE_LINE(leader, lanes[leader].pc);
+	if (!is_alu_opcode(shape->instruction))
+		return false;
+
+	bool is_immediate = (OPCODE_INFO(shape->instruction)->format == FORMAT_I);
+
+	for (int l = 0; l < padded_lanes; l++) {
+		step_mask[l] = 0;
+
+		if (l >= num_lanes || lanes[l].done || lanes[l].pc != lanes[leader].pc)
+			continue;
+
+		const decodedLine *line = &LANE_LINE(l, lanes[l].pc);
+		if (!same_alu_shape(line, shape))
+			continue;
+
+		step_mask[l] = -1;
+		if (is_immediate)
+			step_operand[l] = line->immediate;
+		matches++;
+	}
+
+	if (matches < 2)
+		return false;
+
+	const int32_t *second = is_immediate ? step_operand : &LANE_REG(shape->second_reg_val, 0);
+	alu_rows(shape->instruction, &LANE_REG(shape->dest_register, 0), &LANE_REG(shape->first_reg_val, 0), second, step_mask, padded_lanes);
+
+	uint32_t used = (1u << shape->dest_register) | (1u << shape->first_reg_val);
+	if (!is_immediate)
+		used |= (1u << shape->second_reg_val);
+
+	for (int l = 0; l < num_lanes; l++) {
+		if (!step_mask[l])
+			continue;
+
+		laneInfo *lane = &lanes[l];
+		lane_reg_used[l] |= used;
+		lane->opcode_count[shape->instruction]++;
+		lane->total_inst_count++;
+		lane->cycle_counter += 5;
+		lane->pc++;
+		if (lane->pc > lane->program_length)
+			lane->done = true;
+
+		stepped[l] = true;
+	}
+
+	return true;
+}
+
+
+
+
+// Copy a lane into the simulator globals and print it like a normal run
+static void print_lane(int l) {
+	laneInfo *lane = &lanes[l];
+
+	printf("\n\n\n################################\n");
+	printf(" Lane %d: %s\n", l, lane->trace_file);
+	printf("################################\n");
+
+	if (!lane->loaded) {
+		printf("Trace file could not be loaded.\n");
+		return;
+	}
+
+	for (int r = 0; r < NUM_REGISTERS; r++) {
+		registers[r] = LANE_REG(r, l);
+		register_used[r] = (lane_reg_used[l] >> r) & 1;
+	}
+	for (int a = 0; a < MEMORY_SIZE; a++) {
+		memory[a] = LANE_MEM(l, a);
+		memory_used[a] = LANE_MEM_USED(l, a);
+	}
+	rebuild_dirty_map();
+
+	memcpy(opcode_count, lane->opcode_count, sizeof(opcode_count));
+	total_inst_count = lane->total_inst_count;
+	cycle_counter = lane->cycle_counter;
+	hazard_count = 0;
+	pc = lane->pc;
+
+	print_stats();
+}
+
+
+
+
+// Append the non-empty lines of a list file to the lane names
+static const char **read_lane_list(const char *lane_list, const char **trace_files, int *trace_count) {
+	FILE *fp = fopen(lane_list, "r");
+	char line[FILENAME_MAX];
+	int capacity = *trace_count + 64;
+	const char **names = malloc(capacity * sizeof(char *));
+
+	if (names == NULL)
+		return NULL;
+	memcpy(names, trace_files, *trace_count * sizeof(char *));
+
+	if (fp == NULL) {
+		perror("Error opening lane list");
+		return names;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (strlen(line) == 0)
+			continue;
+
+		if (*trace_count == capacity) {
+			capacity *= 2;
+			const char **grown = realloc(names, capacity * sizeof(char *));
+			if (grown == NULL)
+				break;
+			names = grown;
+		}
+		names[(*trace_count)++] = strdup(line);
+	}
+
+	fclose(fp);
+	return names;
+}
+
+
+int run_lockstep(const char **trace_files, int trace_count, const char *lane_list) {
+	long long converged_steps = 0;
+	long long diverged_steps = 0;
+	bool *stepped;
+	const char *kernel;
+	int failed = 0;
+
+	if (lane_list != NULL) {
+		trace_files = read_lane_list(lane_list, trace_files, &trace_count);
+		if (trace_files == NULL) {
+			printf("Error: not enough memory for the lane list.\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (functional_mode != NO_PIPE)
+		printf("\nLockstep execution models NO_PIPE; ignoring the pipeline mode.\n");
+
+	num_lanes = trace_count;
+	padded_lanes = (trace_count + LANE_VECTOR - 1) / LANE_VECTOR * LANE_VECTOR;
+
+	lanes = calloc(num_lanes, sizeof(laneInfo));
+	lane_regs = calloc((size_t)NUM_REGISTERS * padded_lanes, sizeof(int32_t));
+	lane_reg_used = calloc(num_lanes, sizeof(uint32_t));
+	lane_memory = calloc((size_t)num_lanes * MEMORY_SIZE, sizeof(int32_t));
+	lane_memory_used = calloc((size_t)num_lanes * MEMORY_SIZE, sizeof(bool));
+	lane_program = calloc((size_t)num_lanes * (MEMORY_SIZE + 1), sizeof(decodedLine));
+	step_operand = calloc(padded_lanes, sizeof(int32_t));
+	step_mask = calloc(padded_lanes, sizeof(int32_t));
+	stepped = calloc(num_lanes, sizeof(bool));
+
+	if (!lanes || !lane_regs || !lane_reg_used || !lane_memory || !lane_memory_used || !lane_program || !step_operand || !step_mask || !stepped) {
+		printf("Error: not enough memory for %d lanes.\n", num_lanes);
+		return EXIT_FAILURE;
+	}
+
+	// Load every lane through the normal loader
+	for (int l = 0; l < num_lanes; l++) {
+		FILE *fp = open_image(trace_files[l]);
+		int line_count = -1;
+
+		lanes[l].trace_file = trace_files[l];
+
+		if (fp == NULL) {
+			if (mode == DEBUG)
+				perror("Error opening trace file");
+		}
+		else
+			line_count = load_program(fp);
+
+		if (line_count < 0) {
+			lanes[l].done = true;
+			failed++;
+			continue;
+		}
+
+		memcpy(&LANE_LINE(l, 0), program_store, (line_count + 1) * sizeof(decodedLine));
+		for (int w = 0; w < line_count; w++)
+			LANE_MEM(l, w) = (int32_t)rawHex_array[w];
+		lanes[l].loaded = true;
+		lanes[l].program_length = line_count;
+	}
+
+	kernel = select_alu_kernel();
+
+
+
+	while (1) {
+		bool any_live = false;
+
+		memset(stepped, 0, num_lanes * sizeof(bool));
+
+		if (converged_alu_step(stepped))
+			converged_steps++;
+
+		// Everyone the vector step didn't cover runs on its own
+		for (int l = 0; l < num_lanes; l++) {
+			if (lanes[l].done || stepped[l])
+				continue;
+			lane_step(l);
+			diverged_steps++;
+		}
+
+		for (int l = 0; l < num_lanes; l++) {
+			if (!lanes[l].done) {
+				any_live = true;
+				break;
+			}
+		}
+		if (!any_live)
+			break;
+	}
+
+
+
+	for (int l = 0; l < num_lanes; l++)
+		print_lane(l);
+
+	printf("\n\n\n Lockstep Statistics (%d lanes, %s):\n", num_lanes, kernel);
+	printf("================================\n");
+	printf(" Vector steps:		%lld\n", converged_steps);
+	printf(" Per-lane steps:		%lld\n", diverged_steps);
+	printf("================================\n");
+
+	free(lanes); free(lane_regs); free(lane_reg_used); free(lane_memory);
+	free(lane_memory_used); free(lane_program); free(step_operand); free(step_mask); free(stepped);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
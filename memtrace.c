@@ -0,0 +1,190 @@
+/**
+ * memtrace.c - LDW/STW address trace for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Streams the effective address of every LDW and STW to a file, for
+ * offline cache and prefetcher studies:
+ *
+ *				BINARY:		A 16 byte header ("MIPSMEMT", version, record
+ *							size) followed by one 12 byte memTraceRecord
+ *							per access, in host byte order.
+ *
+ *				DINERO:		Dinero III/IV "din" text: one "<label> <hex
+ *							address>" line per access, label 0 for a
+ *							read and 1 for a write.
+ *
+ * Both go through large in-memory buffers and only touch the file when a
+ * buffer fills, so tracing stays a few stores per access.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mips.h"
+
+
+#define MEM_TRACE_MAGIC "MIPSMEMT"
+#define MEM_TRACE_VERSION 1
+
+// Records held before the binary trace is written out
+#define MEM_TRACE_RECORDS 65536
+
+// Bytes held before the Dinero trace is written out
+#define DINERO_BUFFER (1024 * 1024)
+
+// Longest Dinero line: label, space, 8 hex digits, newline
+#define DINERO_LINE 12
+
+
+// struct to hold one access in the binary trace
+typedef struct mem_trace_record {
+	uint32_t cycle;
+	uint32_t address;       // registers[rs] + imm, before wrapping into memory[]
+	uint16_t line;          // trace file line index of the LDW/STW
+	uint8_t type;           // MEM_READ or MEM_WRITE
+	uint8_t reserved;
+} memTraceRecord;
+
+
+bool mem_tracing = false;
+
+static FILE *binary_fp = NULL;
+static memTraceRecord *records = NULL;
+static int records_used = 0;
+
+static FILE *dinero_fp = NULL;
+static char *dinero_buffer = NULL;
+static size_t dinero_used = 0;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+
+
+
+static void flush_records() {
+	if (records_used > 0)
+		fwrite(records, sizeof(memTraceRecord), records_used, binary_fp);
+	records_used = 0;
+}
+
+
+static void flush_dinero() {
+	if (dinero_used > 0)
+		fwrite(dinero_buffer, 1, dinero_used, dinero_fp);
+	dinero_used = 0;
+}
+
+
+static FILE *open_trace(const char *path) {
+	FILE *fp = fopen(path, "wb");
+
+	if (fp == NULL)
+		perror("Error opening memory trace");
+	return fp;
+}
+
+
+
+
+bool start_mem_trace(const char *binary_path, const char *dinero_path) {
+
+	if (binary_path != NULL) {
+		uint32_t header[2] = {MEM_TRACE_VERSION, sizeof(memTraceRecord)};
+
+		records = malloc(MEM_TRACE_RECORDS * sizeof(memTraceRecord));
+		binary_fp = open_trace(binary_path);
+		if (records == NULL || binary_fp == NULL)
+			return false;
+
+		fwrite(MEM_TRACE_MAGIC, 1, 8, binary_fp);
+		fwrite(header, sizeof(header), 1, binary_fp);
+	}
+
+	if (dinero_path != NULL) {
+		dinero_buffer = malloc(DINERO_BUFFER);
+		dinero_fp = open_trace(dinero_path);
+		if (dinero_buffer == NULL || dinero_fp == NULL)
+			return false;
+	}
+
+	mem_tracing = true;
+	return true;
+}
+
+
+void mem_trace_access(int type, int32_t address) {
+
+	if (binary_fp != NULL) {
+		memTraceRecord *r = &records[records_used];
+
+		r->cycle = (uint32_t)cycle_counter;
+		r->address = (uint32_t)address;
+		r->line = (uint16_t)last_executed_line;
+		r->type = (uint8_t)type;
+		r->reserved = 0;
+
+		if (++records_used == MEM_TRACE_RECORDS)
+			flush_records();
+	}
+
+	if (dinero_fp != NULL) {
+		uint32_t a = (uint32_t)address;
+		char *p = dinero_buffer + dinero_used;
+		int digits = 1;
+
+		if (DINERO_BUFFER - dinero_used < DINERO_LINE) {
+			flush_dinero();
+			p = dinero_buffer;
+		}
+
+		// Hex without leading zeros, written by hand: printf would be most
+		// of the cost of tracing
+		while (digits < 8 && (a >> (4 * digits)) != 0)
+			digits++;
+
+		*p++ = (type == MEM_WRITE) ? '1' : '0';
+		*p++ = ' ';
+		for (int d = digits - 1; d >= 0; d--)
+			*p++ = hex_digits[(a >> (4 * d)) & 0xF];
+		*p++ = '\n';
+
+		dinero_used = p - dinero_buffer;
+	}
+}
+
+
+void finish_mem_trace() {
+
+	if (!mem_tracing)
+		return;
+
+	if (binary_fp != NULL) {
+		flush_records();
+		if (fclose(binary_fp) != 0)
+			perror("Error writing memory trace");
+	}
+
+	if (dinero_fp != NULL) {
+		flush_dinero();
+		if (fclose(dinero_fp) != 0)
+			perror("Error writing memory trace");
+	}
+
+	free(records);
+	free(dinero_buffer);
+	binary_fp = NULL;
+	dinero_fp = NULL;
+	records = NULL;
+	dinero_buffer = NULL;
+	mem_tracing = false;
+}
@@ -51,99 +51,223 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <inttypes.h>
+#include <limits.h>
 #include "mips.h"
 
-// struct to hold decoded line information
-typedef struct decoded_line_information {
-	int32_t instruction;
-	int32_t dest_register;
-	int32_t first_reg_val;
-	int32_t second_reg_val;
-	int32_t immediate;
-	int pipe_stage;
-} decodedLine;
-
-
-// struct to hold pipline informatoin
-typedef struct pipe_main {
-	decodedLine pipe1;
-	decodedLine pipe2;
-	decodedLine pipe3;
-	decodedLine pipe4;
-	decodedLine pipe5;
-} pipeline;
 
-// Initialize memory array - Initialize Register array
-int32_t registers[NUM_REGISTERS];
-bool register_used[NUM_REGISTERS];
-
-int32_t memory[MEMORY_SIZE];
-bool memory_used[MEMORY_SIZE];
+// Pipeline slot holding no instruction
+const decodedLine empty = {.instruction=NOP, .dest_register=-1, .first_reg_val=-1, .second_reg_val=-1, .immediate=0, .pipe_stage=0, .line_index=-1};
 
-// Stores all of the line's information in one array
-decodedLine program_store[MEMORY_SIZE+1];
-uint32_t rawHex_array[MEMORY_SIZE];
+// Initialize memory array - Initialize Register array
+SIM_LOCAL int32_t registers[NUM_REGISTERS];
+SIM_LOCAL bool register_used[NUM_REGISTERS];
+
+// Data memory is shared by every simulated core, unless a core is
+// pointed at memory of its own (interval slicing)
+int32_t shared_memory[MEMORY_SIZE];
+bool shared_memory_used[MEMORY_SIZE];
+SIM_LOCAL int32_t *memory = shared_memory;
+SIM_LOCAL bool *memory_used = shared_memory_used;
+dirtyMap shared_dirty_map;
+SIM_LOCAL dirtyMap *dirty_map = &shared_dirty_map;
+
+// Stores all of the line's information in one array. Line i is the
+// decoded copy of memory word i (byte address 4*i); rawHex_array holds the
+// words as the image was loaded
+SIM_LOCAL decodedLine program_store[MEMORY_SIZE+1];
+SIM_LOCAL uint32_t rawHex_array[MEMORY_SIZE];
+SIM_LOCAL int program_length = 0;
+
+// Lines a store has changed since they were decoded
+SIM_LOCAL bool code_stale[MEMORY_SIZE+1];
 
 // Variable for our pipe struct
-pipeline pipe;
+SIM_LOCAL pipeline pipe;
+
+// Line waiting to be fetched into the pipeline
+SIM_LOCAL decodedLine newinst;
 
 // Global variable to count transactions
-int rtype_count = 0;
-int itype_count = 0;
-int arith_count = 0;
-int logic_count = 0;
-int memacc_count = 0;
-int cflow_count = 0;
-int total_inst_count = 0;
-int total_stalls = 0;
+SIM_LOCAL int opcode_count[OPCODES];
+
+// Instruction mix, worked out from opcode_count[] by tally_instruction_mix()
+SIM_LOCAL int rtype_count = 0;
+SIM_LOCAL int itype_count = 0;
+SIM_LOCAL int arith_count = 0;
+SIM_LOCAL int logic_count = 0;
+SIM_LOCAL int memacc_count = 0;
+SIM_LOCAL int cflow_count = 0;
+SIM_LOCAL int total_inst_count = 0;
+SIM_LOCAL int total_stalls = 0;
 
 // Program run more
 int mode;
 
-// Function mode
-int functional_mode;
+// Function mode (per thread, so server jobs can each pick their own)
+SIM_LOCAL int functional_mode;
 
 // File pointer
-FILE *file;
+SIM_LOCAL FILE *file;
 
 // Program Counter
-int pc = 0;
-int cycle_counter = 0;
+SIM_LOCAL int pc = 0;
+SIM_LOCAL int cycle_counter = 0;
+
+// Cycle at which a multi-core run must synchronise with the other cores
+SIM_LOCAL int sync_cycle = INT_MAX;
+
+// Instruction count at which inst_event() next runs
+SIM_LOCAL int inst_event_count = INT_MAX;
+
+// Cycle at which cycle_event() next runs
+SIM_LOCAL int cycle_event_count = INT_MAX;
+
+// program_store[] slot of the last line opcode_master() executed
+SIM_LOCAL int last_executed_line = -1;
 
 // Since we keep getting stuck in loops
-int successful_branch_limiter = 0;
+SIM_LOCAL int successful_branch_limiter = 0;
 int successful_branch_limiter_count = 10;
 
-bool rtype = 0;
-bool was_control_flow = 0;
-bool was_jrfunc_for_nopipe = 0;
-bool halt_executed = false;
-bool ready_to_end = false;
+SIM_LOCAL bool rtype = 0;
+SIM_LOCAL bool was_control_flow = 0;
+SIM_LOCAL bool was_jrfunc_for_nopipe = 0;
+SIM_LOCAL bool halt_executed = false;
+SIM_LOCAL bool ready_to_end = false;
 
 // Hazard and newline loaded variables
-bool hazard = false;
-int hazard_count = 0;
-bool newInstAdded = true;
-bool end_of_fetch = false;
+SIM_LOCAL bool hazard = false;
+SIM_LOCAL int hazard_count = 0;
+
+// Cycles by what they were spent on, and whether to print them
+SIM_LOCAL cpiStack cpi;
+bool cpi_report = false;
+SIM_LOCAL bool newInstAdded = true;
+SIM_LOCAL bool end_of_fetch = false;
 
-uint32_t rawHex;
-uint8_t opcode;
-uint8_t rs;
-uint8_t rt;
-uint8_t rd;
-int16_t imm16;
+SIM_LOCAL uint32_t rawHex;
+SIM_LOCAL uint8_t opcode;
+SIM_LOCAL uint8_t rs;
+SIM_LOCAL uint8_t rt;
+SIM_LOCAL uint8_t rd;
+SIM_LOCAL int16_t imm16;
 
 
 
 
+// A fuzzing build links in the fuzzer's main() instead (fuzz.c)
+#ifndef FUZZING
 int main(int argc, char *argv[]) {
-	char line[LINE_BUFFER_SIZE];
-    char binary_string[ADDRESS_BITS + 1];
-	int line_number = 0;
+	const char **trace_files = malloc(argc * sizeof(char *));
+	int trace_count = 0;
+	int core_count = 0;
+	int quantum = DEFAULT_QUANTUM;
+	bool deterministic = false;
+	bool lockstep = false;
+	const char *lane_list = NULL;
+	bool validate = false;
+	int validate_interval = DEFAULT_VALIDATE_INTERVAL;
+	const char *checkpoint_file = NULL;
+	const char *restore_file = NULL;
+	int checkpoint_at = -1;
+	bool profile = false;
+	const char *pipe_trace_file = NULL;
+	const char *profile_file = NULL;
+	const char *trace_start = NULL;
+	const char *trace_stop = NULL;
+	const char *mem_trace_file = NULL;
+	const char *dinero_file = NULL;
+	bool reuse = false;
+	int reuse_window = DEFAULT_REUSE_WINDOW;
+	bool ilp = false;
+	const char *ilp_latencies = NULL;
+	bool fast = false;
+	const char *rewind_target = NULL;
+	int history_entries = DEFAULT_HISTORY_ENTRIES;
+	int snapshot_interval = DEFAULT_SNAPSHOT_INTERVAL;
+	const char **breaks = malloc(argc * sizeof(char *));
+	int break_count = 0;
+	const char **watch_specs = malloc(argc * sizeof(char *));
+	int watch_count = 0;
+	bool watch_continue = false;
+	const char *delta_file = NULL;
+	samplingConfig sample_config = {.policy=SAMPLE_PERIODIC, .interval=DEFAULT_SAMPLE_INTERVAL, .warmup=DEFAULT_SAMPLE_WARMUP, .window=DEFAULT_SAMPLE_WINDOW, .seed=1};
+	sliceConfig slice_config = {.length=DEFAULT_SLICE_LENGTH, .warmup=DEFAULT_SLICE_WARMUP, .threads=0};
+	statsConfig stats_config = {.format=STATS_TEXT, .path=NULL, .interval=0, .series_path=NULL};
+	
+	// A server takes its jobs from a socket instead of the command line
+	if (argc >= 3 && strcmp(argv[1], "SERVE") == 0) {
+		int workers = 0;
+		int cache_size = DEFAULT_SERVER_CACHE;
+		
+		mode = NORMAL;
+		for (int i = 3; i < argc; i++) {
+			if (strncmp(argv[i], "--workers=", 10) == 0)
+				workers = atoi(argv[i] + 10);
+			else if (strncmp(argv[i], "--cache=", 8) == 0)
+				cache_size = atoi(argv[i] + 8);
+			else if (strncmp(argv[i], "--branch-limit=", 15) == 0) {
+				successful_branch_limiter_count = atoi(argv[i] + 15);
+				if (successful_branch_limiter_count <= 0)
+					successful_branch_limiter_count = INT_MAX;
+			}
+			else
+				printf("\nUnknown option %s ignored.\n", argv[i]);
+		}
+		return run_server(argv[2], workers, cache_size);
+	}
 	
     // Check for at least two arguments: mode and filename
     if (argc < 4) {
-        printf("Usage: %s <DEBUG/NORMAL> <NO_PIPE/NO_FWD/FWD> <TRACE_FILE>\n", argv[0]);
+        printf("Usage: %s <DEBUG/NORMAL> <NO_PIPE/NO_FWD/FWD> <TRACE_FILE> [TRACE_FILE[@ENTRY] ...] [OPTIONS]\n", argv[0]);
+        printf("Options:\n");
+        printf("  --cores=N          Simulate N cores (extra cores reuse the last trace file)\n");
+        printf("  --quantum=N        Cycles each core runs between synchronisations\n");
+        printf("  --deterministic    Run the cores' quanta in a fixed order\n");
+        printf("  --lockstep         Run every trace file as a lane of the SIMD lockstep engine\n");
+        printf("  --lane-list=FILE   Add the trace files listed in FILE (one per line) as lanes\n");
+        printf("  --validate[=N]     Check the mode's engine against the reference every N instructions, per trace file\n");
+        printf("  --branch-limit=N   Taken branches allowed before branches stop being taken (0 = no limit)\n");
+        printf("  --sample           Sample NO_FWD/FWD timing in detailed windows between functional fast-forwards\n");
+        printf("  --sample-interval=N   Instructions fast-forwarded between windows\n");
+        printf("  --sample-warmup=N     Detailed instructions run before each window is measured\n");
+        printf("  --sample-window=N     Detailed instructions measured per window\n");
+        printf("  --sample-policy=P     periodic, or random (intervals vary +/-50%%)\n");
+        printf("  --sample-seed=N       Seed for the random policy\n");
+        printf("  --slice[=N]        Time N-instruction intervals of the run in parallel\n");
+        printf("  --slice-warmup=N   Detailed instructions run before each interval\n");
+        printf("  --slice-threads=N  Host threads for the intervals (default: one per CPU)\n");
+        printf("  --stats=FORMAT     Write the final stats as json or csv (to stdout in place of the text report)\n");
+        printf("  --stats-file=FILE     Write the json/csv stats to FILE and keep the text report\n");
+        printf("  --stats-interval=N    Also write a time series row every N cycles\n");
+        printf("  --series-file=FILE    Time series file (default %s or %s)\n", DEFAULT_SERIES_CSV, DEFAULT_SERIES_JSON);
+        printf("  --pipe-trace=FILE  Write a cycle-by-cycle NO_FWD/FWD pipeline trace to FILE (Konata format)\n");
+        printf("  --mem-trace=FILE   Write every LDW/STW address, line, type and cycle to FILE (binary)\n");
+        printf("  --dinero-trace=FILE   Write every LDW/STW address to FILE in Dinero din format\n");
+        printf("  --reuse            Report LDW/STW reuse distances (LRU hit rate per cache size) and working set\n");
+        printf("  --reuse-window=N   Instructions per working set window (default %d)\n", DEFAULT_REUSE_WINDOW);
+        printf("  --ilp              Report the dataflow-limit IPC (unlimited issue, perfect branches)\n");
+        printf("  --ilp-latency=L    Latencies for --ilp, e.g. alu:1,mul:3,load:2,store:1,branch:1\n");
+        printf("  --fast-loops       Skip the repeated iterations of loops that have settled into a steady state\n");
+        printf("  --rewind=T         When the run ends, go back to T and print the state there:\n");
+        printf("                     inst:N, cycle:N, back:N, or the last time pc:LINE, R5==3, mem[400]>=1 held;\n");
+        printf("                     'interactive' reads back [N], step [N], to T, stats and quit from stdin\n");
+        printf("  --history=N        Undo log entries kept for --rewind (default %d)\n", DEFAULT_HISTORY_ENTRIES);
+        printf("  --snapshot-interval=N   Instructions between the snapshots --rewind runs forward from\n");
+        printf("  --break=LINE       Stop the run when LINE is about to execute\n");
+        printf("  --watch=W          Stop the run when W is written (R5, mem[400]), read (R5:read, mem[400]:read)\n");
+        printf("                     or written so a condition becomes true (R5==3, mem[400]>=1)\n");
+        printf("  --watch-continue   Print the state at every breakpoint or watchpoint hit and carry on\n");
+        printf("  --delta=FILE       Write the memory words that differ from the loaded image to FILE (binary)\n");
+        printf("  --cpi-stack        Split a NO_FWD/FWD run's cycles into base, stall, flush and fill/drain\n");
+        printf("  --profile[=FILE]   Print the hottest lines (and write every line's counts to FILE as CSV)\n");
+        printf("  --trace-start=T    In DEBUG mode, run NORMAL until trigger T, then trace\n");
+        printf("  --trace-stop=T     Go back to NORMAL at trigger T (cycle:N, inst:N, pc:LINE, R5==3, mem[400]>=1)\n");
+        printf("  --checkpoint=FILE  Write a checkpoint to FILE on SIGUSR1 (and at --checkpoint-at)\n");
+        printf("  --checkpoint-at=N  Write the checkpoint once N instructions have executed\n");
+        printf("  --restore=FILE     Resume from a checkpoint of the same trace file\n");
+        printf("\n   or: %s SERVE <SOCKET_PATH> [--workers=N] [--cache=N] [--branch-limit=N]\n", argv[0]);
+        printf("  Run jobs sent to a UNIX domain socket on N worker threads, caching N decoded images\n");
         return EXIT_FAILURE;
     }
 	
@@ -157,6 +281,10 @@ int main(int argc, char *argv[]) {
 		mode = NORMAL;
 	}
 	
+	// DEBUG messages are printed by their own thread
+	if (mode == DEBUG)
+		start_debug_log();
+	
 	
 	
 	// Set mode specified in the first argument
@@ -173,8 +301,209 @@ int main(int argc, char *argv[]) {
 	
 	
 	
+	// Everything after the mode arguments is either an option or another
+	// trace file, each of which is loaded onto its own core
+	trace_files[trace_count++] = argv[3];
+	
+	for (int i = 4; i < argc; i++) {
+		if (strncmp(argv[i], "--cores=", 8) == 0)
+			core_count = atoi(argv[i] + 8);
+		else if (strncmp(argv[i], "--quantum=", 10) == 0)
+			quantum = atoi(argv[i] + 10);
+		else if (strcmp(argv[i], "--deterministic") == 0)
+			deterministic = true;
+		else if (strcmp(argv[i], "--lockstep") == 0)
+			lockstep = true;
+		else if (strncmp(argv[i], "--lane-list=", 12) == 0)
+			lane_list = argv[i] + 12;
+		else if (strcmp(argv[i], "--validate") == 0)
+			validate = true;
+		else if (strncmp(argv[i], "--validate=", 11) == 0) {
+			validate = true;
+			validate_interval = atoi(argv[i] + 11);
+		}
+		else if (strncmp(argv[i], "--branch-limit=", 15) == 0) {
+			successful_branch_limiter_count = atoi(argv[i] + 15);
+			if (successful_branch_limiter_count <= 0)
+				successful_branch_limiter_count = INT_MAX;
+		}
+		else if (strcmp(argv[i], "--sample") == 0)
+			sampling = true;
+		else if (strncmp(argv[i], "--sample-interval=", 18) == 0)
+			sample_config.interval = atoi(argv[i] + 18);
+		else if (strncmp(argv[i], "--sample-warmup=", 16) == 0)
+			sample_config.warmup = atoi(argv[i] + 16);
+		else if (strncmp(argv[i], "--sample-window=", 16) == 0)
+			sample_config.window = atoi(argv[i] + 16);
+		else if (strcmp(argv[i], "--sample-policy=random") == 0)
+			sample_config.policy = SAMPLE_RANDOM;
+		else if (strcmp(argv[i], "--sample-policy=periodic") == 0)
+			sample_config.policy = SAMPLE_PERIODIC;
+		else if (strncmp(argv[i], "--sample-seed=", 14) == 0)
+			sample_config.seed = (unsigned)strtoul(argv[i] + 14, NULL, 10);
+		else if (strcmp(argv[i], "--slice") == 0)
+			slicing = true;
+		else if (strncmp(argv[i], "--slice=", 8) == 0) {
+			slicing = true;
+			slice_config.length = atoi(argv[i] + 8);
+		}
+		else if (strncmp(argv[i], "--slice-warmup=", 15) == 0)
+			slice_config.warmup = atoi(argv[i] + 15);
+		else if (strncmp(argv[i], "--slice-threads=", 16) == 0)
+			slice_config.threads = atoi(argv[i] + 16);
+		else if (strcmp(argv[i], "--stats=json") == 0)
+			stats_config.format = STATS_JSON;
+		else if (strcmp(argv[i], "--stats=csv") == 0)
+			stats_config.format = STATS_CSV;
+		else if (strncmp(argv[i], "--stats-file=", 13) == 0)
+			stats_config.path = argv[i] + 13;
+		else if (strncmp(argv[i], "--stats-interval=", 17) == 0)
+			stats_config.interval = atoi(argv[i] + 17);
+		else if (strncmp(argv[i], "--series-file=", 14) == 0)
+			stats_config.series_path = argv[i] + 14;
+		else if (strncmp(argv[i], "--pipe-trace=", 13) == 0)
+			pipe_trace_file = argv[i] + 13;
+		else if (strncmp(argv[i], "--mem-trace=", 12) == 0)
+			mem_trace_file = argv[i] + 12;
+		else if (strncmp(argv[i], "--dinero-trace=", 15) == 0)
+			dinero_file = argv[i] + 15;
+		else if (strcmp(argv[i], "--reuse") == 0)
+			reuse = true;
+		else if (strncmp(argv[i], "--reuse-window=", 15) == 0)
+			reuse_window = atoi(argv[i] + 15);
+		else if (strcmp(argv[i], "--ilp") == 0)
+			ilp = true;
+		else if (strncmp(argv[i], "--ilp-latency=", 14) == 0) {
+			ilp = true;
+			ilp_latencies = argv[i] + 14;
+		}
+		else if (strcmp(argv[i], "--fast-loops") == 0)
+			fast = true;
+		else if (strncmp(argv[i], "--rewind=", 9) == 0)
+			rewind_target = argv[i] + 9;
+		else if (strncmp(argv[i], "--history=", 10) == 0)
+			history_entries = atoi(argv[i] + 10);
+		else if (strncmp(argv[i], "--snapshot-interval=", 20) == 0)
+			snapshot_interval = atoi(argv[i] + 20);
+		else if (strncmp(argv[i], "--break=", 8) == 0)
+			breaks[break_count++] = argv[i] + 8;
+		else if (strncmp(argv[i], "--watch=", 8) == 0)
+			watch_specs[watch_count++] = argv[i] + 8;
+		else if (strcmp(argv[i], "--watch-continue") == 0)
+			watch_continue = true;
+		else if (strncmp(argv[i], "--delta=", 8) == 0)
+			delta_file = argv[i] + 8;
+		else if (strcmp(argv[i], "--cpi-stack") == 0)
+			cpi_report = true;
+		else if (strcmp(argv[i], "--profile") == 0)
+			profile = true;
+		else if (strncmp(argv[i], "--profile=", 10) == 0) {
+			profile = true;
+			profile_file = argv[i] + 10;
+		}
+		else if (strncmp(argv[i], "--trace-start=", 14) == 0)
+			trace_start = argv[i] + 14;
+		else if (strncmp(argv[i], "--trace-stop=", 13) == 0)
+			trace_stop = argv[i] + 13;
+		else if (strncmp(argv[i], "--checkpoint=", 13) == 0)
+			checkpoint_file = argv[i] + 13;
+		else if (strncmp(argv[i], "--checkpoint-at=", 16) == 0)
+			checkpoint_at = atoi(argv[i] + 16);
+		else if (strncmp(argv[i], "--restore=", 10) == 0)
+			restore_file = argv[i] + 10;
+		else if (strncmp(argv[i], "--", 2) == 0)
+			printf("\nUnknown option %s ignored.\n", argv[i]);
+		else
+			trace_files[trace_count++] = argv[i];
+	}
+	
+	if (profile && (validate || lockstep || slicing || core_count > 1 || trace_count > 1)) {
+		printf("\nProfiling covers single-core runs only; not profiling.\n");
+		profile = false;
+	}
+	
+	if (profile)
+		start_profiling(profile_file);
+	
+	if (ilp && (validate || lockstep || slicing || core_count > 1 || trace_count > 1)) {
+		printf("\nThe dataflow limit covers single-core runs only; not reporting it.\n");
+		ilp = false;
+	}
+	
+	if (reuse && (validate || lockstep || slicing || core_count > 1 || trace_count > 1)) {
+		printf("\nReuse analysis covers single-core runs only; not reporting it.\n");
+		reuse = false;
+	}
+	
+	if ((mem_trace_file != NULL || dinero_file != NULL) && (validate || lockstep || slicing || core_count > 1 || trace_count > 1)) {
+		printf("\nMemory traces cover single-core runs only; not writing them.\n");
+		mem_trace_file = NULL;
+		dinero_file = NULL;
+	}
+	
+	if ((trace_start != NULL || trace_stop != NULL) && (mode != DEBUG || validate || lockstep || slicing || core_count > 1 || trace_count > 1)) {
+		printf("\nTrace windows cover single-core DEBUG runs only; ignoring them.\n");
+		trace_start = NULL;
+		trace_stop = NULL;
+	}
+	
+	if (fast && (validate || lockstep || core_count > 1 || trace_count > 1)) {
+		printf("\nLoop fast-forwarding covers single-core runs only; running every iteration.\n");
+		fast = false;
+	}
+	
+	if (rewind_target != NULL && (validate || lockstep || core_count > 1 || trace_count > 1)) {
+		printf("\nReverse execution covers single-core runs only; not rewinding.\n");
+		rewind_target = NULL;
+	}
+	
+	if ((break_count > 0 || watch_count > 0) && (validate || lockstep || slicing || core_count > 1 || trace_count > 1)) {
+		printf("\nBreakpoints and watchpoints cover single-core runs only; ignoring them.\n");
+		break_count = watch_count = 0;
+	}
+	
+	if (delta_file != NULL && (validate || lockstep || core_count > 1 || trace_count > 1)) {
+		printf("\nThe memory delta covers single-core runs only; not writing it.\n");
+		delta_file = NULL;
+	}
+	
+	if (delta_file != NULL)
+		start_delta(delta_file);
+	
+	if (cpi_report && (functional_mode == NO_PIPE || sampling)) {
+		printf("\nThe CPI stack covers full NO_FWD/FWD runs only; not reporting it.\n");
+		cpi_report = false;
+	}
+	
+	if (stats_config.format != STATS_TEXT && (validate || lockstep || core_count > 1 || trace_count > 1)) {
+		printf("\nJSON/CSV stats cover single-core runs only; printing the text report.\n");
+		stats_config.format = STATS_TEXT;
+	}
+	
+	if (stats_config.interval > 0 && stats_config.format == STATS_TEXT) {
+		printf("\n--stats-interval needs --stats=json or --stats=csv; no time series will be written.\n");
+		stats_config.interval = 0;
+	}
+	
+	if (validate) {
+		if (lockstep || sampling || slicing || core_count > 1 || checkpoint_file != NULL || restore_file != NULL)
+			printf("\nValidation runs each trace file on one core from the start; ignoring lockstep, multi-core, sampling, slicing and checkpoint options.\n");
+		return run_validation(trace_files, trace_count, validate_interval);
+	}
+	
+	if (lockstep)
+		return run_lockstep(trace_files, trace_count, lane_list);
+	
+	if (core_count < trace_count)
+		core_count = trace_count;
+	
+	if (core_count > 1)
+		return run_multicore(trace_files, trace_count, core_count, quantum, deterministic);
+	
+	
+	
 	// Open the trace file specified in the second argument
-    file = fopen(argv[3], "r");
+    file = open_image(argv[3]);
     if (file == NULL) {
         if (mode == DEBUG)
 			perror("Error opening trace file");
@@ -194,14 +523,169 @@ int main(int argc, char *argv[]) {
 	
 	
 	
+	// fill program_store array
+	if (load_program(file) < 0)
+		return EXIT_FAILURE;
+	load_memory_image();
+	
+	if (sampling && functional_mode == NO_PIPE) {
+		printf("\nSampling needs NO_FWD or FWD; running the whole program.\n");
+		sampling = false;
+	}
+	
+	if (sampling && (checkpoint_file != NULL || restore_file != NULL)) {
+		printf("\nCheckpoints can't be combined with sampling; running without sampling.\n");
+		sampling = false;
+	}
+	
+	if (slicing && (functional_mode == NO_PIPE || sampling || checkpoint_file != NULL || restore_file != NULL)) {
+		printf("\nSlicing needs NO_FWD or FWD without sampling or checkpoints; running the whole program.\n");
+		slicing = false;
+	}
+	
+	if (restore_file != NULL && !restore_checkpoint(restore_file))
+		return EXIT_FAILURE;
+	
+	if (checkpoint_file != NULL)
+		start_checkpoints(checkpoint_file, checkpoint_at);
+	else if (checkpoint_at >= 0)
+		printf("\n--checkpoint-at needs --checkpoint=FILE; no checkpoint will be written.\n");
+	
+	if (stats_config.interval > 0 && (sampling || slicing)) {
+		printf("\nSampled and sliced runs have no cycle-by-cycle time series; writing the final stats only.\n");
+		stats_config.interval = 0;
+	}
+	
+	if (!start_stats(&stats_config))
+		return EXIT_FAILURE;
+	
+	if (pipe_trace_file != NULL && (functional_mode == NO_PIPE || sampling || slicing)) {
+		printf("\nThe pipeline trace covers full NO_FWD/FWD runs only; not writing it.\n");
+		pipe_trace_file = NULL;
+	}
+	
+	if (pipe_trace_file != NULL && !start_pipe_trace(pipe_trace_file))
+		return EXIT_FAILURE;
+	
+	if ((mem_trace_file != NULL || dinero_file != NULL) && !start_mem_trace(mem_trace_file, dinero_file))
+		return EXIT_FAILURE;
+	
+	if (reuse)
+		start_reuse_analysis(reuse_window);
+	
+	if (ilp && !start_ilp_analysis(ilp_latencies))
+		return EXIT_FAILURE;
+	
+	if (!start_trace_window(trace_start, trace_stop))
+		return EXIT_FAILURE;
+	
+	// Going back replays part of the run, which would repeat their output
+	if (rewind_target != NULL && (sampling || slicing || stats_config.interval > 0 || trace_start != NULL || trace_stop != NULL)) {
+		printf("\nReverse execution replays part of the run, so it can't be combined with sampling, slicing, a stats time series or trace windows; not rewinding.\n");
+		rewind_target = NULL;
+	}
+	
+	if (rewind_target != NULL && !start_history(rewind_target, history_entries, snapshot_interval))
+		return EXIT_FAILURE;
+	
+	if (!start_watches(breaks, break_count, watch_specs, watch_count, watch_continue))
+		return EXIT_FAILURE;
 	
+	// Skipped iterations would be missing from every per-line output
+	if (fast && (mode == DEBUG || profiling || ilp_analysis || reuse_analysis || pipe_tracing || mem_tracing || recording || watching)) {
+		printf("\nLoop fast-forwarding skips lines that DEBUG output, profiles, traces, the ILP and reuse studies, reverse execution and watchpoints need; running every iteration.\n");
+		fast = false;
+	}
+	
+	if (fast)
+		start_fast_loops();
+	
+	if (sampling)
+		run_sampled(&sample_config);
+	else if (slicing)
+		run_sliced(argv[3], &slice_config);
+	else if (restore_file != NULL)
+		resume_simulation();
+	else
+		run_simulation(0);
+	
+	
+	
+	if(!ready_to_end && mode == DEBUG) debug_log("No HALT instruction found- ending program");
+	
+	end_program();
+
+	return 99;
+}
+#endif
+
+
+
+
+void decode_word(decodedLine *line, int line_index, uint32_t word) {
+	const opcodeInfo *info;
 	
+	*line = empty;
+	line->line_index = line_index;
 	
-    // initialize pipeline slots empty
-    decodedLine empty = {.instruction=NOP, .dest_register=-1, .first_reg_val=-1, .second_reg_val=-1, .immediate=0, .pipe_stage=0};
-    pipe.pipe1 = empty; pipe.pipe2=empty; pipe.pipe3=empty; pipe.pipe4=empty; pipe.pipe5=empty;
-    
-	decodedLine newinst = empty;
+	// bit shift the intruction param by twenty six
+	opcode = (word >> 26) & 0x3F;
+
+	// Set instruction param
+	line->instruction = opcode;
+
+	// Getting registers by bit shifting and masking
+	rs = (word >> 21) & 0x1F;
+	rt = (word >> 16) & 0x1F;
+	rd = (word >> 11) & 0x1F;
+	imm16 = word & 0xFFFF;
+	int32_t  imm    = (int32_t) imm16;
+
+	// The opcode table says which fields this encoding fills
+	info = OPCODE_INFO(opcode);
+	if (info->fields & FIELD_RD_DEST)
+		line->dest_register = rd;
+	if (info->fields & FIELD_RT_DEST)
+		line->dest_register = rt;
+	if (info->fields & FIELD_RS)
+		line->first_reg_val = rs;
+	if (info->fields & FIELD_RT)
+		line->second_reg_val = rt;
+	if (info->fields & FIELD_IMM)
+		line->immediate = imm;
+}
+
+
+// Puts 'word' in the image as line 'line'
+static void load_line(int line, uint32_t word) {
+	
+	rawHex_array[line] = word;
+	decode_word(&program_store[line], line, word);
+	code_stale[line] = false;
+}
+
+
+// Marks the end of an image of 'length' lines in program_store
+static void end_image(int length) {
+	
+	program_store[length] = empty;
+	program_store[length].instruction = EOP;
+	program_store[length].line_index = length;
+	program_length = length;
+	code_stale[length] = false;
+}
+
+
+int load_program(FILE *fp) {
+	char line[LINE_BUFFER_SIZE];
+	int line_number = 0;
+	
+	file = fp;
+	
+	// initialize pipeline slots empty
+	pipe.pipe1 = empty; pipe.pipe2=empty; pipe.pipe3=empty; pipe.pipe4=empty; pipe.pipe5=empty;
+	
+	newinst = empty;
 	
 	
 	// fill program_store array
@@ -209,6 +693,15 @@ int main(int argc, char *argv[]) {
 		
 		line_number++;
 		
+		// The image has to fit in memory[], with the EOP line after it
+		if (line_number > MEMORY_SIZE) {
+			if (mode == DEBUG)
+				printf("Error: More than %d lines in the trace file. Exiting.\n", MEMORY_SIZE);
+			
+			fclose(file);
+			return -1;
+		}
+		
 		// Remove newlines
 		line[strcspn(line, "\r\n")] = '\0';
 
@@ -222,568 +715,932 @@ int main(int argc, char *argv[]) {
 				printf("Error: Invalid instruction length at line %d (%zu characters). Exiting.\n", line_number, strlen(line));
 			
 			fclose(file);
-			return EXIT_FAILURE; // End the program if incorrect length
+			return -1; // End the program if incorrect length
 		}
 		
-		program_store[line_number - 1] = empty;
-		
 		// this is converting the intake to an integer
 		rawHex = StringToHex(line);
 		
-		rawHex_array[line_number - 1] = rawHex;
-		
-		// bit shift the intruction param by twenty six
-		opcode = (rawHex >> 26) & 0x3F;
-
-		// Set instruction param
-		program_store[line_number - 1].instruction = opcode;
-
-		// Set pipline stage to zero
-		program_store[line_number - 1].pipe_stage = 0;
-
-		// Getting registers by bit shifting and masking
-		rs = (rawHex >> 21) & 0x1F;
-		rt = (rawHex >> 16) & 0x1F;
-		rd = (rawHex >> 11) & 0x1F;
-		imm16 = rawHex & 0xFFFF;
-		int32_t  imm    = (int32_t) imm16;
-
-		switch (opcode) {
-		  //-----------------------------------
-		  // R-type arithmetic/logical:
-		  case ADD: case SUB: case MUL:
-		  case OR:  case AND: case XOR:
-			program_store[line_number - 1].dest_register    = rd;
-			program_store[line_number - 1].first_reg_val     = rs;
-			program_store[line_number - 1].second_reg_val    = rt;
-			break;
-
-		  //-----------------------------------
-		  // I-type 2-reg + immediate:
-		  case ADDI: case SUBI: case MULI:
-		  case ORI:  case ANDI: case XORI:
-		  case LDW:  case STW:
-			program_store[line_number - 1].dest_register    = rt;
-			program_store[line_number - 1].first_reg_val     = rs;
-			program_store[line_number - 1].immediate         = imm;
-			break;
-
-		  //-----------------------------------
-		  // Branches with two regs + offset
-		  case BEQ:
-			program_store[line_number - 1].first_reg_val     = rs;
-			program_store[line_number - 1].second_reg_val    = rt;
-			program_store[line_number - 1].immediate         = imm;
-			break;
-
-		  // Branch-zero: 1 reg + offset
-		  case BZ:
-			program_store[line_number - 1].first_reg_val     = rs;
-			program_store[line_number - 1].immediate         = imm;
-			break;
-
-		  //-----------------------------------
-		  // Jump-register (uses only rs)
-		  case JR:
-			program_store[line_number - 1].first_reg_val     = rs;
-			break;
-
-		  //-----------------------------------
-		  // HALT, NOP, EOP have no operands
-		  case HALT:
-		  case NOP:
-		  case EOP:
-			// nothing to fill
-			break;
-
-		  //-----------------------------------
-		  default:
-			if (mode == DEBUG) {
-			  printf("Line %d: opcode 0x%X not a valid instruction\n",
-					 line_number, opcode);
-			}
-			
+		load_line(line_number - 1, rawHex);
+
+		if (OPCODE_INFO(opcode)->name == NULL && mode == DEBUG) {
+			printf("Line %d: opcode 0x%X not a valid instruction\n",
+				 line_number, opcode);
 		}
 		
 	}
 	
-	// Mark the end of the trace file in program_store
-	program_store[line_number] = empty;
-	program_store[line_number].instruction = EOP;
+	end_image(line_number);
 	
-	pc = -1; // will be incremented first thing to pc=0 AKA the first trace file line
+	fclose(file);
+	file = NULL;
 	
+	return line_number;
+}
+
+
+
+
+int load_words(const uint32_t *words, int count) {
 	
+	if (count > MEMORY_SIZE)
+		return -1;
 	
+	pipe.pipe1 = empty; pipe.pipe2=empty; pipe.pipe3=empty; pipe.pipe4=empty; pipe.pipe5=empty;
+	newinst = empty;
 	
-	if (functional_mode == NO_PIPE){
-		for (pc = 0; pc <= line_number; pc++){
-			//DEBUG: print each binary string
-			if ((mode == DEBUG) && (rawHex_array[pc] > 0x0)) {
-				printf("\n\n-------------------------------------------------------\n");
-				printf("\n---Line %d---\n", pc + 1);
-			   //  printf("Binary: %u\n", program_store[pc]);
-				printf("Hex Number:\t\t0x%X\n", rawHex_array[pc]);
-				printf("Instruction:\t\t0x%X, %d\n", program_store[pc].instruction, program_store[pc].instruction);
-				printf("Destination register:\t%d\n", program_store[pc].dest_register);
-				printf("1st source register:\t%d\n", program_store[pc].first_reg_val);
-				if (opcode <= 0xB && opcode % 2 == 0) printf ("2nd source register:\t\t%d\n\n", program_store[pc].second_reg_val);
-				else printf("Immediate value:   %6d\n\n", (int16_t)program_store[pc].immediate);
+	for (int i = 0; i < count; i++)
+		load_line(i, words[i]);
+	end_image(count);
+	
+	return count;
+}
+
+
+
+
+void load_memory_image() {
+	
+	for (int i = 0; i < program_length; i++)
+		memory[i] = (int32_t)rawHex_array[i];
+}
+
+
+void invalidate_code() {
+	
+	for (int i = 0; i < program_length; i++)
+		code_stale[i] = true;
+}
+
+
+// Decodes a line again from the memory word a store changed
+static void refresh_line(int line) {
+	uint32_t word;
+	
+	// Clear the flag before reading the word, so a store another core
+	// makes meanwhile leaves the line stale again
+	(void)__atomic_exchange_n(&code_stale[line], false, __ATOMIC_ACQ_REL);
+	word = (uint32_t)__atomic_load_n(&memory[line], __ATOMIC_RELAXED);
+	
+	if (mode == DEBUG) debug_log("Line %d was stored to; decoding 0x%08X again\n", line + 1, word);
+	
+	decode_word(&program_store[line], line, word);
+}
+
+
+// Line the pipeline fetches at 'line'. A jump outside the image fetches
+// the EOP line after it, so the run ends there as functional_step() ends it
+static const decodedLine *fetch_line(int line) {
+	
+	if (line < 0 || line > program_length)
+		return &program_store[program_length];
+	
+	if (__atomic_load_n(&code_stale[line], __ATOMIC_RELAXED))
+		refresh_line(line);
+	return &program_store[line];
+}
+
+
+
+
+void run_simulation(int entry) {
+	
+	pc = entry - 1; // will be incremented first thing to the entry line
+	
+	if (functional_mode == NO_PIPE)
+		run_nopipe(entry);
+	
+	else if ((functional_mode == NO_FWD) || (functional_mode == FWD))
+		run_pipeline();
+}
+
+
+
+
+void run_nopipe(int entry) {
+	
+	for (pc = entry; pc >= 0 && pc <= program_length; pc++){
+		// Multi-core synchronisation and time series rows
+		if (cycle_counter >= cycle_event_count)
+			cycle_event();
+		
+		if (total_inst_count >= inst_event_count || checkpoint_signalled)
+			inst_event();
+		
+		// An event can end the run (a server job's budget running out)
+		if (ready_to_end)
+			return;
+		
+		if (__atomic_load_n(&code_stale[pc], __ATOMIC_RELAXED))
+			refresh_line(pc);
+		
+		//DEBUG: print each binary string
+		if ((mode == DEBUG) && (pc >= 0) && (pc < program_length) && (rawHex_array[pc] > 0x0)) {
+			debug_log("\n\n-------------------------------------------------------\n");
+			debug_log("\n---Line %d---\n", pc + 1);
+		   //  printf("Binary: %u\n", program_store[pc]);
+			debug_log("Hex Number:\t\t0x%X\n", rawHex_array[pc]);
+			debug_log("Instruction:\t\t0x%X, %d\n", program_store[pc].instruction, program_store[pc].instruction);
+			debug_log("Destination register:\t%d\n", program_store[pc].dest_register);
+			debug_log("1st source register:\t%d\n", program_store[pc].first_reg_val);
+			if (OPCODE_INFO(program_store[pc].instruction)->format == FORMAT_R) debug_log("2nd source register:\t\t%d\n\n", program_store[pc].second_reg_val);
+			else debug_log("Immediate value:   %6d\n\n", (int16_t)program_store[pc].immediate);
+		}
+		
+		if (opcode_master(program_store[pc])){
+			if(!was_jrfunc_for_nopipe)
+				pc+=2;
+			else if (was_jrfunc_for_nopipe)
+				was_jrfunc_for_nopipe = 0;
+		}
+		if (ready_to_end)
+			return;
+		
+		cycle_counter += 5; // 5 cycles per instruction
+		
+		if (!was_control_flow && program_store[pc].instruction == HALT){
+			ready_to_end = true;
+			return;
+		}
+	}
+}
+
+
+
+
+// Whether a line fetched behind 'line', or the one about to be loaded,
+// has been stored over since it was fetched
+static bool stale_fetch(decodedLine *slots[5], const decodedLine *line) {
+	
+	for (int i = 0; i < 5; i++) {
+		if (slots[i] != line && slots[i]->pipe_stage >= IF && slots[i]->pipe_stage <= EX
+		  && slots[i]->line_index >= 0 && code_stale[slots[i]->line_index])
+			return true;
+	}
+	return !newInstAdded && newinst.line_index >= 0 && code_stale[newinst.line_index];
+}
+
+
+// Executes the line in EX. A taken BZ/BEQ/JR works out where to go from its
+// own line, as run_nopipe() does, however far fetch has run ahead: the lines
+// behind it are thrown out and fetch starts again there. A HALT throws them
+// out and stops fetch, and a STW over a line already fetched sends fetch
+// back to the line after the store
+static void execute_stage(decodedLine *slots[5], int ex) {
+	decodedLine *line = slots[ex];
+	int fetch_pc = pc;
+	
+	pc = line->line_index;
+	if (opcode_master(*line)) {
+		if (was_jrfunc_for_nopipe)
+			was_jrfunc_for_nopipe = 0;
+		else
+			pc += 2;
+		pc++;
+		
+		// The next line loaded is fetched from pc
+		flush_fetch(slots, line);
+		newInstAdded = false;
+		end_of_fetch = false;
+		return;
+	}
+	pc = fetch_pc;
+	
+	if (halt_executed) {
+		flush_fetch(slots, line);
+		newinst = empty;
+		end_of_fetch = true;
+	}
+	else if (line->instruction == STW && stale_fetch(slots, line)) {
+		flush_fetch(slots, line);
+		pc = line->line_index;
+		newInstAdded = true;
+		end_of_fetch = false;
+	}
+}
+
+
+
+
+void run_pipeline() {
+	
+	while (1) {
+		// Multi-core synchronisation and time series rows
+		if (cycle_counter >= cycle_event_count)
+			cycle_event();
+		
+		if (total_inst_count >= inst_event_count || checkpoint_signalled)
+			inst_event();
+		
+		// An event can end the run (a server job's budget running out)
+		if (ready_to_end)
+			return;
+		
+		// if a new instruction is added to the pipeline 
+		// in the previous iteration of the while loop,
+		// then get a NEW new instruction from the trace file.
+		if (newInstAdded){
+			if (mode == DEBUG) debug_log("Loading new line from trace file\n\n");
+			
+			pc++;
+			
+			if (fetch_line(pc)->instruction == EOP){
+				pc--;
+				newinst = empty;
+				end_of_fetch = true;
+			}	
+			
+			else {
+				newinst = *fetch_line(pc);
+				newInstAdded = false;
 			}
 			
-			if (opcode_master(program_store[pc])){
-				if(!was_jrfunc_for_nopipe)
-					pc+=2;
-				else if (was_jrfunc_for_nopipe)
-					was_jrfunc_for_nopipe = 0;
+		}
+
+
+		// Array of decodedLines which serves as pipes
+		decodedLine *slots[5] = {&pipe.pipe1, &pipe.pipe2, &pipe.pipe3, &pipe.pipe4, &pipe.pipe5};
+
+		// 3 decodedLine variables to hold the line that is in a particular stage
+		decodedLine *inIF = NULL, *inID = NULL, *inEX = NULL, *inMEM = NULL, *inWB = NULL;
+		int inIFindex = 0;
+		int inIDindex = 0;
+		int inEXindex = 0;
+		int inMEMindex = 0;
+		int inWBindex = 0;
+		
+
+		// Re-check which lines are in which stages
+		for (int i = 0; i < 5; i++) {
+			if (slots[i]->pipe_stage == 1) {
+				inIF = slots[i];
+				inIFindex = i;
 			}
-			cycle_counter += 5; // 5 cycles per instruction
 			
-			if (!was_control_flow && program_store[pc].instruction == HALT){
-				end_program();
+			if (slots[i]->pipe_stage == 2) {
+				inID = slots[i];
+				inIDindex = i;
 			}
-		}
-	}
-	
-	else if ((functional_mode == NO_FWD) || (functional_mode == FWD)){
-		while (1) {
-			// if a new instruction is added to the pipeline 
-			// in the previous iteration of the while loop,
-			// then get a NEW new instruction from the trace file.
-			if (newInstAdded){
-				if (mode == DEBUG) printf("Loading new line from trace file\n\n");
-				
-				pc++;
-				
-				if (program_store[pc].instruction == EOP){
-					pc--;
-					newinst = empty;
-					end_of_fetch = true;
-				}	
-				
-				else {
-					newinst = program_store[pc];
-					newInstAdded = false;
-				}
-				
+			
+			if (slots[i]->pipe_stage == 3) {
+				inEX = slots[i];
+				inEXindex = i;
 			}
+			
+			if (slots[i]->pipe_stage == 4) {
+				inMEM = slots[i];
+				inMEMindex = i;
+			}
+			
+			if (slots[i]->pipe_stage == 5) {
+				inWB = slots[i];
+				inWBindex = i;
+			}
+		}
 
 
-			// Array of decodedLines which serves as pipes
-			decodedLine *slots[5] = {&pipe.pipe1, &pipe.pipe2, &pipe.pipe3, &pipe.pipe4, &pipe.pipe5};
-
-			// 3 decodedLine variables to hold the line that is in a particular stage
-			decodedLine *inIF = NULL, *inID = NULL, *inEX = NULL, *inMEM = NULL, *inWB = NULL;
-			int inIFindex = 0;
-			int inIDindex = 0;
-			int inEXindex = 0;
-			int inMEMindex = 0;
-			int inWBindex = 0;
+		// FORWARDING 
+		if (inID && inIF && findHazard(inID, inIF) && (functional_mode == FWD)) { // Checking for "IF-ID" hazards, effectively one less than an ID-MEM hazard
+			hazard_count++;
+			hazard = true;
+			cycle_counter++;
+			total_stalls++;
+			cpi_bubble((inID->instruction == LDW) ? CPI_LOAD_USE : CPI_RAW_FWD);
+			cpi_cycle();
+			if (pipe_tracing) trace_cycle();
+			if (profiling) profile_stall(inID, inIF);
+			if (pipe_tracing) trace_stall(inID, inIF);
 			
+			// DEBUG
+			if (mode == DEBUG) debug_log("\n\n\n\nStall at cycle %d: IF-ID hazard detected\n\n\n\n", cycle_counter);
 
-			// Re-check which lines are in which stages
+			// Iterate through pipes and stall as appropriate
 			for (int i = 0; i < 5; i++) {
-				if (slots[i]->pipe_stage == 1) {
-					inIF = slots[i];
-					inIFindex = i;
-				}
-				
-				if (slots[i]->pipe_stage == 2) {
-					inID = slots[i];
-					inIDindex = i;
-				}
-				
-				if (slots[i]->pipe_stage == 3) {
-					inEX = slots[i];
-					inEXindex = i;
+				if (slots[i]->pipe_stage > 1 && slots[i]->pipe_stage < 5) { // The secondary difference is pushing ID stages until MEM compared to EX until WB
+					if (slots[i]->pipe_stage == 3) {
+						execute_stage(slots, i);
+						if (ready_to_end)
+							return;
+					}
+					slots[i]->pipe_stage++;
 				}
-				
-				if (slots[i]->pipe_stage == 4) {
-					inMEM = slots[i];
-					inMEMindex = i;
+				// Write-back logic once a line is pushed through its respective pipe
+				else if (slots[i]->pipe_stage == 5){
+					if (mode == DEBUG) debug_log("\n\nWriting back data from pipe %d\n\n", i+1);
+					if (halt_executed && (slots[i]->instruction == HALT)){
+						cycle_counter--;
+						cpi.cycles[cpi.last_cause]--;
+						ready_to_end = true;
+						return;
+					}
+					
+					*slots[i] = empty;
 				}
 				
-				if (slots[i]->pipe_stage == 5) {
-					inWB = slots[i];
-					inWBindex = i;
-				}
-			}
-
-
-			// FORWARDING 
-			if (inID && inIF && findHazard(inID, inIF) && (functional_mode == FWD)) { // Checking for "IF-ID" hazards, effectively one less than an ID-MEM hazard
-				hazard_count++;
-				hazard = true;
-				cycle_counter++;
-				
-				// DEBUG
-				if (mode == DEBUG) printf("\n\n\n\nStall at cycle %d: IF-ID hazard detected\n\n\n\n", cycle_counter);
-
-				// Iterate through pipes and stall as appropriate
-				for (int i = 0; i < 5; i++) {
-					if (slots[i]->pipe_stage > 1 && slots[i]->pipe_stage < 5) { // The secondary difference is pushing ID stages until MEM compared to EX until WB
-						if (slots[i]->pipe_stage == 3) {
-							if(opcode_master(*slots[i])){
-								*slots[inIFindex] = empty;
-								*slots[inIDindex] = empty;
-							}
-						}
-						slots[i]->pipe_stage++;
+				// Load a new instruction in the pipe
+				if (!end_of_fetch && (slots[i]->pipe_stage == 0) && !newInstAdded){
+					// determine if there's an empty 
+					bool already_have_fetch_inst = 0;
+					for (int j=0; j<5; j++) {
+						if (slots[j]->pipe_stage == 1)
+							already_have_fetch_inst = 1;
 					}
-					// Write-back logic once a line is pushed through its respective pipe
-					else if (slots[i]->pipe_stage == 5){
-						if (mode == DEBUG) printf("\n\nWriting back data from pipe %d\n\n", i+1);
-						if (halt_executed && (slots[i]->instruction == HALT)){
-							cycle_counter--;
-							end_program();
-						}
 						
-						*slots[i] = empty;
+					if ((already_have_fetch_inst == 0) && (!was_control_flow)){
+						newinst.pipe_stage = 1;
+						*slots[i] = newinst;
+						newInstAdded = true;
+						if (mode == DEBUG) debug_log("New instruction added to pipeline\n\n");
 					}
 					
-					// Load a new instruction in the pipe
-					if (!end_of_fetch && (slots[i]->pipe_stage == 0) && !newInstAdded){
-						// determine if there's an empty 
-						bool already_have_fetch_inst = 0;
-						for (int j=0; j<5; j++) {
-							if (slots[j]->pipe_stage == 1)
-								already_have_fetch_inst = 1;
-						}
-							
-						if ((already_have_fetch_inst == 0) && (!was_control_flow)){
-							newinst.pipe_stage = 1;
-							*slots[i] = newinst;
-							newInstAdded = true;
-							if (mode == DEBUG) printf("New instruction added to pipeline\n\n");
-						}
-						
-						else if ((already_have_fetch_inst == 0) && (was_control_flow)){
-							newinst = program_store[pc];
-							newinst.pipe_stage = 1;
-							*slots[i] = newinst;
-							newInstAdded = true;
-							if (mode == DEBUG) printf("New instruction added to pipeline\n\n");
-						}
+					else if ((already_have_fetch_inst == 0) && (was_control_flow)){
+						newinst = *fetch_line(pc);
+						newinst.pipe_stage = 1;
+						*slots[i] = newinst;
+						newInstAdded = true;
+						if (mode == DEBUG) debug_log("New instruction added to pipeline\n\n");
 					}
-					
 				}
+				
 			}
+		}
 
 
-			// ID-EX hazard handling
-			if (inID && inEX && findHazard(inEX, inID) && functional_mode == NO_FWD) {
-				hazard_count++;
-				hazard = true;
-				cycle_counter++;
-				total_stalls++;
-				
-				// DEBUG
-				if (mode == DEBUG) printf("\n\n\n\nStall at cycle %d: EX-ID hazard detected\n\n\n\n", cycle_counter);
-
-				// Iterate through pipes and stall as appropriate
-				for (int i = 0; i < 5; i++) {
-					if (slots[i]->pipe_stage > 2 && slots[i]->pipe_stage < 5) {
-						if (slots[i]->pipe_stage == 3) {
-							if(opcode_master(*slots[i])){
-								*slots[inIFindex] = empty;
-								*slots[inIDindex] = empty;
-							}
-						}
-						slots[i]->pipe_stage++;
+		// ID-EX hazard handling
+		if (inID && inEX && findHazard(inEX, inID) && functional_mode == NO_FWD) {
+			hazard_count++;
+			hazard = true;
+			cycle_counter++;
+			total_stalls++;
+			cpi_bubble((inEX->instruction == LDW) ? CPI_LOAD_USE : CPI_RAW_NO_FWD);
+			cpi_cycle();
+			if (pipe_tracing) trace_cycle();
+			if (profiling) profile_stall(inEX, inID);
+			if (pipe_tracing) trace_stall(inEX, inID);
+			
+			// DEBUG
+			if (mode == DEBUG) debug_log("\n\n\n\nStall at cycle %d: EX-ID hazard detected\n\n\n\n", cycle_counter);
+
+			// Iterate through pipes and stall as appropriate
+			for (int i = 0; i < 5; i++) {
+				if (slots[i]->pipe_stage > 2 && slots[i]->pipe_stage < 5) {
+					if (slots[i]->pipe_stage == 3) {
+						execute_stage(slots, i);
+						if (ready_to_end)
+							return;
 					}
-					// Write-back logic once a line is pushed through its respective pipe
-					else if (slots[i]->pipe_stage == 5){
-						if (mode == DEBUG) printf("\n\nWriting back data from pipe %d\n\n", i+1);
-						if (halt_executed && (slots[i]->instruction == HALT)){
-							cycle_counter--;
-							end_program();
-						}
-						
-						*slots[i] = empty;
+					slots[i]->pipe_stage++;
+				}
+				// Write-back logic once a line is pushed through its respective pipe
+				else if (slots[i]->pipe_stage == 5){
+					if (mode == DEBUG) debug_log("\n\nWriting back data from pipe %d\n\n", i+1);
+					if (halt_executed && (slots[i]->instruction == HALT)){
+						cycle_counter--;
+						cpi.cycles[cpi.last_cause]--;
+						ready_to_end = true;
+						return;
 					}
 					
-					// Load a new instruction in the pipe
-					if (!end_of_fetch && (slots[i]->pipe_stage == 0) && !newInstAdded){
-						// determine if there's an empty 
-						bool already_have_fetch_inst = 0;
-						for (int j=0; j<5; j++) {
-							if (slots[j]->pipe_stage == 1)
-								already_have_fetch_inst = 1;
-						}
-							
-						if ((already_have_fetch_inst == 0) && (!was_control_flow)){
-							newinst.pipe_stage = 1;
-							*slots[i] = newinst;
-							newInstAdded = true;
-							if (mode == DEBUG) printf("New instruction added to pipeline\n\n");
-						}
+					*slots[i] = empty;
+				}
+				
+				// Load a new instruction in the pipe
+				if (!end_of_fetch && (slots[i]->pipe_stage == 0) && !newInstAdded){
+					// determine if there's an empty 
+					bool already_have_fetch_inst = 0;
+					for (int j=0; j<5; j++) {
+						if (slots[j]->pipe_stage == 1)
+							already_have_fetch_inst = 1;
+					}
 						
-						else if ((already_have_fetch_inst == 0) && (was_control_flow)){
-							newinst = program_store[pc];
-							newinst.pipe_stage = 1;
-							*slots[i] = newinst;
-							newInstAdded = true;
-							if (mode == DEBUG) printf("New instruction added to pipeline\n\n");
-						}
+					if ((already_have_fetch_inst == 0) && (!was_control_flow)){
+						newinst.pipe_stage = 1;
+						*slots[i] = newinst;
+						newInstAdded = true;
+						if (mode == DEBUG) debug_log("New instruction added to pipeline\n\n");
 					}
 					
+					else if ((already_have_fetch_inst == 0) && (was_control_flow)){
+						newinst = *fetch_line(pc);
+						newinst.pipe_stage = 1;
+						*slots[i] = newinst;
+						newInstAdded = true;
+						if (mode == DEBUG) debug_log("New instruction added to pipeline\n\n");
+					}
 				}
 				
-				// DEBUG: pipe cycle debug
-				if (mode == DEBUG) {
-						printf("***************PIPE CYCLE DEBUG**************\n\n");
-						printf("Pipe 1: %d\n", slots[0]->pipe_stage);
-						printf("Pipe 2: %d\n", slots[1]->pipe_stage);
-						printf("Pipe 3: %d\n", slots[2]->pipe_stage);
-						printf("Pipe 4: %d\n", slots[3]->pipe_stage);
-						printf("Pipe 5: %d\n", slots[4]->pipe_stage);
-						printf("*********************************\n");
-				}
+			}
+			
+			// DEBUG: pipe cycle debug
+			if (mode == DEBUG) {
+					debug_log("***************PIPE CYCLE DEBUG**************\n\n");
+					debug_log("Pipe 1: %d\n", slots[0]->pipe_stage);
+					debug_log("Pipe 2: %d\n", slots[1]->pipe_stage);
+					debug_log("Pipe 3: %d\n", slots[2]->pipe_stage);
+					debug_log("Pipe 4: %d\n", slots[3]->pipe_stage);
+					debug_log("Pipe 5: %d\n", slots[4]->pipe_stage);
+					debug_log("*********************************\n");
+			}
 
 
-				//DEBUG: print each binary string
-				if ((mode == DEBUG) && (rawHex_array[pc] > 0x0)) {
-					printf("---Line %d---\n", pc + 1);
-				   //  printf("Binary: %u\n", program_store[pc]);
-					printf("Hex Number:\t\t0x%X\n", rawHex_array[pc]);
-					printf("Instruction:\t\t0x%X, %d\n", program_store[pc].instruction, program_store[pc].instruction);
-					printf("Destination register:\t%d\n", program_store[pc].dest_register);
-					printf("1st source register:\t%d\n", program_store[pc].first_reg_val);
-					if (opcode <= 0xB && opcode % 2 == 0) printf ("2nd source register:\t\t%d\n\n", program_store[pc].second_reg_val);
-					else printf("Immediate value:   %6d\n\n", (int16_t)program_store[pc].immediate);
-				}
+			//DEBUG: print each binary string
+			if ((mode == DEBUG) && (pc >= 0) && (pc < program_length) && (rawHex_array[pc] > 0x0)) {
+				debug_log("---Line %d---\n", pc + 1);
+			   //  printf("Binary: %u\n", program_store[pc]);
+				debug_log("Hex Number:\t\t0x%X\n", rawHex_array[pc]);
+				debug_log("Instruction:\t\t0x%X, %d\n", program_store[pc].instruction, program_store[pc].instruction);
+				debug_log("Destination register:\t%d\n", program_store[pc].dest_register);
+				debug_log("1st source register:\t%d\n", program_store[pc].first_reg_val);
+				if (OPCODE_INFO(program_store[pc].instruction)->format == FORMAT_R) debug_log("2nd source register:\t\t%d\n\n", program_store[pc].second_reg_val);
+				else debug_log("Immediate value:   %6d\n\n", (int16_t)program_store[pc].immediate);
 			}
+		}
 
 
-			// Re-check which lines are in which stages
-			for (int i = 0; i < 5; i++) {
-				if (slots[i]->pipe_stage == 1) {
-					inIF = slots[i];
-					inIFindex = i;
-				}
-				
-				if (slots[i]->pipe_stage == 2) {
-					inID = slots[i];
-					inIDindex = i;
-				}
-				
-				if (slots[i]->pipe_stage == 3) {
-					inEX = slots[i];
-					inEXindex = i;
-				}
-				
-				if (slots[i]->pipe_stage == 4) {
-					inMEM = slots[i];
-					inMEMindex = i;
-				}
-				
-				if (slots[i]->pipe_stage == 5) {
-					inWB = slots[i];
-					inWBindex = i;
-				}
+		// Re-check which lines are in which stages
+		for (int i = 0; i < 5; i++) {
+			if (slots[i]->pipe_stage == 1) {
+				inIF = slots[i];
+				inIFindex = i;
+			}
+			
+			if (slots[i]->pipe_stage == 2) {
+				inID = slots[i];
+				inIDindex = i;
+			}
+			
+			if (slots[i]->pipe_stage == 3) {
+				inEX = slots[i];
+				inEXindex = i;
+			}
+			
+			if (slots[i]->pipe_stage == 4) {
+				inMEM = slots[i];
+				inMEMindex = i;
+			}
+			
+			if (slots[i]->pipe_stage == 5) {
+				inWB = slots[i];
+				inWBindex = i;
 			}
+		}
 
 
-			// memory access instructions - MEM-ID hazard handling
-			if (inID && inMEM && findHazard(inMEM, inID) && functional_mode == NO_FWD) {
-				hazard_count++;
-				hazard = true;
-				cycle_counter++;
-				total_stalls++;
-				
-				// DEBUG
-				if (mode == DEBUG) printf("\n\n\n\nStall at cycle %d: MEM-ID hazard detected\n\n\n\n", cycle_counter);
-				
-				// Iterate through pipes and stall as appropriate
-				for (int i = 0; i < 5; i++) {
-					if (slots[i]->pipe_stage > 2 && slots[i]->pipe_stage < 5) {
-						if (slots[i]->pipe_stage == 3) {
-							if(opcode_master(*slots[i])){
-								*slots[inIFindex] = empty;
-								*slots[inIDindex] = empty;
-							}
-						}
-						slots[i]->pipe_stage++;
+		// memory access instructions - MEM-ID hazard handling
+		if (inID && inMEM && findHazard(inMEM, inID) && functional_mode == NO_FWD) {
+			hazard_count++;
+			hazard = true;
+			cycle_counter++;
+			total_stalls++;
+			cpi_bubble((inMEM->instruction == LDW) ? CPI_LOAD_USE : CPI_RAW_NO_FWD);
+			cpi_cycle();
+			if (pipe_tracing) trace_cycle();
+			if (profiling) profile_stall(inMEM, inID);
+			if (pipe_tracing) trace_stall(inMEM, inID);
+			
+			// DEBUG
+			if (mode == DEBUG) debug_log("\n\n\n\nStall at cycle %d: MEM-ID hazard detected\n\n\n\n", cycle_counter);
+			
+			// Iterate through pipes and stall as appropriate
+			for (int i = 0; i < 5; i++) {
+				if (slots[i]->pipe_stage > 2 && slots[i]->pipe_stage < 5) {
+					if (slots[i]->pipe_stage == 3) {
+						execute_stage(slots, i);
+						if (ready_to_end)
+							return;
 					}
-					// Write-back logic once a line is pushed through its respective pipe
-					else if (slots[i]->pipe_stage == 5){
-						if (mode == DEBUG) printf("\n\nWriting back data from pipe %d\n\n", i+1);
-						if (halt_executed && (slots[i]->instruction == HALT)){
-							cycle_counter--;
-							end_program();
-						}
-						
-						*slots[i] = empty;
+					slots[i]->pipe_stage++;
+				}
+				// Write-back logic once a line is pushed through its respective pipe
+				else if (slots[i]->pipe_stage == 5){
+					if (mode == DEBUG) debug_log("\n\nWriting back data from pipe %d\n\n", i+1);
+					if (halt_executed && (slots[i]->instruction == HALT)){
+						cycle_counter--;
+						cpi.cycles[cpi.last_cause]--;
+						ready_to_end = true;
+						return;
 					}
+					
+					*slots[i] = empty;
+				}
 
-					// Load a new instruction in the pipe
-					if (!end_of_fetch && (slots[i]->pipe_stage == 0) && !newInstAdded){
-						// determine if there's an empty 
-						bool already_have_fetch_inst = 0;
-						for (int j=0; j<5; j++) {
-							if (slots[j]->pipe_stage == 1)
-								already_have_fetch_inst = 1;
-						}
-							
-						if ((already_have_fetch_inst == 0) && (!was_control_flow)){
-							newinst.pipe_stage = 1;
-							*slots[i] = newinst;
-							newInstAdded = true;
-							if (mode == DEBUG) printf("New instruction added to pipeline\n\n");
-						}
+				// Load a new instruction in the pipe
+				if (!end_of_fetch && (slots[i]->pipe_stage == 0) && !newInstAdded){
+					// determine if there's an empty 
+					bool already_have_fetch_inst = 0;
+					for (int j=0; j<5; j++) {
+						if (slots[j]->pipe_stage == 1)
+							already_have_fetch_inst = 1;
+					}
 						
-						else if ((already_have_fetch_inst == 0) && (was_control_flow)){
-							newinst = program_store[pc];
-							newinst.pipe_stage = 1;
-							*slots[i] = newinst;
-							newInstAdded = true;
-							if (mode == DEBUG) printf("New instruction added to pipeline\n\n");
-						}
+					if ((already_have_fetch_inst == 0) && (!was_control_flow)){
+						newinst.pipe_stage = 1;
+						*slots[i] = newinst;
+						newInstAdded = true;
+						if (mode == DEBUG) debug_log("New instruction added to pipeline\n\n");
+					}
+					
+					else if ((already_have_fetch_inst == 0) && (was_control_flow)){
+						newinst = *fetch_line(pc);
+						newinst.pipe_stage = 1;
+						*slots[i] = newinst;
+						newInstAdded = true;
+						if (mode == DEBUG) debug_log("New instruction added to pipeline\n\n");
 					}
 				}
-				
-				// DEBUG: pipe cycle debug
-				if (mode == DEBUG) {
-						printf("***************PIPE CYCLE DEBUG**************\n\n");
-						printf("Pipe 1: %d\n", slots[0]->pipe_stage);
-						printf("Pipe 2: %d\n", slots[1]->pipe_stage);
-						printf("Pipe 3: %d\n", slots[2]->pipe_stage);
-						printf("Pipe 4: %d\n", slots[3]->pipe_stage);
-						printf("Pipe 5: %d\n", slots[4]->pipe_stage);
-						printf("*********************************\n");
-				}
+			}
+			
+			// DEBUG: pipe cycle debug
+			if (mode == DEBUG) {
+					debug_log("***************PIPE CYCLE DEBUG**************\n\n");
+					debug_log("Pipe 1: %d\n", slots[0]->pipe_stage);
+					debug_log("Pipe 2: %d\n", slots[1]->pipe_stage);
+					debug_log("Pipe 3: %d\n", slots[2]->pipe_stage);
+					debug_log("Pipe 4: %d\n", slots[3]->pipe_stage);
+					debug_log("Pipe 5: %d\n", slots[4]->pipe_stage);
+					debug_log("*********************************\n");
+			}
 
 
-				//DEBUG: print each binary string
-				if ((mode == DEBUG) && (rawHex_array[pc] > 0x0)) {
-					printf("---Line %d---\n", pc + 1);
-				   //  printf("Binary: %u\n", program_store[pc]);
-					printf("Hex Number:\t\t0x%X\n", rawHex_array[pc]);
-					printf("Instruction:\t\t0x%X, %d\n", program_store[pc].instruction, program_store[pc].instruction);
-					printf("Destination register:\t%d\n", program_store[pc].dest_register);
-					printf("1st source register:\t%d\n", program_store[pc].first_reg_val);
-					if (opcode <= 0xB && opcode % 2 == 0) printf ("2nd source register:\t\t%d\n\n", program_store[pc].second_reg_val);
-					else printf("Immediate value:   %6d\n\n", (int16_t)program_store[pc].immediate);
-				}
+			//DEBUG: print each binary string
+			if ((mode == DEBUG) && (pc >= 0) && (pc < program_length) && (rawHex_array[pc] > 0x0)) {
+				debug_log("---Line %d---\n", pc + 1);
+			   //  printf("Binary: %u\n", program_store[pc]);
+				debug_log("Hex Number:\t\t0x%X\n", rawHex_array[pc]);
+				debug_log("Instruction:\t\t0x%X, %d\n", program_store[pc].instruction, program_store[pc].instruction);
+				debug_log("Destination register:\t%d\n", program_store[pc].dest_register);
+				debug_log("1st source register:\t%d\n", program_store[pc].first_reg_val);
+				if (OPCODE_INFO(program_store[pc].instruction)->format == FORMAT_R) debug_log("2nd source register:\t\t%d\n\n", program_store[pc].second_reg_val);
+				else debug_log("Immediate value:   %6d\n\n", (int16_t)program_store[pc].immediate);
 			}
+		}
 
 
+		
+		// No-hazard case
+		if (!hazard) {
+			cycle_counter++;
+			cpi_cycle();
+			if (pipe_tracing) trace_cycle();
 			
-			// No-hazard case
-			if (!hazard) {
-				cycle_counter++;
+			// Execute on each instruction once they're in the EX stage
+			for (int i = 0; i < 5; i++) {
+				if (slots[i]->pipe_stage > 0 && slots[i]->pipe_stage < 5) {
+					if (slots[i]->pipe_stage == 3) {
+						execute_stage(slots, i);
+						if (ready_to_end)
+							return;
+					}
+					slots[i]->pipe_stage++;
+				}
+				// Print Write-backs
+				else if (slots[i]->pipe_stage == 5){
+					if (mode == DEBUG) debug_log("\n\nWriting back data from pipe %d\n\n", i+1);
+					if (halt_executed && (slots[i]->instruction == HALT)){
+						cycle_counter--;
+						cpi.cycles[cpi.last_cause]--;
+						ready_to_end = true;
+						return;
+					}
+					
+					*slots[i] = empty;
+				}
 				
-				// Execute on each instruction once they're in the EX stage
-				for (int i = 0; i < 5; i++) {
-					if (slots[i]->pipe_stage > 0 && slots[i]->pipe_stage < 5) {
-						if (slots[i]->pipe_stage == 3) {
-							if(opcode_master(*slots[i])){
-								*slots[inIFindex] = empty;
-								*slots[inIDindex] = empty;
-							}
-						}
-						slots[i]->pipe_stage++;
+				// Load a new instruction in the pipe
+				if (!end_of_fetch && (slots[i]->pipe_stage == 0) && !newInstAdded){
+					// determine if there's an empty 
+					bool already_have_fetch_inst = 0;
+					for (int j=0; j<5; j++) {
+						if (slots[j]->pipe_stage == 1)
+							already_have_fetch_inst = 1;
 					}
-					// Print Write-backs
-					else if (slots[i]->pipe_stage == 5){
-						if (mode == DEBUG) printf("\n\nWriting back data from pipe %d\n\n", i+1);
-						if (halt_executed && (slots[i]->instruction == HALT)){
-							cycle_counter--;
-							end_program();
-						}
 						
-						*slots[i] = empty;
+					if ((already_have_fetch_inst == 0) && (!was_control_flow)){
+						newinst.pipe_stage = 1;
+						*slots[i] = newinst;
+						newInstAdded = true;
+						if (mode == DEBUG) debug_log("New instruction added to pipeline\n\n");
 					}
 					
-					// Load a new instruction in the pipe
-					if (!end_of_fetch && (slots[i]->pipe_stage == 0) && !newInstAdded){
-						// determine if there's an empty 
-						bool already_have_fetch_inst = 0;
-						for (int j=0; j<5; j++) {
-							if (slots[j]->pipe_stage == 1)
-								already_have_fetch_inst = 1;
-						}
-							
-						if ((already_have_fetch_inst == 0) && (!was_control_flow)){
-							newinst.pipe_stage = 1;
-							*slots[i] = newinst;
-							newInstAdded = true;
-							if (mode == DEBUG) printf("New instruction added to pipeline\n\n");
-						}
-						
-						else if ((already_have_fetch_inst == 0) && (was_control_flow)){
-							newinst = program_store[pc];
-							newinst.pipe_stage = 1;
-							*slots[i] = newinst;
-							newInstAdded = true;
-							if (mode == DEBUG) printf("New instruction added to pipeline\n\n");
-						}
+					else if ((already_have_fetch_inst == 0) && (was_control_flow)){
+						newinst = *fetch_line(pc);
+						newinst.pipe_stage = 1;
+						*slots[i] = newinst;
+						newInstAdded = true;
+						if (mode == DEBUG) debug_log("New instruction added to pipeline\n\n");
 					}
-				}	
-				
-				
-				// DEBUG: pipe cycle debug
-				if (mode == DEBUG) {
-					printf("***************PIPE CYCLE DEBUG**************\n\n");
-					printf("Pipe 1: %d\n", slots[0]->pipe_stage);
-					printf("Pipe 2: %d\n", slots[1]->pipe_stage);
-					printf("Pipe 3: %d\n", slots[2]->pipe_stage);
-					printf("Pipe 4: %d\n", slots[3]->pipe_stage);
-					printf("Pipe 5: %d\n", slots[4]->pipe_stage);
-					printf("*********************************\n");
-				}
-
-
-				//DEBUG: print each binary string
-				if ((mode == DEBUG) && (rawHex_array[pc] > 0x0)) {
-					printf("---Line %d---\n", pc + 1);
-				   //  printf("Binary: %u\n", program_store[pc]);
-					printf("Hex Number:\t\t0x%X\n", rawHex_array[pc]);
-					printf("Instruction:\t\t0x%X, %d\n", program_store[pc].instruction, program_store[pc].instruction);
-					printf("Destination register:\t%d\n", program_store[pc].dest_register);
-					printf("1st source register:\t%d\n", program_store[pc].first_reg_val);
-					if (opcode <= 0xB && opcode % 2 == 0) printf ("2nd source register:\t\t%d\n\n", program_store[pc].second_reg_val);
-					else printf("Immediate value:   %6d\n\n", (int16_t)program_store[pc].immediate);
 				}
-				
-			}
-			
-			
+			}	
 			
-			// PLEASE DO NOT GET RID OF THIS IT MAKES IT RUN FOREVER TRUST ME
-			hazard = false;
 			
-			// once we've hit EOF *and* every stage is empty, we're done
-			if (end_of_fetch
-			  && pipe.pipe1.pipe_stage == 0
-			  && pipe.pipe2.pipe_stage == 0
-			  && pipe.pipe3.pipe_stage == 0
-			  && pipe.pipe4.pipe_stage == 0
-			  && pipe.pipe5.pipe_stage == 0) {
-				end_program();   // prints stats + exit
+			// DEBUG: pipe cycle debug
+			if (mode == DEBUG) {
+				debug_log("***************PIPE CYCLE DEBUG**************\n\n");
+				debug_log("Pipe 1: %d\n", slots[0]->pipe_stage);
+				debug_log("Pipe 2: %d\n", slots[1]->pipe_stage);
+				debug_log("Pipe 3: %d\n", slots[2]->pipe_stage);
+				debug_log("Pipe 4: %d\n", slots[3]->pipe_stage);
+				debug_log("Pipe 5: %d\n", slots[4]->pipe_stage);
+				debug_log("*********************************\n");
+			}
+
+
+			//DEBUG: print each binary string
+			if ((mode == DEBUG) && (pc >= 0) && (pc < program_length) && (rawHex_array[pc] > 0x0)) {
+				debug_log("---Line %d---\n", pc + 1);
+			   //  printf("Binary: %u\n", program_store[pc]);
+				debug_log("Hex Number:\t\t0x%X\n", rawHex_array[pc]);
+				debug_log("Instruction:\t\t0x%X, %d\n", program_store[pc].instruction, program_store[pc].instruction);
+				debug_log("Destination register:\t%d\n", program_store[pc].dest_register);
+				debug_log("1st source register:\t%d\n", program_store[pc].first_reg_val);
+				if (OPCODE_INFO(program_store[pc].instruction)->format == FORMAT_R) debug_log("2nd source register:\t\t%d\n\n", program_store[pc].second_reg_val);
+				else debug_log("Immediate value:   %6d\n\n", (int16_t)program_store[pc].immediate);
 			}
 			
 		}
+		
+		
+		
+		// PLEASE DO NOT GET RID OF THIS IT MAKES IT RUN FOREVER TRUST ME
+		hazard = false;
+		
+		// once we've hit EOF *and* every stage is empty, we're done
+		if (end_of_fetch
+		  && pipe.pipe1.pipe_stage == 0
+		  && pipe.pipe2.pipe_stage == 0
+		  && pipe.pipe3.pipe_stage == 0
+		  && pipe.pipe4.pipe_stage == 0
+		  && pipe.pipe5.pipe_stage == 0) {
+			ready_to_end = true;   // main prints stats + exits
+			return;
+		}
+		
 	}
+}
+
+
+
 
 
+
+
+
+void reset_pipeline(int entry) {
 	
-	if(mode == DEBUG) printf("No HALT instruction found- ending program");
+	pipe.pipe1 = empty; pipe.pipe2=empty; pipe.pipe3=empty; pipe.pipe4=empty; pipe.pipe5=empty;
+	newinst = empty;
 	
-	end_program();
+	newInstAdded = true;
+	end_of_fetch = false;
+	hazard = false;
+	was_control_flow = 0;
+	halt_executed = false;
+	ready_to_end = false;
+	
+	cpi.pending_count = 0;
+	cpi.filled = false;
+	
+	if (fast_loops) reset_fast_loops();
+	
+	pc = entry - 1; // will be incremented first thing to the entry line
+}
 
-	return 99;
+
+
+
+void reset_simulation() {
+	
+	memset(memory, 0, MEMORY_SIZE * sizeof(int32_t));
+	memset(memory_used, 0, MEMORY_SIZE * sizeof(bool));
+	clear_dirty_map();
+	
+	memset(program_store, 0, sizeof(program_store));
+	memset(rawHex_array, 0, sizeof(rawHex_array));
+	memset(code_stale, 0, sizeof(code_stale));
+	program_length = 0;
+	
+	reset_core_state();
+}
+
+
+void reset_core_state() {
+	
+	memset(registers, 0, sizeof(registers));
+	memset(register_used, 0, sizeof(register_used));
+	
+	memset(opcode_count, 0, sizeof(opcode_count));
+	rtype_count = itype_count = 0;
+	arith_count = logic_count = memacc_count = cflow_count = 0;
+	total_inst_count = 0;
+	total_stalls = 0;
+	hazard_count = 0;
+	memset(&cpi, 0, sizeof(cpi));
+	
+	cycle_counter = 0;
+	sync_cycle = INT_MAX;
+	inst_event_count = INT_MAX;
+	cycle_event_count = INT_MAX;
+	last_executed_line = -1;
+	successful_branch_limiter = 0;
+	rtype = 0;
+	was_jrfunc_for_nopipe = 0;
+	
+	reset_pipeline(0);
+	pc = 0;
+}
+
+
+
+
+bool functional_step() {
+	int line_index = pc;
+	
+	if (pc < 0 || pc > program_length) {
+		ready_to_end = true;
+		return false;
+	}
+	
+	if (code_stale[line_index])
+		refresh_line(line_index);
+	
+	// Callers count the lines they step, so no loop may be skipped here.
+	// Control flow carries on where run_nopipe() does: two lines past
+	// where a branch leaves pc, and the line after a JR's target
+	fast_loops_held = true;
+	if (opcode_master(program_store[line_index])) {
+		if (was_jrfunc_for_nopipe)
+			was_jrfunc_for_nopipe = 0;
+		else
+			pc += 2;
+	}
+	pc++;
+	fast_loops_held = false;
+	
+	if (halt_executed)
+		ready_to_end = true;
+	
+	return !ready_to_end;
+}
+
+
+
+
+int next_line() {
+	decodedLine line;
+	
+	if (last_executed_line < 0)
+		return pc;
+	
+	line = program_store[last_executed_line];
+	
+	if (!was_control_flow)
+		return last_executed_line + 1;
+	
+	// Taken BZ/BEQ: the offset is relative to the line after the branch.
+	// Taken JR: the line after the one its register points at
+	if (line.instruction == BZ || line.instruction == BEQ)
+		return last_executed_line + 1 + (int16_t)line.immediate / 4;
+	if (line.instruction == JR)
+		return (int16_t)registers[line.first_reg_val] / 4 + 1;
+	
+	return pc;
+}
+
+
+
+
+void schedule_inst_event(int count) {
+	if (count < inst_event_count)
+		inst_event_count = count;
+}
+
+
+void inst_event() {
+	
+	// Every user reschedules itself for its next event
+	inst_event_count = INT_MAX;
+	
+	if (sampling)
+		sample_inst_event();
+	
+	if (slicing)
+		slice_inst_event();
+	
+	checkpoint_inst_event();
+	
+	reuse_inst_event();
+	
+	trace_window_inst_event();
+	
+	validate_inst_event();
+	
+	history_inst_event();
+	
+	if (serving)
+		server_inst_event();
+	
+	if (fuzzing)
+		fuzz_inst_event();
+}
+
+
+
+
+void cpi_bubble(int cause) {
+	
+	// A full queue only happens if bubbles stop reaching EX; keep the newest
+	if (cpi.pending_count == CPI_PENDING) {
+		memmove(cpi.pending, cpi.pending + 1, CPI_PENDING - 1);
+		cpi.pending_count--;
+	}
+	cpi.pending[cpi.pending_count++] = cause;
+}
+
+
+void cpi_cycle() {
+	const decodedLine *slots[5] = {&pipe.pipe1, &pipe.pipe2, &pipe.pipe3, &pipe.pipe4, &pipe.pipe5};
+	int cause;
+	
+	for (int i = 0; i < 5; i++) {
+		if (slots[i]->pipe_stage == EX) {
+			cpi.cycles[CPI_BASE]++;
+			cpi.last_cause = CPI_BASE;
+			cpi.filled = true;
+			return;
+		}
+	}
+	
+	// EX is empty: charge it to the oldest bubble still on its way
+	if (cpi.pending_count > 0) {
+		cause = cpi.pending[0];
+		memmove(cpi.pending, cpi.pending + 1, --cpi.pending_count);
+	}
+	else if (end_of_fetch || halt_executed)
+		cause = CPI_DRAIN;
+	else if (!cpi.filled)
+		cause = CPI_FILL;
+	else
+		cause = CPI_FRONT_END;
+	
+	cpi.cycles[cause]++;
+	cpi.last_cause = cause;
+}
+
+
+void flush_fetch(decodedLine *slots[5], const decodedLine *line) {
+	
+	// Every line behind 'line' is in IF or ID, or just moved up to EX
+	for (int i = 0; i < 5; i++) {
+		if (slots[i] == line || slots[i]->pipe_stage < IF || slots[i]->pipe_stage > EX)
+			continue;
+		
+		if (profiling) profile_flush(slots[i]);
+		if (pipe_tracing) trace_flush(slots[i]);
+		
+		// Every line thrown out leaves a bubble behind it; behind a HALT
+		// the pipeline is draining anyway
+		if (!halt_executed)
+			cpi_bubble(CPI_CONTROL);
+		
+		*slots[i] = empty;
+	}
 }
 
 
+void schedule_cycle_event(int cycle) {
+	if (cycle < cycle_event_count)
+		cycle_event_count = cycle;
+}
 
 
+void cycle_event() {
+	
+	// Every user reschedules itself for its next event
+	cycle_event_count = INT_MAX;
+	
+	// Hand over to the other cores once our quantum is used up
+	if (cycle_counter >= sync_cycle)
+		core_sync();
+	schedule_cycle_event(sync_cycle);
+	
+	stats_cycle_event();
+	
+	trace_window_cycle_event();
+	
+	history_cycle_event();
+	
+	if (serving)
+		server_cycle_event();
+}
 
 
 
 
 // detect RAW hazard between two stages
 bool findHazard(const decodedLine *wr, const decodedLine *rd) {
+	const opcodeInfo *writer = OPCODE_INFO(wr->instruction);
+	const opcodeInfo *reader = OPCODE_INFO(rd->instruction);
+	
     // Both stages must hold an instruction
     if (wr->pipe_stage == 0 || rd->pipe_stage == 0) 
 		return false;
@@ -792,15 +1649,18 @@ bool findHazard(const decodedLine *wr, const decodedLine *rd) {
     if (wr->instruction == NOP || rd->instruction == NOP) 
 		return false;
 	
-    if (wr->dest_register < 0) 
+    // The table says which registers each line really writes and reads
+    if (wr->dest_register < 0 || !(writer->usage & WRITES_DEST)) 
 		return false;
 	
-    // Check first source register
-    if (wr->dest_register == rd->first_reg_val) 
+    if ((reader->usage & READS_FIRST) && wr->dest_register == rd->first_reg_val) 
 		return true;
 	
-    // Only R-type opcodes (even, <=0x0A) have a second source
-    if ((rd->instruction % 2 == 0 && rd->instruction <= 0x0A) && wr->dest_register == rd->second_reg_val)
+    if ((reader->usage & READS_SECOND) && wr->dest_register == rd->second_reg_val)
+        return true;
+	
+    // STW's stored register is in dest_register
+    if ((reader->usage & READS_DEST) && wr->dest_register == rd->dest_register)
         return true;
 	
     return false;
@@ -821,15 +1681,70 @@ int32_t StringToHex(char *hex_string) {
 }
 
 
+const char *opcode_name(int opcode) {
+	if (opcode < 0 || opcode >= OPCODES || opcode_table[opcode].name == NULL)
+		return "???";
+	return opcode_table[opcode].name;
+}
+
+
 void end_program() {
 	
-	print_stats();
+	flush_debug_log();
+	
+	if (stats_format != STATS_TEXT)
+		write_stats();
+	
+	finish_pipe_trace();
+	finish_mem_trace();
+	
+	if (text_report()) {
+		print_stats();
+		if (reuse_analysis)
+			print_reuse_stats();
+		if (ilp_analysis)
+			print_ilp_stats();
+		if (cpi_report)
+			print_cpi_stack();
+		if (sampling)
+			print_sample_stats();
+		if (slicing)
+			print_slice_stats();
+		if (profiling)
+			print_profile();
+		if (fast_loops)
+			print_fast_loop_stats();
+		if (watching)
+			print_watch_stats();
+	}
+	
+	if (profiling)
+		write_profile(NULL);
+	
+	if (delta_dump)
+		write_delta();
+	
+	// The replay back to the target would add to everything reported above
+	if (recording && text_report()) {
+		profiling = ilp_analysis = reuse_analysis = pipe_tracing = mem_tracing = watching = false;
+		rewind_history();
+	}
 	exit(EXIT_SUCCESS);
 }
 
 
 void print_stats() {
 	
+	print_registers();
+	print_memory();
+	print_counts();
+	
+	return;
+}
+
+
+void print_registers() {
+	
 	printf("\n\n\n Registers Used:\n"); 
 	printf("================================\n");
 	bool atleast_one_register_printed = 0;
@@ -843,24 +1758,50 @@ void print_stats() {
 	if (!atleast_one_register_printed)
 			printf("No registers used.");
 	printf("================================\n");
-	
-	
+}
+
+
+void print_memory() {
 	
 	printf("\n\n\n Memory Used:\n"); 
 	printf("================================\n");
 	bool atleast_one_memory_printed = 0;
-	for (int i = 0; i<MEMORY_SIZE; i++){
-		if (memory_used[i]){
-			if (atleast_one_memory_printed) printf("--------------------------------\n");
-			printf(" Address:   %" PRIi32 "\n Contents:  %d\n", i, memory[i]);
-			atleast_one_memory_printed = 1;
-		}
+	for (int i = next_used_word(0); i >= 0; i = next_used_word(i + 1)){
+		if (atleast_one_memory_printed) printf("--------------------------------\n");
+		printf(" Address:   %" PRIi32 "\n Contents:  %d\n", i * 4, memory[i]);
+		atleast_one_memory_printed = 1;
 	}
 	if (!atleast_one_memory_printed)
 			printf("No memory addresses used.\n");
 	printf("================================\n");
+}
+
+
+void tally_instruction_mix() {
+	int counts[INSTRUCTION_CLASSES] = {0};
+
+	rtype_count = 0;
+	itype_count = 0;
+	for (int op = 0; op < OPCODES; op++) {
+		if (opcode_count[op] == 0)
+			continue;
+		counts[opcode_table[op].class] += opcode_count[op];
+		if (opcode_table[op].format == FORMAT_R)
+			rtype_count += opcode_count[op];
+		else
+			itype_count += opcode_count[op];
+	}
+
+	arith_count = counts[CLASS_ARITH];
+	logic_count = counts[CLASS_LOGIC];
+	memacc_count = counts[CLASS_MEMORY];
+	cflow_count = counts[CLASS_CONTROL];
+}
+
+
+void print_counts() {
 	
-	
+	tally_instruction_mix();
 	
     printf("\n\n\n Instruction Count Statistics:\n"); 
 	printf("================================\n");
@@ -880,153 +1821,129 @@ void print_stats() {
 	printf("--------------------------------\n");
 	printf(" Program Counter:	%d\n", pc);
 	printf("================================\n");
+}
+
+
+void print_cpi_stack() {
+	const char *names[CPI_CAUSES] = {
+		"Base:\t\t", "RAW Stall (FWD):", "RAW Stall (No FWD):", "Load-Use Stall:\t", "Control Flush:\t",
+		"Memory Stall:\t", "Fill:\t\t", "Drain:\t\t", "Front-End Bubble:"
+	};
+	double insts = (total_inst_count > 0) ? total_inst_count : 1;
+	double total = (cycle_counter > 0) ? cycle_counter : 1;
 	
-	return;
+	printf("\n\n\n CPI Stack:\n"); 
+	printf("================================================\n");
+	printf(" Cycles:		%d\n", cycle_counter);
+	printf(" Instructions:		%d\n", total_inst_count);
+	printf(" CPI:			%.3f\n", (total_inst_count > 0) ? (double)cycle_counter / total_inst_count : 0.0);
+	printf("------------------------------------------------\n");
+	printf("			Cycles	CPI	Share\n");
+	for (int c = 0; c < CPI_CAUSES; c++)
+		printf(" %s\t%d\t%.3f\t%5.1f%%\n", names[c], cpi.cycles[c], cpi.cycles[c] / insts, 100.0 * cpi.cycles[c] / total);
+	printf("================================================\n");
 }
 
 
+// opcode_table[] handlers: unpack a decoded line for the xxxfunc() that runs it
+static void execute_add(const decodedLine *l)	{ addfunc(l->dest_register, l->first_reg_val, l->second_reg_val, false); }
+static void execute_addi(const decodedLine *l)	{ addfunc(l->dest_register, l->first_reg_val, l->immediate, true); }
+static void execute_sub(const decodedLine *l)	{ subfunc(l->dest_register, l->first_reg_val, l->second_reg_val, false); }
+static void execute_subi(const decodedLine *l)	{ subfunc(l->dest_register, l->first_reg_val, l->immediate, true); }
+static void execute_mul(const decodedLine *l)	{ mulfunc(l->dest_register, l->first_reg_val, l->second_reg_val, false); }
+static void execute_muli(const decodedLine *l)	{ mulfunc(l->dest_register, l->first_reg_val, l->immediate, true); }
+static void execute_or(const decodedLine *l)	{ orfunc(l->dest_register, l->first_reg_val, l->second_reg_val, false); }
+static void execute_ori(const decodedLine *l)	{ orfunc(l->dest_register, l->first_reg_val, l->immediate, true); }
+static void execute_and(const decodedLine *l)	{ andfunc(l->dest_register, l->first_reg_val, l->second_reg_val, false); }
+static void execute_andi(const decodedLine *l)	{ andfunc(l->dest_register, l->first_reg_val, l->immediate, true); }
+static void execute_xor(const decodedLine *l)	{ xorfunc(l->dest_register, l->first_reg_val, l->second_reg_val, false); }
+static void execute_xori(const decodedLine *l)	{ xorfunc(l->dest_register, l->first_reg_val, l->immediate, true); }
+static void execute_ldw(const decodedLine *l)	{ ldwfunc(l->dest_register, l->first_reg_val, l->immediate); }
+static void execute_stw(const decodedLine *l)	{ stwfunc(l->dest_register, l->first_reg_val, l->immediate); }
+static void execute_bz(const decodedLine *l)	{ bzfunc(l->first_reg_val, l->immediate); }
+static void execute_beq(const decodedLine *l)	{ beqfunc(l->first_reg_val, l->second_reg_val, l->immediate); }
+static void execute_jr(const decodedLine *l)	{ jrfunc(l->first_reg_val); }
+static void execute_halt(const decodedLine *l)	{ (void)l; haltfunc(); }
+
+
+#define R_FIELDS (FIELD_RD_DEST | FIELD_RS | FIELD_RT)
+#define I_FIELDS (FIELD_RT_DEST | FIELD_RS | FIELD_IMM)
+#define R_USAGE (READS_FIRST | READS_SECOND | WRITES_DEST)
+#define I_USAGE (READS_FIRST | WRITES_DEST)
+
+// Everything decode, hazard detection, execution and the instruction mix
+// statistics need to know about an opcode. Unlisted opcodes are all zero
+const opcodeInfo opcode_table[OPCODES] = {
+	[ADD]	= {"ADD",  FORMAT_R, CLASS_ARITH, R_FIELDS, R_USAGE, 1, "\nADD Instruction Executed\n", execute_add},
+	[ADDI]	= {"ADDI", FORMAT_I, CLASS_ARITH, I_FIELDS, I_USAGE, 1, "\nADDI Instruction Executed\n", execute_addi},
+	[SUB]	= {"SUB",  FORMAT_R, CLASS_ARITH, R_FIELDS, R_USAGE, 1, "\nSUB Instruction Executed\n", execute_sub},
+	[SUBI]	= {"SUBI", FORMAT_I, CLASS_ARITH, I_FIELDS, I_USAGE, 1, "\nSUBI Instruction Executed\n", execute_subi},
+	[MUL]	= {"MUL",  FORMAT_R, CLASS_ARITH, R_FIELDS, R_USAGE, 1, "\nMUL Instruction Executed\n", execute_mul},
+	[MULI]	= {"MULI", FORMAT_I, CLASS_ARITH, I_FIELDS, I_USAGE, 1, "\nMULI Instruction Executed\n", execute_muli},
+	[OR]	= {"OR",   FORMAT_R, CLASS_LOGIC, R_FIELDS, R_USAGE, 1, "\nOR Instruction Executed\n", execute_or},
+	[ORI]	= {"ORI",  FORMAT_I, CLASS_LOGIC, I_FIELDS, I_USAGE, 1, "\nORI Instruction Executed\n", execute_ori},
+	[AND]	= {"AND",  FORMAT_R, CLASS_LOGIC, R_FIELDS, R_USAGE, 1, "\nAND Instruction Executed\n", execute_and},
+	[ANDI]	= {"ANDI", FORMAT_I, CLASS_LOGIC, I_FIELDS, I_USAGE, 1, "\nANDI Instruction Executed\n", execute_andi},
+	[XOR]	= {"XOR",  FORMAT_R, CLASS_LOGIC, R_FIELDS, R_USAGE, 1, "\nXOR Instruction Executed\n", execute_xor},
+	[XORI]	= {"XORI", FORMAT_I, CLASS_LOGIC, I_FIELDS, I_USAGE, 1, "\nXORI Instruction Executed\n", execute_xori},
+	[LDW]	= {"LDW",  FORMAT_I, CLASS_MEMORY, I_FIELDS, I_USAGE, 1, "\nLDW Instruction Executed\n", execute_ldw},
+	[STW]	= {"STW",  FORMAT_I, CLASS_MEMORY, I_FIELDS, READS_FIRST | READS_DEST, 1, "\nSTW Instruction Executed\n", execute_stw},
+	[BZ]	= {"BZ",   FORMAT_I, CLASS_CONTROL, FIELD_RS | FIELD_IMM, READS_FIRST, 1, "\nBZ Instruction Executed\n", execute_bz},
+	[BEQ]	= {"BEQ",  FORMAT_I, CLASS_CONTROL, FIELD_RS | FIELD_RT | FIELD_IMM, READS_FIRST | READS_SECOND, 1, "\nBEQ Instruction Executed\n", execute_beq},
+	[JR]	= {"JR",   FORMAT_I, CLASS_CONTROL, FIELD_RS, READS_FIRST, 1, "\nJR Instruction Executed\n", execute_jr},
+	[HALT]	= {"HALT", FORMAT_I, CLASS_CONTROL, 0, 0, 1, "HALT INSTRUCTION EXECUTED: FINISHING PROGRAM...\n\n\n\n\n", execute_halt},
+	[EOP]	= {"EOP",  FORMAT_NONE, CLASS_NONE, 0, 0, 0, NULL, NULL},
+	[NOP]	= {"NOP",  FORMAT_NONE, CLASS_NONE, 0, 0, 0, NULL, NULL},
+};
+
+
 bool opcode_master(decodedLine line) {
+	const opcodeInfo *info;
 
 	rtype = 0;
 	was_control_flow = 0;
-	
-
-	
-    switch(line.instruction) {	
-		// Arithmetic Instructions:
-		{
-		case ADD:
-			if (mode == DEBUG) printf("\nADD Instruction Executed\n");
-			addfunc(line.dest_register, line.first_reg_val, line.second_reg_val, false);
-			break;
-			
-		case ADDI:
-			if (mode == DEBUG) printf("\nADDI Instruction Executed\n");
-			addfunc(line.dest_register, line.first_reg_val, line.immediate, true);
-			break;
-			
-		case SUB:
-			if (mode == DEBUG) printf("\nSUB Instruction Executed\n");
-			subfunc(line.dest_register, line.first_reg_val, line.second_reg_val, false);
-			break;
-			
-		case SUBI:
-			if (mode == DEBUG) printf("\nSUBI Instruction Executed\n");
-			subfunc(line.dest_register, line.first_reg_val, line.immediate, true);
-			break;
-			
-		case MUL:
-			if (mode == DEBUG) printf("\nMUL Instruction Executed\n");
-			mulfunc(line.dest_register, line.first_reg_val, line.second_reg_val, false);
-			
-			break;
-			
-		case MULI:
-			if (mode == DEBUG) printf("\nMULI Instruction Executed\n");
-			mulfunc(line.dest_register, line.first_reg_val, line.immediate, true);
-			break;
+	last_executed_line = line.line_index;
+	if (profiling) profile_executed(line.line_index);
+	if (window_checking) trace_window_step(line.line_index);
+	if (ilp_analysis) ilp_execute(&line);
+	if (validating) validate_execute(line.line_index);
+	
+
+	
+	info = OPCODE_INFO(line.instruction);
+	if (info->execute != NULL) {
+		if (mode == DEBUG) debug_log(info->trace);
+		if (recording) history_step(&line);
+		if (watching) watch_step(&line);
+		info->execute(&line);
+		opcode_count[(uint8_t)line.instruction]++;
+		total_inst_count++;
+		if (watching) watch_executed(&line);
+	}
+	else {
+		if (line.instruction == NOP) {
+			if (mode == DEBUG) 
+				debug_log("\nNOP Instruction Executed\n");
 		}
-		
-		
-		// Logical Instructions:
-		{
-		case OR:
-			if (mode == DEBUG) printf("\nOR Instruction Executed\n");
-			orfunc(line.dest_register, line.first_reg_val, line.second_reg_val, false);
-			break;
-			
-		case ORI:
-			if (mode == DEBUG) printf("\nORI Instruction Executed\n");
-			orfunc(line.dest_register, line.first_reg_val, line.immediate, true);
-			break;
-			
-		case AND:
-			if (mode == DEBUG) printf("\nAND Instruction Executed\n");
-			andfunc(line.dest_register, line.first_reg_val, line.second_reg_val, false);
-			break;
-			
-		case ANDI:
-			if (mode == DEBUG) printf("\nANDI Instruction Executed\n");
-			andfunc(line.dest_register, line.first_reg_val, line.immediate, true);
-			break;
-			
-		case XOR:
-			if (mode == DEBUG) printf("\nXOR Instruction Executed\n");
-			xorfunc(line.dest_register, line.first_reg_val, line.second_reg_val, false);
-			break;
-			
-		case XORI:
-			if (mode == DEBUG) printf("\nXORI Instruction Executed\n");
-			xorfunc(line.dest_register, line.first_reg_val, line.immediate, true);
-			break;	
+		if (line.instruction == 0x3F){
+			if (mode == DEBUG)
+				debug_log("Error: Unknown opcode 0x%02X. Exiting.\n", line.instruction);
 		}
-		
-		
-		// Memory Access Instructions:
-		{
-		case LDW:
-			if (mode == DEBUG) printf("\nLDW Instruction Executed\n");
-			ldwfunc(line.dest_register, line.first_reg_val, line.immediate);
-			break;
 			
-		case STW:
-			if (mode == DEBUG) printf("\nSTW Instruction Executed\n");
-			stwfunc(line.dest_register, line.first_reg_val, line.immediate);
-			break;
+		if (line.instruction == EOP){
+			if (mode == DEBUG)
+				debug_log("\n End Of Program found (no HALT found): ending program\n");
+			ready_to_end = true;
 		}
-		
-		
-		// Control Flow Instructions:
-		{
-		case BZ:
-			if (mode == DEBUG) printf("\nBZ Instruction Executed\n");
-			bzfunc(line.first_reg_val, line.immediate);
-			break;
-			
-		case BEQ:
-			if (mode == DEBUG) printf("\nBEQ Instruction Executed\n");
-			beqfunc(line.first_reg_val, line.second_reg_val, line.immediate);
-			break;
-			
-		case JR:
-			if (mode == DEBUG) printf("\nJR Instruction Executed\n");
-			jrfunc(line.first_reg_val);
-			break;
-			
-		case HALT:
-			if (mode == DEBUG) printf("HALT INSTRUCTION EXECUTED: FINISHING PROGRAM...\n\n\n\n\n");
-			haltfunc();
-			break;
+		else {
+			if (mode == DEBUG)
+				debug_log("Error: Unknown opcode 0x%02X. Exiting.\n", line.instruction);
 		}
-		
-	
-		default:
-			if (line.instruction == NOP) {
-				if (mode == DEBUG) 
-					printf("\nNOP Instruction Executed\n");
-			}
-			if (line.instruction == 0x3F){
-				if (mode == DEBUG)
-					printf("Error: Unknown opcode 0x%02X. Exiting.\n", line.instruction);
-			}
-				
-			if (line.instruction == EOP){
-				if (mode == DEBUG)
-					printf("\n End Of Program found (no HALT found): ending program\n");
-				end_program();
-			}
-			else {
-				if (mode == DEBUG)
-					printf("Error: Unknown opcode 0x%02X. Exiting.\n", line.instruction);
-					
-				
-			}
-			
-			
-			
 	}
 	
 	
+	if (fast_loops) fast_loop_executed(&line);
+	
 	// Unless control flow instruction modified pc directly, increment by default
 	if (was_control_flow == 0)
 		return false;
@@ -1037,7 +1954,7 @@ bool opcode_master(decodedLine line) {
 
 
 void addfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
-	if(mode == DEBUG) printf(
+	if(mode == DEBUG) debug_log(
             "[DEBUG] addfunc called with dest=%" PRIi32
             ", src1=%" PRIi32
             ", src2=%" PRIi32
@@ -1051,23 +1968,16 @@ void addfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
 	if (!is_immediate) rtype = 1;
     int32_t val1 = registers[(int)src1];
     int32_t val2 = is_immediate ? src2 : registers[(int)src2]; // sign-extend imm
-    registers[(int)dest] = val1 + val2;
+	if (recording) history_register(dest);
+    registers[(int)dest] = (int32_t)((uint32_t)val1 + (uint32_t)val2);
 	register_used[(int)dest] = 1;
 	register_used[(int)src1] = 1;
 	if (rtype) register_used[(int)src2] = 1;
-
-    arith_count++;
-    if (is_immediate)
-        itype_count++;
-    else
-        rtype_count++;
-
-    total_inst_count++;
 }
 
 
 void subfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
-	if(mode == DEBUG) printf(
+	if(mode == DEBUG) debug_log(
             "[DEBUG] subfunc called with dest=%" PRIi32
             ", src1=%" PRIi32
             ", src2=%" PRIi32
@@ -1082,23 +1992,16 @@ void subfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
 	if (!is_immediate) rtype = 1;
     int32_t val1 = registers[(int)src1];
     int32_t val2 = is_immediate ? (int16_t)src2 : registers[(int)src2];
-    registers[(int)dest] = val1 - val2;
+	if (recording) history_register(dest);
+    registers[(int)dest] = (int32_t)((uint32_t)val1 - (uint32_t)val2);
 	register_used[(int)dest] = 1;
 	register_used[(int)src1] = 1;
 	if (rtype) register_used[(int)src2] = 1;
-
-    arith_count++;
-    if (is_immediate)
-        itype_count++;
-    else
-        rtype_count++;
-
-    total_inst_count++;
 }
 
 
 void mulfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
-	if(mode == DEBUG) printf(
+	if(mode == DEBUG) debug_log(
             "[DEBUG] mulfunc called with dest=%" PRIi32
             ", src1=%" PRIi32
             ", src2=%" PRIi32
@@ -1113,23 +2016,16 @@ void mulfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
 	if (!is_immediate) rtype = 1;
 	int32_t val1 = registers[(int)src1];
     int32_t val2 = is_immediate ? (int16_t)src2 : registers[(int)src2];
-    registers[(int)dest] = val1 * val2;
+	if (recording) history_register(dest);
+    registers[(int)dest] = (int32_t)((uint32_t)val1 * (uint32_t)val2);
 	register_used[(int)dest] = 1;
 	register_used[(int)src1] = 1;
 	if (rtype) register_used[(int)src2] = 1;
-
-    arith_count++;
-    if (is_immediate)
-        itype_count++;
-    else
-        rtype_count++;
-
-    total_inst_count++;
 }
 
 
 void orfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
-	if(mode == DEBUG) printf(
+	if(mode == DEBUG) debug_log(
             "[DEBUG] orfunc called with dest=%" PRIi32
             ", src1=%" PRIi32
             ", src2=%" PRIi32
@@ -1144,23 +2040,16 @@ void orfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
 	if (!is_immediate) rtype = 1;
     int32_t val1 = registers[(int)src1];
     int32_t val2 = is_immediate ? (int16_t)src2 : registers[(int)src2];
+	if (recording) history_register(dest);
     registers[(int)dest] = val1 | val2;
 	register_used[(int)dest] = 1;
 	register_used[(int)src1] = 1;
 	if (rtype) register_used[(int)src2] = 1;
-
-    logic_count++;
-    if (is_immediate)
-        itype_count++;
-    else
-        rtype_count++;
-
-    total_inst_count++;
 }
 
 
 void andfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
-	if(mode == DEBUG) printf(
+	if(mode == DEBUG) debug_log(
             "[DEBUG] andfunc called with dest=%" PRIi32
             ", src1=%" PRIi32
             ", src2=%" PRIi32
@@ -1175,23 +2064,16 @@ void andfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
 	if (!is_immediate) rtype = 1;
     int32_t val1 = registers[src1];
     int32_t val2 = is_immediate ? (int16_t)src2 : registers[(int)src2];
+	if (recording) history_register(dest);
     registers[(int)dest] = val1 & val2;
 	register_used[(int)dest] = 1;
 	register_used[(int)src1] = 1;
 	if (rtype) register_used[(int)src2] = 1;
-
-    logic_count++;
-    if (is_immediate)
-        itype_count++;
-    else
-        rtype_count++;
-
-    total_inst_count++;
 }
 
 
 void xorfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
-	if(mode == DEBUG) printf(
+	if(mode == DEBUG) debug_log(
             "[DEBUG] xorfunc called with dest=%" PRIi32
             ", src1=%" PRIi32
             ", src2=%" PRIi32
@@ -1206,24 +2088,17 @@ void xorfunc(int32_t dest, int32_t src1, int32_t src2, bool is_immediate) {
 	if (!is_immediate) rtype = 1;
     int32_t val1 = registers[(int)src1];
     int32_t val2 = is_immediate ? (int16_t)src2 : registers[(int)src2];
+	if (recording) history_register(dest);
     registers[(int)dest] = val1 ^ val2;
 	register_used[(int)dest] = 1;
 	register_used[(int)src1] = 1;
 	if (rtype) register_used[(int)src2] = 1;
-
-    logic_count++;
-    if (is_immediate)
-        itype_count++;
-    else
-        rtype_count++;
-
-    total_inst_count++;
 }
 
 
 void ldwfunc(int32_t rt, int32_t rs, int32_t imm) {
 	
-	if(mode == DEBUG) printf(
+	if(mode == DEBUG) debug_log(
             "[DEBUG] ldwfunc called with rt=%" PRIi32
             ", rs=%" PRIi32
             ", imm=%" PRIi32 "\n",
@@ -1232,22 +2107,25 @@ void ldwfunc(int32_t rt, int32_t rs, int32_t imm) {
             imm
         );
 	
-    int32_t addr = registers[(int)rs] + (int16_t)imm;
+    int32_t addr = (int32_t)((uint32_t)registers[(int)rs] + (int16_t)imm);
+	if (mem_tracing) mem_trace_access(MEM_READ, addr);
+	if (reuse_analysis) reuse_access(addr);
 	/*
     if (addr % 4 != 0 || addr / 4 < 0 || addr / 4 >= MEMORY_SIZE) {
         printf("Memory load error: invalid address 0x%X\n", addr);
         exit(EXIT_FAILURE);
     }*/
 
-    registers[(int)rt] = memory[((int)addr % MEMORY_SIZE)];
+	// memory[] is shared by all cores; relaxed atomics keep it lock-free
+	if (recording) history_load(rt, MEMORY_INDEX(addr));
+	if (fuzzing) fuzz_access(MEMORY_INDEX(addr));
+    registers[(int)rt] = __atomic_load_n(&memory[MEMORY_INDEX(addr)], __ATOMIC_RELAXED);
 	
-	memory_used[((int)addr % MEMORY_SIZE)] = 1;
+	if (!__atomic_load_n(&memory_used[MEMORY_INDEX(addr)], __ATOMIC_RELAXED))
+		mark_dirty(MEMORY_INDEX(addr));
+	__atomic_store_n(&memory_used[MEMORY_INDEX(addr)], 1, __ATOMIC_RELAXED);
 	register_used[(int)rt] = 1;
 	register_used[(int)rs] = 1;
-	
-    memacc_count++;
-    itype_count++;
-    total_inst_count++;
 }
 
 
@@ -1255,7 +2133,7 @@ void stwfunc(int32_t rt, int32_t rs, int32_t imm) {
 	
 	
 		
-	if(mode == DEBUG) printf(
+	if(mode == DEBUG) debug_log(
             "[DEBUG] stwfunc called with rt=%" PRIi32
             ", rs=%" PRIi32
             ", imm=%" PRIi32 "\n",
@@ -1264,7 +2142,10 @@ void stwfunc(int32_t rt, int32_t rs, int32_t imm) {
             imm
         );
 	
-    int32_t addr = registers[(int)rs] + (int16_t)imm;
+    int32_t addr = (int32_t)((uint32_t)registers[(int)rs] + (int16_t)imm);
+	if (mem_tracing) mem_trace_access(MEM_WRITE, addr);
+	if (reuse_analysis) reuse_access(addr);
+	if (validating) validate_store(addr);
 	
 	/*
     if (addr % 4 != 0 || addr / 4 < 0 || addr / 4 >= MEMORY_SIZE) {
@@ -1272,21 +2153,28 @@ void stwfunc(int32_t rt, int32_t rs, int32_t imm) {
         exit(EXIT_FAILURE);
     }*/
 	
-	memory[((int)addr % MEMORY_SIZE)] = registers[(int)rt];
-	memory_used[((int)addr % MEMORY_SIZE)] = 1;
+	int w = MEMORY_INDEX(addr);
+	if (recording) history_store(w);
+	if (fuzzing) fuzz_access(w);
+	
+	// A store into the program leaves its decoded line stale, on every core
+	bool code_changed = (w < program_length && __atomic_load_n(&memory[w], __ATOMIC_RELAXED) != registers[(int)rt]);
+	
+	__atomic_store_n(&memory[w], registers[(int)rt], __ATOMIC_RELAXED);
+	if (code_changed)
+		mark_code_stale(w);
+	if (!__atomic_load_n(&memory_used[w], __ATOMIC_RELAXED))
+		mark_dirty(w);
+	__atomic_store_n(&memory_used[w], 1, __ATOMIC_RELAXED);
 	
 	register_used[(int)rt] = 1;
 	register_used[(int)rs] = 1;
-
-    memacc_count++;
-    itype_count++;
-    total_inst_count++;
 }
 
 
 void bzfunc(int32_t rs, int32_t imm) {
 	
-	if(mode == DEBUG) printf(
+	if(mode == DEBUG) debug_log(
             "[DEBUG] bzfunc called with rs=%d, imm=%d (signed offset=%d), "
             "reg[%d]=%d, pc_before=%d, pc_target=%d\n",
             rs, imm, (int16_t)imm,
@@ -1295,9 +2183,6 @@ void bzfunc(int32_t rs, int32_t imm) {
         );
 	
 	
-    cflow_count++;
-    itype_count++;
-    total_inst_count++;
 	register_used[(int)rs] = 1;
 
     if ((registers[(int)rs] == 0) && (successful_branch_limiter < successful_branch_limiter_count)) {
@@ -1311,7 +2196,7 @@ void bzfunc(int32_t rs, int32_t imm) {
 
 void beqfunc(int32_t rs, int32_t rt, int32_t imm) {
 	
-	if(mode == DEBUG) printf(
+	if(mode == DEBUG) debug_log(
             "[DEBUG] beqfunc called with rs=%d, rt=%d, imm=%d (signed offset=%d)\n"
             "        reg[%d]=%d, reg[%d]=%d\n"
             "        pc_before=%d, pc_target=%d\n",
@@ -1322,9 +2207,6 @@ void beqfunc(int32_t rs, int32_t rt, int32_t imm) {
         );
 	
 	
-    cflow_count++;
-    itype_count++;
-    total_inst_count++;
 	register_used[(int)rs] = 1;
 	register_used[(int)rt] = 1;
 
@@ -1338,13 +2220,11 @@ void beqfunc(int32_t rs, int32_t rt, int32_t imm) {
 
 
 void jrfunc(int32_t rs) {
-    cflow_count++;
-    itype_count++;
-    total_inst_count++;
-	was_control_flow = 1;
-	was_jrfunc_for_nopipe = 1;
 
+	// Past the branch limit a JR falls through like an untaken branch
 	if (successful_branch_limiter < successful_branch_limiter_count){
+		was_control_flow = 1;
+		was_jrfunc_for_nopipe = 1;
 		pc = ((int16_t)registers[(int)rs]/4);  // Assume PC holds instruction index, not byte address
 		register_used[(int)rs] = 1;
 		successful_branch_limiter++;
@@ -1354,12 +2234,5 @@ void jrfunc(int32_t rs) {
 
 void haltfunc() {
 	
-	cflow_count++;
-	itype_count++;
-	total_inst_count++;
-	
-	// Close the file
-    fclose(file);
-	
 	halt_executed = true;
 }
\ No newline at end of file
@@ -18,12 +18,21 @@
 #ifndef _MIPS_H
 #define _MIPS_H
 
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+
 
 // MIPS system specifications
 #define ADDRESS_BITS 32
 #define NUM_REGISTERS 32
 #define MEMORY_SIZE 1024
 
+// Word of memory[] an LDW/STW byte address refers to (negative addresses
+// wrap). Code and data share it: line i of the image is word i
+#define MEMORY_INDEX(addr) (((((int)(addr) >> 2) % MEMORY_SIZE) + MEMORY_SIZE) % MEMORY_SIZE)
+
 
 // Mode values
 #define DEBUG 1
@@ -75,13 +84,253 @@
 
 
 
-typedef struct decoded_line_information decodedLine;
+// Multi-core settings
+#define MAX_CORES 64
+#define DEFAULT_QUANTUM 1000            // cycles a core runs between synchronisations
+
+// Storage class for state that every simulated core keeps a copy of.
+// Each core runs on its own host thread, so thread-local storage gives
+// every core its own registers, PC, pipeline and statistics while the
+// plain globals (memory[], memory_used[]) stay shared between them.
+#define SIM_LOCAL _Thread_local
+
+
+
+// struct to hold decoded line information
+typedef struct decoded_line_information {
+	int32_t instruction;
+	int32_t dest_register;
+	int32_t first_reg_val;
+	int32_t second_reg_val;
+	int32_t immediate;
+	int pipe_stage;
+	int line_index;         // program_store[] slot the line was loaded from
+} decodedLine;
+
+
+// Instruction formats
+#define FORMAT_NONE 0           // NOP, EOP
+#define FORMAT_R 1              // rd = rs op rt
+#define FORMAT_I 2              // rt, rs and a 16 bit immediate (also JR, HALT)
+
+// Instruction classes for the instruction mix statistics
+#define CLASS_NONE 0
+#define CLASS_ARITH 1
+#define CLASS_LOGIC 2
+#define CLASS_MEMORY 3
+#define CLASS_CONTROL 4
+#define INSTRUCTION_CLASSES 5
+
+// decodedLine fields the loader fills from an encoding
+#define FIELD_RD_DEST 0x01      // dest_register = rd
+#define FIELD_RT_DEST 0x02      // dest_register = rt
+#define FIELD_RS 0x04           // first_reg_val = rs
+#define FIELD_RT 0x08           // second_reg_val = rt
+#define FIELD_IMM 0x10          // immediate
+
+// Registers a line really reads and writes (STW reads dest_register)
+#define READS_FIRST 0x01
+#define READS_SECOND 0x02
+#define READS_DEST 0x04
+#define WRITES_DEST 0x08
+
+// Opcode table size: instruction values are 6 bit opcodes, EOP and NOP
+#define OPCODES 256
+
+
+// struct to hold everything the simulator knows about one opcode
+typedef struct opcode_information {
+	const char *name;               // NULL if the opcode isn't one
+	int format;
+	int class;
+	int fields;                     // FIELD_* the loader fills
+	int usage;                      // READS_* / WRITES_DEST, for hazards and watchpoints
+	int latency;                    // EX cycles
+	const char *trace;              // DEBUG message when executed
+	void (*execute)(const decodedLine *line);   // NULL for NOP, EOP and unknown opcodes
+} opcodeInfo;
+
+extern const opcodeInfo opcode_table[OPCODES];
+
+// Table entry for an instruction value
+#define OPCODE_INFO(instruction) (&opcode_table[(uint8_t)(instruction)])
+
+
+// struct to hold pipline informatoin
+typedef struct pipe_main {
+	decodedLine pipe1;
+	decodedLine pipe2;
+	decodedLine pipe3;
+	decodedLine pipe4;
+	decodedLine pipe5;
+} pipeline;
+
+
+// What the CPI stack charges a NO_FWD/FWD cycle to
+#define CPI_BASE 0              // a line executed in EX
+#define CPI_RAW_FWD 1           // RAW stall with forwarding (FWD)
+#define CPI_RAW_NO_FWD 2        // RAW stall without forwarding (NO_FWD)
+#define CPI_LOAD_USE 3          // RAW stall waiting on an LDW
+#define CPI_CONTROL 4           // line thrown out by a taken branch
+#define CPI_MEMORY 5            // memory stall (no memory latency is modelled yet)
+#define CPI_FILL 6              // no line has reached EX since the pipeline started
+#define CPI_DRAIN 7             // emptying after the last fetch or a HALT
+#define CPI_FRONT_END 8         // EX empty with no stall or flush behind it
+#define CPI_CAUSES 9
+#define CPI_PENDING 16          // most bubbles on their way to EX at once
+
+
+// struct to hold the cycles of a NO_FWD/FWD run split by what they were
+// spent on. Every counted cycle goes to exactly one cause
+typedef struct cpi_stack {
+	int cycles[CPI_CAUSES];
+	int8_t pending[CPI_PENDING];    // causes of the bubbles not yet in EX, oldest first
+	int pending_count;
+	int last_cause;                 // cause the last cycle was charged to
+	bool filled;                    // a line has reached EX since the pipeline started
+} cpiStack;
+
+
+
+// Dirty-word bitmaps: bit w%64 of words[w/64] is set once memory word w
+// is used, and bit p%64 of pages[p/64] once a word of page p (words 64p
+// to 64p+63) is
+#define DIRTY_PAGES ((MEMORY_SIZE + 63) / 64)
+#define DIRTY_PAGE_MASKS ((DIRTY_PAGES + 63) / 64)
+
+typedef struct dirty_map {
+	uint64_t words[DIRTY_PAGES];
+	uint64_t pages[DIRTY_PAGE_MASKS];
+} dirtyMap;
+
+
+
+// Simulator state shared with the other source files
+extern SIM_LOCAL int32_t registers[NUM_REGISTERS];
+extern SIM_LOCAL bool register_used[NUM_REGISTERS];
+extern int32_t shared_memory[MEMORY_SIZE];
+extern bool shared_memory_used[MEMORY_SIZE];
+extern SIM_LOCAL int32_t *memory;           // MEMORY_SIZE words
+extern SIM_LOCAL bool *memory_used;
+extern dirtyMap shared_dirty_map;
+extern SIM_LOCAL dirtyMap *dirty_map;       // memory_used's bitmaps
+
+extern SIM_LOCAL int rtype_count;
+extern SIM_LOCAL int itype_count;
+extern SIM_LOCAL int arith_count;
+extern SIM_LOCAL int logic_count;
+extern SIM_LOCAL int memacc_count;
+extern SIM_LOCAL int cflow_count;
+extern SIM_LOCAL int opcode_count[OPCODES];
+extern SIM_LOCAL int total_inst_count;
+extern SIM_LOCAL int total_stalls;
+extern SIM_LOCAL int hazard_count;
+extern SIM_LOCAL cpiStack cpi;
+extern bool cpi_report;
+
+extern int mode;
+extern SIM_LOCAL int functional_mode;
+
+extern SIM_LOCAL decodedLine program_store[MEMORY_SIZE+1];
+extern SIM_LOCAL uint32_t rawHex_array[MEMORY_SIZE];
+extern SIM_LOCAL int program_length;
+extern SIM_LOCAL bool code_stale[MEMORY_SIZE+1];   // stored to since decoded
+extern int successful_branch_limiter_count;
+
+extern SIM_LOCAL int pc;
+extern SIM_LOCAL int cycle_counter;
+extern SIM_LOCAL int sync_cycle;
+extern SIM_LOCAL int inst_event_count;
+extern SIM_LOCAL int cycle_event_count;
+extern SIM_LOCAL int last_executed_line;
+extern SIM_LOCAL bool was_control_flow;
+extern SIM_LOCAL bool was_jrfunc_for_nopipe;
+extern SIM_LOCAL bool rtype;
+extern SIM_LOCAL bool halt_executed;
+extern SIM_LOCAL bool ready_to_end;
+extern SIM_LOCAL bool end_of_fetch;
+
+extern SIM_LOCAL pipeline pipe;
+extern SIM_LOCAL decodedLine newinst;
+extern SIM_LOCAL bool newInstAdded;
+extern SIM_LOCAL bool hazard;
+extern SIM_LOCAL int successful_branch_limiter;
+
+
+
+// Reads a trace file into program_store and closes it.
+// Returns the number of lines read, or -1 if the file is malformed
+int load_program(FILE *fp);
+
+// Loads 'count' instruction words as the program, as load_program() would
+// a trace file with one word per line. Returns -1 if they don't fit
+int load_words(const uint32_t *words, int count);
+
+// Decodes one instruction word into line, as line 'line_index'
+void decode_word(decodedLine *line, int line_index, uint32_t word);
+
+// Copies the loaded image into memory[], code and data alike
+void load_memory_image();
+
+// Marks every line to be decoded again from memory[] when next fetched
+// (after memory[] is replaced wholesale, e.g. by a checkpoint)
+void invalidate_code();
+
+// Runs the loaded program in the current functional mode, starting
+// at line 'entry', until it halts or runs off the end of the program
+void run_simulation(int entry);
+
+// Non-pipelined execution, one instruction every 5 cycles
+void run_nopipe(int entry);
+
+// 5-stage pipelined execution (NO_FWD or FWD)
+void run_pipeline();
+
+// Empties the pipeline so the next run_pipeline() starts fetching at 'entry'
+void reset_pipeline(int entry);
+
+// Clears the calling thread's registers, memory, program, counters and
+// pipeline, ready to load and run another program
+void reset_simulation();
+
+// Clears the calling thread's registers, counters and pipeline, leaving
+// memory and the program as they are
+void reset_core_state();
+
+// Executes program_store[pc] without the pipeline or cycles, carrying on
+// after control flow where run_nopipe() and the pipeline do. Returns false
+// once the program has ended
+bool functional_step();
+
+// Line the program carries on at after the last line opcode_master()
+// executed, for restarting an emptied pipeline
+int next_line();
+
+// Runs inst_event() once total_inst_count reaches 'count'
+void schedule_inst_event(int count);
+
+// Called when total_inst_count reaches inst_event_count
+void inst_event();
+
+// Queues the cause of a bubble a stall or flush just put in the pipeline
+void cpi_bubble(int cause);
+
+// Charges the cycle just counted to the CPI stack: a base cycle if a line
+// is in EX, otherwise the cause of the bubble that is
+void cpi_cycle();
+
+// Throws out every line behind 'line' (the one in EX) after a taken
+// branch, a HALT or a store over a fetched line
+void flush_fetch(decodedLine *slots[5], const decodedLine *line);
 
-// Not sure if this is needed anymore
-typedef struct pipe_main pipeline;
+// Runs cycle_event() once cycle_counter reaches 'cycle'
+void schedule_cycle_event(int cycle);
 
-// Switch statement to complete the appropriate
-// function based on the opcode
+// Called when cycle_counter reaches cycle_event_count
+void cycle_event();
+
+// Runs a line through its opcode_table[] handler and counts it.
+// Returns true if it changed the pc
 bool opcode_master(decodedLine line);
 
 // true = (wr destination == rd source)
@@ -91,6 +340,20 @@ bool findHazard(const decodedLine *wr, const decodedLine *rd);
 // Prints the used registers, used memory, and instruction stats
 void print_stats();
 
+// Works out the R/I-type and class counts from opcode_count[]
+void tally_instruction_mix();
+
+// The three sections of print_stats()
+void print_registers();
+void print_memory();
+void print_counts();
+
+// Prints where a NO_FWD/FWD run's cycles went (--cpi-stack)
+void print_cpi_stack();
+
+// Mnemonic of an opcode, "???" if it isn't one
+const char *opcode_name(int opcode);
+
 // Runs print_stats() and ends the program
 void end_program();
 
@@ -137,5 +400,506 @@ int32_t StringToHex(char *hex_string);
 
 
 
+// Multi-core simulation (multicore.c)
+
+// Runs core_count cores, each on its own host thread, over the given
+// trace files (a trailing "@N" on a file name starts that core at line N).
+// Cores beyond trace_count reuse the last trace file.
+int run_multicore(const char **trace_files, int trace_count, int core_count, int quantum, bool deterministic);
+
+// Marks program word w stale in every core's decoded copy (only this
+// thread's when no multi-core run is going)
+void mark_code_stale(int w);
+
+// Called by a core when its cycle_counter reaches sync_cycle
+void core_sync();
+
+
+
+
+// Sampled simulation (sampling.c)
+
+// Sampling defaults
+#define DEFAULT_SAMPLE_INTERVAL 1000
+#define DEFAULT_SAMPLE_WARMUP 20
+#define DEFAULT_SAMPLE_WINDOW 100
+
+// Sampling policies
+#define SAMPLE_PERIODIC 0
+#define SAMPLE_RANDOM 1
+
+// struct to hold the sampling settings
+typedef struct sampling_config {
+	int policy;
+	int interval;           // instructions fast-forwarded between windows
+	int warmup;             // detailed instructions run before measuring
+	int window;             // detailed instructions measured per window
+	unsigned seed;          // SAMPLE_RANDOM only
+} samplingConfig;
+
+extern bool sampling;
+
+// Prints the sampling windows and the confidence of the cycle estimate
+void print_sample_stats();
+
+// Runs the loaded program alternating functional_step() fast-forward and
+// detailed pipeline windows, then prints statistics with extrapolated
+// cycle counts
+void run_sampled(const samplingConfig *config);
+
+// Instruction-count hook for the sampler
+void sample_inst_event();
+
+
+
+// Machine-readable statistics (stats.c)
+
+#define STATS_TEXT 0
+#define STATS_JSON 1
+#define STATS_CSV 2
+
+#define DEFAULT_SERIES_CSV "stats_series.csv"
+#define DEFAULT_SERIES_JSON "stats_series.jsonl"
+
+// struct to hold the --stats options
+typedef struct stats_config {
+	int format;                 // STATS_TEXT, STATS_JSON or STATS_CSV
+	const char *path;           // final stats file, NULL for stdout
+	int interval;               // cycles per time series row, 0 for none
+	const char *series_path;    // time series file, NULL for the default
+} statsConfig;
+
+extern int stats_format;
+
+// Opens the time series (if any) and schedules its first row.
+// Returns false if the series file can't be opened
+bool start_stats(const statsConfig *stats_config);
+
+// Writes a time series row if one is due
+void stats_cycle_event();
+
+// Finishes the time series and writes the final stats.
+// Returns false if either file couldn't be written
+bool write_stats();
+
+// Writes the calling thread's final stats to fp as one line of JSON, with
+// no newline at the end (a server job's result)
+void write_stats_record(FILE *fp);
+
+// false if the machine-readable stats are taking the place of the text
+// reports on stdout
+bool text_report();
+
+
+
+// Pipeline trace (pipetrace.c)
+
+extern bool pipe_tracing;
+
+// Starts writing the Konata pipeline trace to 'path'.
+// Returns false if it can't be opened
+bool start_pipe_trace(const char *path);
+
+// Pipeline trace hooks, each called behind 'if (pipe_tracing)':
+// a cycle was counted, 'reader' stalled on 'writer', 'slot' was flushed
+void trace_cycle();
+void trace_stall(const decodedLine *writer, const decodedLine *reader);
+void trace_flush(const decodedLine *slot);
+
+// Retires what is left in the pipeline and closes the trace
+void finish_pipe_trace();
+
+
+
+// Memory access trace (memtrace.c)
+
+#define MEM_READ 0
+#define MEM_WRITE 1
+
+extern bool mem_tracing;
+
+// Starts writing every LDW/STW to the binary trace at 'binary_path' and/or
+// the Dinero trace at 'dinero_path' (either may be NULL).
+// Returns false if one can't be opened
+bool start_mem_trace(const char *binary_path, const char *dinero_path);
+
+// Records an access, called behind 'if (mem_tracing)' with the effective
+// address before it wraps into memory[]
+void mem_trace_access(int type, int32_t address);
+
+// Writes out what is still buffered and closes the traces
+void finish_mem_trace();
+
+
+
+// Reuse distance and working set analysis (reuse.c)
+
+#define DEFAULT_REUSE_WINDOW 1000       // instructions per working set window
+
+extern bool reuse_analysis;
+
+// Starts measuring reuse distances, and working sets over windows of
+// 'window' instructions
+void start_reuse_analysis(int window);
+
+// Reuse analysis hooks: an LDW/STW address (behind 'if (reuse_analysis)')
+// and the instruction event that closes working set windows
+void reuse_access(int32_t address);
+void reuse_inst_event();
+
+// Prints the reuse distance histogram and working set sizes
+void print_reuse_stats();
+
+
+
+// Dataflow-limit ILP study (ilp.c)
+
+extern bool ilp_analysis;
+
+// Starts tracking the critical path, with the latencies in 'latencies'
+// ("alu:N,mul:N,load:N,store:N,branch:N", any subset; NULL for all 1).
+// Returns false if it can't be parsed
+bool start_ilp_analysis(const char *latencies);
+
+// Adds a line to the critical path, called behind 'if (ilp_analysis)'
+// before opcode_master() executes it
+void ilp_execute(const decodedLine *line);
+
+// Prints the dataflow-limit IPC next to this run's IPC
+void print_ilp_stats();
+
+
+
+// DEBUG event log (debuglog.c)
+
+#define DEBUG_LOG_ARGS 10
+
+// Logs a DEBUG message: a printf format and up to DEBUG_LOG_ARGS int arguments
+#define debug_log(format, ...) debug_log_record(format, (const int32_t[DEBUG_LOG_ARGS]){__VA_ARGS__})
+
+void debug_log_record(const char *format, const int32_t *args);
+
+// Starts the thread that prints logged messages. Until it's started (or
+// if it can't be), messages are printed as they are logged
+bool start_debug_log();
+
+// Waits until every logged message has been printed
+void flush_debug_log();
+
+
+
+// Trace windows (tracewindow.c)
+
+// Trigger kinds
+#define TRIGGER_NONE 0
+#define TRIGGER_CYCLE 1
+#define TRIGGER_INST 2
+#define TRIGGER_PC 3
+#define TRIGGER_REG 4
+#define TRIGGER_MEM 5
+
+// Comparisons for register/memory triggers
+#define CMP_EQ 0
+#define CMP_NE 1
+#define CMP_LT 2
+#define CMP_LE 3
+#define CMP_GT 4
+#define CMP_GE 5
+
+// struct to hold one trigger (cycle:N, inst:N, pc:LINE, R5==3, mem[400]>=1)
+typedef struct trace_trigger {
+	int kind;
+	int target;             // cycle, instruction count, line index, register or memory word
+	int compare;
+	int32_t value;
+} traceTrigger;
+
+extern bool window_checking;
+
+// Reads a trigger spec into 't' (TRIGGER_NONE if 'spec' is NULL).
+// Returns false if it can't be parsed
+bool parse_trigger(const char *spec, traceTrigger *t);
+
+// Whether a pc, register or memory trigger holds with 'line' about to
+// execute
+bool trigger_holds(const traceTrigger *t, int line);
+
+// Switches a DEBUG run to NORMAL until the 'start' trigger and back to
+// NORMAL at the 'stop' trigger (either may be NULL). Returns false if
+// either can't be parsed
+bool start_trace_window(const char *start, const char *stop);
+
+// Trace window hooks: the instruction and cycle events, and (behind
+// 'if (window_checking)') every line opcode_master() executes
+void trace_window_inst_event();
+void trace_window_cycle_event();
+void trace_window_step(int line);
+
+
+
+// Hotspot profiling (profile.c)
+
+extern bool profiling;
+
+// Turns the profiler on; the CSV goes to 'path' if it isn't NULL
+void start_profiling(const char *path);
+
+// Profiler hooks, each called behind 'if (profiling)'
+void profile_executed(int line);
+void profile_stall(const decodedLine *writer, const decodedLine *reader);
+void profile_flush(const decodedLine *line);
+
+// Prints the hottest lines, most executed and stalled first
+void print_profile();
+
+// Writes every line's counts as CSV to 'path' (or the start_profiling()
+// path if NULL). Returns false on failure
+bool write_profile(const char *path);
+
+
+
+// Parallel interval slicing (slicing.c)
+
+// Slicing defaults
+#define DEFAULT_SLICE_LENGTH 1000000
+#define DEFAULT_SLICE_WARMUP 100
+#define MAX_SLICE_THREADS 64
+
+// struct to hold the slicing settings
+typedef struct slice_config {
+	int length;             // instructions per interval
+	int warmup;             // detailed instructions run before each interval
+	int threads;            // host threads, 0 for one per CPU
+} sliceConfig;
+
+extern bool slicing;
+
+// Runs the loaded program functionally, then times each interval of it
+// through the pipeline on its own thread and adds up the intervals
+void run_sliced(const char *trace_file, const sliceConfig *config);
+
+// Prints the intervals, the boundaries that didn't match and the passes' times
+void print_slice_stats();
+
+// Instruction-count hook for interval slicing
+void slice_inst_event();
+
+
+
+// Checkpoints (checkpoint.c)
+
+// Checkpoint file format
+#define CHECKPOINT_MAGIC "MIPSCKPT"
+#define CHECKPOINT_VERSION 4
+
+// Writes the whole machine state to 'path'. Returns false on failure
+bool save_checkpoint(const char *path);
+
+// Loads a checkpoint written by save_checkpoint() for the loaded program.
+// Returns false (after saying why) if it can't be used
+bool restore_checkpoint(const char *path);
+
+// Size of the state a checkpoint holds, and copies of it in memory
+// (for the calling thread's simulator)
+size_t state_size();
+void capture_state(void *buf);
+void apply_state(const void *buf);
+
+// The same without memory and its used flags, for snapshots that keep
+// memory's history some other way (history.c)
+size_t core_state_size();
+void capture_core_state(void *buf);
+void apply_core_state(const void *buf);
+
+// Carries on a restored run in the current functional mode
+void resume_simulation();
+
+// Set by the SIGUSR1 handler; the run loops poll it and call inst_event()
+extern volatile sig_atomic_t checkpoint_signalled;
+
+// Writes a checkpoint to 'path' once total_inst_count reaches 'at'
+// (never if 'at' < 0) and whenever the process gets SIGUSR1
+void start_checkpoints(const char *path, int at);
+
+// Instruction-count hook for checkpoints
+void checkpoint_inst_event();
+
+
+
+// SIMD lockstep execution (lockstep.c)
+
+// Runs every trace file (plus those named in lane_list, if given) as one
+// lane of a struct-of-arrays NO_PIPE engine, executing converged ALU
+// instructions as vector operations across lanes, then prints each lane
+int run_lockstep(const char **trace_files, int trace_count, const char *lane_list);
+
+
+
+// Differential validation (validate.c)
+
+#define DEFAULT_VALIDATE_INTERVAL 1000
+
+extern bool validating;
+
+// Runs every trace file through the reference (functional_step()) and the
+// functional mode's engine side by side, comparing a rolling hash of their
+// state every 'interval' instructions, and prints the first divergent
+// instruction of each file that differs. Returns EXIT_FAILURE if any did
+int run_validation(const char **trace_files, int trace_count, int interval);
+
+// Validation hooks, each called behind 'if (validating)': opcode_master()
+// executed 'line', STW stored to 'address'
+void validate_execute(int line);
+void validate_store(int32_t address);
+
+// Instruction-count hook for validation
+void validate_inst_event();
+
+
+
+// Simulation server (server.c)
+
+#define DEFAULT_SERVER_CACHE 64
+#define MAX_SERVER_WORKERS 64
+
+extern bool serving;
+
+// Listens on the UNIX domain socket at 'path' and runs the jobs sent to it
+// on 'workers' threads (0 = one per CPU), keeping the last 'cache_size'
+// decoded images. Only returns if the socket can't be set up
+int run_server(const char *path, int workers, int cache_size);
+
+// Instruction-count and cycle hooks for a job's budgets
+void server_inst_event();
+void server_cycle_event();
+
+
+
+// Loop fast-forwarding (fastloop.c)
+
+extern bool fast_loops;
+extern SIM_LOCAL bool fast_loops_held;     // no skipping: lines are being stepped one at a time
+
+void start_fast_loops();
+
+// Forgets the loop being watched, for a pipeline started afresh
+void reset_fast_loops();
+
+// Called by opcode_master() after every line it executes
+void fast_loop_executed(const decodedLine *line);
+
+void print_fast_loop_stats();
+
+
+
+// Compressed trace files (compressed.c)
+
+// Opens a trace file for load_program(), inflating it on another thread
+// if it is gzip-compressed. Returns NULL (with errno set) if it can't
+FILE *open_image(const char *path);
+
+
+
+// Reverse execution (history.c)
+
+#define DEFAULT_HISTORY_ENTRIES (1 << 20)   // undo log entries kept (one to three per instruction)
+#define DEFAULT_SNAPSHOT_INTERVAL 10000     // instructions between snapshots
+
+extern bool recording;
+
+// Keeps an undo log of the last 'entries' register and memory writes and
+// a snapshot every 'interval' instructions, to go back to 'target' once
+// the run ends: inst:N, cycle:N, back:N (N instructions before the end),
+// or the last time pc:LINE, R5==3 or mem[400]>=1 held. Returns false if
+// 'target' can't be parsed or the history can't be allocated
+bool start_history(const char *target, int entries, int interval);
+
+// Undo log hooks, called (behind 'if (recording)') as each instruction
+// starts and before each write it makes
+void history_step(const decodedLine *line);
+void history_register(int32_t r);
+void history_load(int32_t rt, int w);
+void history_store(int w);
+
+// History hooks: the instruction and cycle events
+void history_inst_event();
+void history_cycle_event();
+
+// Goes back to the target and prints the state there
+void rewind_history();
+
+
+
+// Breakpoints and watchpoints (watch.c)
+
+extern bool watching;
+
+// Sets a breakpoint on each line number in 'breaks' and a watchpoint for
+// each of 'specs' (R5 or mem[400] for writes, R5:read or mem[400]:read
+// for reads, R5==3 or mem[400]>=1 for a value condition). A hit prints
+// the state and carries on if 'carry_on', else ends the run there.
+// Returns false if one can't be parsed
+bool start_watches(const char **breaks, int break_count, const char **specs, int spec_count, bool carry_on);
+
+// Called (behind 'if (watching)') by opcode_master() just before and just
+// after each instruction executes
+void watch_step(const decodedLine *line);
+void watch_executed(const decodedLine *line);
+
+void print_watch_stats();
+
+
+
+// Dirty-word bitmaps and memory deltas (dirtymap.c)
+
+#define DELTA_MAGIC "MIPSDLTA"
+#define DELTA_VERSION 1
+
+extern bool delta_dump;
+
+// Marks memory word w used in dirty_map, called before its memory_used
+// flag is first set
+void mark_dirty(int w);
+
+// Empties dirty_map, along with memory_used
+void clear_dirty_map();
+
+// Builds dirty_map again from memory_used, after it is replaced wholesale
+void rebuild_dirty_map();
+
+// First used memory word at or after w, -1 if there are no more:
+// for (w = next_used_word(0); w >= 0; w = next_used_word(w + 1))
+int next_used_word(int w);
+
+// Writes the memory words that differ from the loaded image to 'path'
+// once the run ends
+void start_delta(const char *path);
+
+// Writes the delta. Returns false if it can't be written
+bool write_delta();
+
+
+
+// Fuzzing harness (fuzz.c)
+
+#ifndef FUZZ_MAX_INSTS
+#define FUZZ_MAX_INSTS 100              // instructions each mode runs an input for
+#endif
+
+extern bool fuzzing;
+
+// libFuzzer entry point: runs 'data' as an image of raw instruction words
+// (host byte order, a partial last word ignored) through the reference and
+// every functional mode, and aborts if a mode ends in a different state
+// from the reference
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+// Fuzzing hooks: the instruction event that ends a run at its budget, and
+// (behind 'if (fuzzing)') every memory word a LDW/STW touches
+void fuzz_inst_event();
+void fuzz_access(int w);
+
+
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,413 @@
+/**
+ * multicore.c - Multi-core extension for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Every simulated core is a full copy of the single-core simulator
+ * (registers, PC, pipeline and statistics) running on its own host thread.
+ * The SIM_LOCAL state in mips.c is thread-local, so the cores never see
+ * each other's copies. All cores share memory[] and memory_used[], which
+ * LDW/STW access with relaxed atomics, so the memory path takes no lock.
+ * Every core runs the same image, which memory[] starts out holding; each
+ * core may start at its own entry line. A store that changes a program
+ * word marks that line stale in every core's decoded copy, and no core
+ * starts running until every core has its copy.
+ *
+ *
+ * SYNCHRONISATION:
+ *
+ *				DEFAULT:		All live cores run a quantum of cycles
+ *								concurrently, then wait for each other
+ *								at a barrier.
+ *
+ *				DETERMINISTIC:	The cores take turns in core order, each
+ *								running one quantum while the others wait,
+ *								so every run interleaves memory accesses
+ *								the same way.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "mips.h"
+
+
+// struct to hold the per-core run information
+typedef struct core_information {
+	int id;
+	char trace_file[FILENAME_MAX];
+	int entry;
+	bool loaded;
+	pthread_t thread;
+} coreInfo;
+
+static coreInfo cores[MAX_CORES];
+static int num_cores;
+static int core_quantum;
+static int core_mode;                 // functional mode, copied into each core's thread
+static bool core_deterministic;
+
+// Which core this host thread is simulating
+static SIM_LOCAL int core_id;
+
+// Each core's code_stale[]. A core thread lives until every core has
+// finished, so a store on one core can always reach the others
+static bool *core_code_stale[MAX_CORES];
+
+// Synchronisation state, all protected by core_lock
+static pthread_mutex_t core_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t core_cond = PTHREAD_COND_INITIALIZER;
+static bool core_live[MAX_CORES];
+static int live_cores;
+static int barrier_arrived;
+static unsigned barrier_generation;
+static int turn;
+static int started_cores;
+static int finished_cores;
+static int report_turn;
+
+// Aggregate statistics, summed as each core reports
+static long long agg_inst_count = 0;
+static long long agg_rtype_count = 0;
+static long long agg_itype_count = 0;
+static long long agg_arith_count = 0;
+static long long agg_logic_count = 0;
+static long long agg_memacc_count = 0;
+static long long agg_cflow_count = 0;
+static long long agg_hazard_count = 0;
+static long long agg_stalls = 0;
+static long long agg_core_cycles = 0;
+static int max_cycles = 0;
+
+
+
+
+// Pass the turn to the next live core after the current one.
+// Caller holds core_lock.
+static void next_turn() {
+	for (int i = 1; i <= num_cores; i++) {
+		int candidate = (turn + i) % num_cores;
+		if (core_live[candidate]) {
+			turn = candidate;
+			break;
+		}
+	}
+	pthread_cond_broadcast(&core_cond);
+}
+
+
+// Release the barrier if every live core has arrived.
+// Caller holds core_lock.
+static void check_barrier() {
+	if (barrier_arrived > 0 && barrier_arrived >= live_cores) {
+		barrier_arrived = 0;
+		barrier_generation++;
+		pthread_cond_broadcast(&core_cond);
+	}
+}
+
+
+// Deterministic mode: block until it is this core's turn to run
+static void wait_for_turn() {
+	while (turn != core_id)
+		pthread_cond_wait(&core_cond, &core_lock);
+}
+
+
+void core_sync() {
+
+	pthread_mutex_lock(&core_lock);
+
+	if (core_deterministic) {
+		next_turn();
+		wait_for_turn();
+	}
+
+	else {
+		unsigned generation = barrier_generation;
+		barrier_arrived++;
+		check_barrier();
+		while (generation == barrier_generation)
+			pthread_cond_wait(&core_cond, &core_lock);
+	}
+
+	pthread_mutex_unlock(&core_lock);
+
+	sync_cycle += core_quantum;
+}
+
+
+// Wait until every core has loaded its image and published its
+// code_stale[], so no core's store to the program can miss another's copy
+static void core_start() {
+
+	pthread_mutex_lock(&core_lock);
+
+	started_cores++;
+	pthread_cond_broadcast(&core_cond);
+	while (started_cores < num_cores)
+		pthread_cond_wait(&core_cond, &core_lock);
+
+	pthread_mutex_unlock(&core_lock);
+}
+
+
+// Take a finished core out of the synchronisation so the others
+// don't wait on it
+static void core_leave() {
+
+	pthread_mutex_lock(&core_lock);
+
+	core_live[core_id] = false;
+	live_cores--;
+	finished_cores++;
+
+	if (core_deterministic) {
+		if (turn == core_id)
+			next_turn();
+	}
+	else
+		check_barrier();
+
+	pthread_cond_broadcast(&core_cond);
+	pthread_mutex_unlock(&core_lock);
+}
+
+
+// Once every core is done, print this core's registers and statistics
+// in core order and add them to the aggregate
+static void core_report(const coreInfo *core) {
+
+	pthread_mutex_lock(&core_lock);
+
+	while (finished_cores < num_cores || report_turn != core_id)
+		pthread_cond_wait(&core_cond, &core_lock);
+
+	flush_debug_log();
+	printf("\n\n\n################################\n");
+	printf(" Core %d: %s (entry line %d)\n", core->id, core->trace_file, core->entry);
+	printf("################################\n");
+
+	if (core->loaded) {
+		print_registers();
+		print_counts();
+		if (cpi_report)
+			print_cpi_stack();
+
+		agg_inst_count += total_inst_count;
+		agg_rtype_count += rtype_count;
+		agg_itype_count += itype_count;
+		agg_arith_count += arith_count;
+		agg_logic_count += logic_count;
+		agg_memacc_count += memacc_count;
+		agg_cflow_count += cflow_count;
+		agg_hazard_count += hazard_count;
+		agg_stalls += total_stalls;
+		agg_core_cycles += cycle_counter;
+		if (cycle_counter > max_cycles)
+			max_cycles = cycle_counter;
+	}
+	else
+		printf("Trace file could not be loaded.\n");
+
+	report_turn++;
+	pthread_cond_broadcast(&core_cond);
+	pthread_mutex_unlock(&core_lock);
+}
+
+
+// A store changed program word w: every core decodes the line again
+// before it next runs it
+void mark_code_stale(int w) {
+
+	if (num_cores <= 1) {
+		code_stale[w] = true;
+		return;
+	}
+
+	for (int i = 0; i < num_cores; i++) {
+		if (core_code_stale[i] != NULL)
+			__atomic_store_n(&core_code_stale[i][w], true, __ATOMIC_RELEASE);
+	}
+}
+
+
+// Loads a trace file into this thread's program store. Returns its
+// line count, or -1 when it cannot be opened or read
+static int load_core_image(const char *trace_file) {
+	FILE *fp = open_image(trace_file);
+
+	if (fp == NULL) {
+		if (mode == DEBUG)
+			perror("Error opening trace file");
+		return -1;
+	}
+	return load_program(fp);
+}
+
+
+static void *core_main(void *arg) {
+	coreInfo *core = (coreInfo *)arg;
+	int line_count;
+
+	core_id = core->id;
+	functional_mode = core_mode;
+	sync_cycle = core_quantum;
+	schedule_cycle_event(sync_cycle);
+
+	line_count = load_core_image(core->trace_file);
+	__atomic_store_n(&core_code_stale[core_id], code_stale, __ATOMIC_RELEASE);
+	core_start();
+
+	if (line_count >= 0) {
+		core->loaded = true;
+
+		if (core->entry < 0 || core->entry > line_count) {
+			printf("\nCore %d: entry line %d is outside %s, starting at line 0.\n", core->id, core->entry, core->trace_file);
+			core->entry = 0;
+		}
+
+		if (core_deterministic) {
+			pthread_mutex_lock(&core_lock);
+			wait_for_turn();
+			pthread_mutex_unlock(&core_lock);
+		}
+
+		run_simulation(core->entry);
+
+		if(!ready_to_end && mode == DEBUG) debug_log("Core %d: No HALT instruction found- ending program\n", core->id);
+	}
+
+	core_leave();
+	core_report(core);
+
+	return NULL;
+}
+
+
+
+
+int run_multicore(const char **trace_files, int trace_count, int core_count, int quantum, bool deterministic) {
+	static uint32_t image[MEMORY_SIZE];
+	int image_length;
+
+	if (core_count > MAX_CORES) {
+		printf("\nToo many cores, limiting to %d.\n", MAX_CORES);
+		core_count = MAX_CORES;
+	}
+
+	num_cores = core_count;
+	core_quantum = (quantum > 0) ? quantum : DEFAULT_QUANTUM;
+	core_deterministic = deterministic;
+	live_cores = core_count;
+
+	// Initialize the shared memory to zero.
+	for (int i = 0; i<MEMORY_SIZE; i++){
+		memory_used[i] = false;
+		memory[i] = 0;
+	}
+	clear_dirty_map();
+
+	// Split "file@entry" into the file name and entry line
+	for (int i = 0; i < core_count; i++) {
+		const char *name = trace_files[(i < trace_count) ? i : trace_count - 1];
+		char *at;
+
+		cores[i].id = i;
+		cores[i].entry = 0;
+		cores[i].loaded = false;
+		snprintf(cores[i].trace_file, sizeof(cores[i].trace_file), "%s", name);
+
+		at = strrchr(cores[i].trace_file, '@');
+		if (at != NULL && at[1] != '\0' && strspn(at + 1, "0123456789") == strlen(at + 1)) {
+			cores[i].entry = atoi(at + 1);
+			*at = '\0';
+		}
+
+		core_live[i] = true;
+		core_code_stale[i] = NULL;
+	}
+
+	// All cores share one memory, which starts out as core 0's image, so
+	// every core has to run that image. Only the entry lines may differ
+	image_length = load_core_image(cores[0].trace_file);
+	if (image_length >= 0) {
+		memcpy(image, rawHex_array, (size_t)image_length * sizeof(image[0]));
+
+		for (int i = 1; i < core_count; i++) {
+			int length;
+
+			// A core whose file cannot be loaded reports that itself
+			if (strcmp(cores[i].trace_file, cores[0].trace_file) == 0
+			  || (length = load_core_image(cores[i].trace_file)) < 0)
+				continue;
+
+			if (length != image_length
+			  || memcmp(image, rawHex_array, (size_t)image_length * sizeof(image[0])) != 0) {
+				printf("\nCore %d's image (%s) differs from core 0's (%s). All cores share one memory,"
+					" so they must run the same image; give cores their own entry lines with FILE@N instead.\n",
+					i, cores[i].trace_file, cores[0].trace_file);
+				return EXIT_FAILURE;
+			}
+		}
+
+		// Back to core 0's program to seed memory from
+		load_core_image(cores[0].trace_file);
+		load_memory_image();
+	}
+
+	core_mode = functional_mode;
+
+	for (int i = 0; i < core_count; i++) {
+		if (pthread_create(&cores[i].thread, NULL, core_main, &cores[i]) != 0) {
+			perror("Error starting core thread");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (int i = 0; i < core_count; i++)
+		pthread_join(cores[i].thread, NULL);
+
+
+
+	// Shared memory and totals across all cores
+	print_memory();
+
+    printf("\n\n\n Aggregate Statistics (%d cores):\n", core_count);
+	printf("================================\n");
+    printf(" Total Instructions:	%lld\n", agg_inst_count);
+	printf("--------------------------------\n");
+    printf(" R-Type:		%lld\n", agg_rtype_count);
+    printf(" I-Type:		%lld\n", agg_itype_count);
+	printf("--------------------------------\n");
+    printf(" Arithmetic:		%lld\n", agg_arith_count);
+    printf(" Logical:		%lld\n", agg_logic_count);
+    printf(" Memory Access:		%lld\n", agg_memacc_count);
+    printf(" Control Flow:		%lld\n", agg_cflow_count);
+	printf("--------------------------------\n");
+	printf(" Cycles (slowest):	%d\n", max_cycles);
+	printf(" Cycles (all cores):	%lld\n", agg_core_cycles);
+	printf(" Aggregate IPC:		%.3f\n", (max_cycles > 0) ? (double)agg_inst_count / max_cycles : 0.0);
+	printf("--------------------------------\n");
+	printf(" Total Hazards:		%lld\n", agg_hazard_count);
+	printf(" Total Stalls:		%lld\n", agg_stalls);
+	printf("================================\n");
+
+	for (int i = 0; i < core_count; i++) {
+		if (!cores[i].loaded)
+			return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
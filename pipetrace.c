@@ -0,0 +1,184 @@
+/**
+ * pipetrace.c - Cycle-by-cycle pipeline trace in Konata format
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Writes a Kanata 0004 log, which the Konata pipeline viewer opens:
+ *
+ *				I / L:		A line entered IF; its label is the trace
+ *							file line, hex and mnemonic.
+ *
+ *				S / E:		The line started / ended a stage
+ *							(F, D, X, M, W for IF, ID, EX, MEM, WB).
+ *
+ *				R:			The line left the pipeline: retired out of
+ *							WB (type 0) or flushed by a branch (type 1).
+ *
+ *				C:			Cycles advanced since the last command.
+ *
+ * Stalls are added to the stalled line's hover text. The trace only keeps
+ * the five pipe slots' state and is written as it goes, so its memory use
+ * doesn't grow with the length of the run.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mips.h"
+
+
+// stdio buffer the trace is written through
+#define TRACE_BUFFER (1024 * 1024)
+
+
+bool pipe_tracing = false;
+
+static FILE *trace_fp = NULL;
+static char *trace_buffer = NULL;
+static int traced_cycle;
+static long long next_id = 0;
+static long long next_retire = 0;
+
+// Trace id and stage of the line in each pipe slot, -1 if none
+static long long slot_id[5] = {-1, -1, -1, -1, -1};
+static int slot_stage[5];
+
+static const char *stage_names[NUMPIPES + 1] = {"", "F", "D", "X", "M", "W"};
+
+
+
+
+static int slot_index(const decodedLine *slot) {
+	const decodedLine *slots[5] = {&pipe.pipe1, &pipe.pipe2, &pipe.pipe3, &pipe.pipe4, &pipe.pipe5};
+
+	for (int i = 0; i < 5; i++) {
+		if (slots[i] == slot)
+			return i;
+	}
+	return -1;
+}
+
+
+// Catches the trace up to the current cycle
+static void advance() {
+	if (cycle_counter > traced_cycle) {
+		fprintf(trace_fp, "C\t%d\n", cycle_counter - traced_cycle);
+		traced_cycle = cycle_counter;
+	}
+}
+
+
+static void leave(int i, int type) {
+	fprintf(trace_fp, "E\t%lld\t0\t%s\n", slot_id[i], stage_names[slot_stage[i]]);
+	fprintf(trace_fp, "R\t%lld\t%lld\t%d\n", slot_id[i], next_retire++, type);
+	slot_id[i] = -1;
+}
+
+
+
+
+bool start_pipe_trace(const char *path) {
+
+	trace_fp = fopen(path, "w");
+	if (trace_fp == NULL) {
+		perror("Error opening pipeline trace");
+		return false;
+	}
+
+	trace_buffer = malloc(TRACE_BUFFER);
+	if (trace_buffer != NULL)
+		setvbuf(trace_fp, trace_buffer, _IOFBF, TRACE_BUFFER);
+
+	traced_cycle = cycle_counter;
+	fprintf(trace_fp, "Kanata\t0004\n");
+	fprintf(trace_fp, "C=\t%d\n", cycle_counter);
+
+	pipe_tracing = true;
+	return true;
+}
+
+
+void trace_cycle() {
+	const decodedLine *slots[5] = {&pipe.pipe1, &pipe.pipe2, &pipe.pipe3, &pipe.pipe4, &pipe.pipe5};
+
+	advance();
+
+	for (int i = 0; i < 5; i++) {
+		int stage = slots[i]->pipe_stage;
+
+		// A slot that went back to an earlier stage was emptied out of WB
+		// and refilled in the same cycle
+		if (slot_id[i] >= 0 && (stage == 0 || stage < slot_stage[i]))
+			leave(i, 0);
+
+		if (slot_id[i] >= 0 && stage != slot_stage[i]) {
+			fprintf(trace_fp, "E\t%lld\t0\t%s\n", slot_id[i], stage_names[slot_stage[i]]);
+			fprintf(trace_fp, "S\t%lld\t0\t%s\n", slot_id[i], stage_names[stage]);
+			slot_stage[i] = stage;
+		}
+
+		else if (slot_id[i] < 0 && stage >= IF && stage <= WB) {
+			int line = slots[i]->line_index;
+
+			slot_id[i] = next_id++;
+			slot_stage[i] = stage;
+			fprintf(trace_fp, "I\t%lld\t%lld\t0\n", slot_id[i], slot_id[i]);
+			if (line >= 0 && line < MEMORY_SIZE)
+				fprintf(trace_fp, "L\t%lld\t0\t%d: %08X %s\n", slot_id[i], line + 1, rawHex_array[line], opcode_name(slots[i]->instruction));
+			else
+				fprintf(trace_fp, "L\t%lld\t0\t%s\n", slot_id[i], opcode_name(slots[i]->instruction));
+			fprintf(trace_fp, "S\t%lld\t0\t%s\n", slot_id[i], stage_names[stage]);
+		}
+	}
+}
+
+
+void trace_stall(const decodedLine *writer, const decodedLine *reader) {
+	int i = slot_index(reader);
+
+	if (i < 0 || slot_id[i] < 0)
+		return;
+
+	fprintf(trace_fp, "L\t%lld\t1\tstalled at cycle %d on line %d\n", slot_id[i], cycle_counter, writer->line_index + 1);
+}
+
+
+void trace_flush(const decodedLine *slot) {
+	int i = slot_index(slot);
+
+	if (i < 0 || slot_id[i] < 0)
+		return;
+
+	advance();
+	leave(i, 1);
+}
+
+
+void finish_pipe_trace() {
+
+	if (!pipe_tracing)
+		return;
+
+	// Whatever is still in the pipeline after a HALT never retires
+	advance();
+	for (int i = 0; i < 5; i++) {
+		if (slot_id[i] >= 0)
+			leave(i, 1);
+	}
+
+	if (fclose(trace_fp) != 0)
+		perror("Error writing pipeline trace");
+	free(trace_buffer);
+	trace_fp = NULL;
+	trace_buffer = NULL;
+	pipe_tracing = false;
+}
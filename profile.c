@@ -0,0 +1,173 @@
+/**
+ * profile.c - Per-line hotspot profiler for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Counts, for every line of the trace file:
+ *
+ *				EXECUTED:		Times the line went through opcode_master().
+ *
+ *				STALLS CAUSED:	Stall cycles spent waiting on the line's
+ *								result (it was the writer of the hazard).
+ *
+ *				STALLS SUFFERED:Stall cycles the line spent waiting on an
+ *								older line's result (it was the reader).
+ *
+ *				FLUSHED:		Times the line was thrown out of IF/ID by
+ *								a taken branch.
+ *
+ * The simulator only calls in here behind 'if (profiling)', so a run
+ * without --profile does no profiling work.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mips.h"
+
+
+// Lines shown in the hotspot report
+#define PROFILE_TOP 20
+
+
+// struct to hold one line's profile
+typedef struct line_profile {
+	long long executed;
+	long long stalls_caused;
+	long long stalls_suffered;
+	long long flushed;
+} lineProfile;
+
+
+bool profiling = false;
+
+static const char *profile_path = NULL;
+static SIM_LOCAL lineProfile profile[MEMORY_SIZE + 1];
+
+
+
+
+static bool valid_line(int line) {
+	return line >= 0 && line <= MEMORY_SIZE;
+}
+
+
+void profile_executed(int line) {
+	if (valid_line(line))
+		profile[line].executed++;
+}
+
+
+void profile_stall(const decodedLine *writer, const decodedLine *reader) {
+	if (valid_line(writer->line_index))
+		profile[writer->line_index].stalls_caused++;
+	if (valid_line(reader->line_index))
+		profile[reader->line_index].stalls_suffered++;
+}
+
+
+void profile_flush(const decodedLine *line) {
+	if (valid_line(line->line_index))
+		profile[line->line_index].flushed++;
+}
+
+
+
+
+// Hotter lines first: most executed, then most stalled
+static int compare_lines(const void *a, const void *b) {
+	const lineProfile *pa = &profile[*(const int *)a];
+	const lineProfile *pb = &profile[*(const int *)b];
+	long long cost_a = pa->executed + pa->stalls_suffered;
+	long long cost_b = pb->executed + pb->stalls_suffered;
+
+	if (cost_a != cost_b)
+		return (cost_a < cost_b) ? 1 : -1;
+	return *(const int *)a - *(const int *)b;
+}
+
+
+
+
+void start_profiling(const char *path) {
+	profiling = true;
+	profile_path = path;
+}
+
+
+void print_profile() {
+	int order[MEMORY_SIZE + 1];
+	int used = 0;
+	long long executed = 0, stalls = 0;
+
+	for (int i = 0; i <= program_length; i++) {
+		const lineProfile *p = &profile[i];
+		if (p->executed || p->stalls_caused || p->stalls_suffered || p->flushed)
+			order[used++] = i;
+		executed += p->executed;
+		stalls += p->stalls_suffered;
+	}
+
+	qsort(order, used, sizeof(int), compare_lines);
+
+	printf("\n\n\n Hotspots (top %d of %d lines):\n", (used < PROFILE_TOP) ? used : PROFILE_TOP, used);
+	printf("================================================================================\n");
+	printf(" Line  Hex       Instr  Executed        %%   Stalls Caused  Stalls Suffered  Flushed\n");
+	printf("--------------------------------------------------------------------------------\n");
+
+	for (int n = 0; n < used && n < PROFILE_TOP; n++) {
+		int i = order[n];
+		const lineProfile *p = &profile[i];
+
+		printf(" %-5d %08X  %-5s  %8lld  %6.2f%%  %13lld  %15lld  %7lld\n",
+			i + 1, rawHex_array[i], opcode_name(program_store[i].instruction),
+			p->executed, (executed > 0) ? 100.0 * p->executed / executed : 0.0,
+			p->stalls_caused, p->stalls_suffered, p->flushed);
+	}
+
+	if (used == 0)
+		printf(" No lines executed.\n");
+	printf("--------------------------------------------------------------------------------\n");
+	printf(" Executed: %lld   Stall Cycles: %lld\n", executed, stalls);
+	printf("================================================================================\n");
+}
+
+
+bool write_profile(const char *path) {
+	FILE *fp;
+
+	if (path == NULL)
+		path = profile_path;
+	if (path == NULL)
+		return true;
+
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		perror("Error writing profile");
+		return false;
+	}
+
+	fprintf(fp, "line,hex,instruction,executed,stalls_caused,stalls_suffered,flushed\n");
+	for (int i = 0; i < program_length; i++) {
+		const lineProfile *p = &profile[i];
+
+		fprintf(fp, "%d,%08X,%s,%lld,%lld,%lld,%lld\n",
+			i + 1, rawHex_array[i], opcode_name(program_store[i].instruction),
+			p->executed, p->stalls_caused, p->stalls_suffered, p->flushed);
+	}
+
+	if (fclose(fp) != 0) {
+		perror("Error writing profile");
+		return false;
+	}
+	return true;
+}
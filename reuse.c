@@ -0,0 +1,230 @@
+/**
+ * reuse.c - Reuse distance and working set analysis for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Measures, over the words of memory[] that LDW/STW touch:
+ *
+ *				REUSE DISTANCE:	For every access, how many other distinct
+ *								words were accessed since the last access
+ *								to the same word. An access hits in a fully
+ *								associative LRU cache of C words exactly
+ *								when its distance is below C, so the
+ *								histogram gives the hit rate of every
+ *								cache size at once.
+ *
+ *				WORKING SET:	Distinct words accessed in each window of
+ *								'window' instructions.
+ *
+ * Every word keeps the timestamp of its last access and a Fenwick tree
+ * marks the timestamps that are still some word's last access, so a
+ * distance is two prefix sums: O(log n) per access. When the timestamps
+ * run out they are renumbered in order, which keeps the tree small.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mips.h"
+
+
+// Timestamps the Fenwick tree covers before they are renumbered
+#define REUSE_STAMPS 65536
+
+// Histogram buckets: 0, 1, 2-3, 4-7, ... up to MEMORY_SIZE - 1
+#define REUSE_BUCKETS 11
+
+
+bool reuse_analysis = false;
+
+static int tree[REUSE_STAMPS + 1];          // Fenwick tree, 1-based
+static int last_stamp[MEMORY_SIZE];         // -1 if never accessed
+static int next_stamp = 0;
+
+static long long accesses = 0;
+static long long cold_accesses = 0;
+static long long histogram[REUSE_BUCKETS];
+
+static int window_length;
+static int window_end;
+static int window_id = 1;
+static int window_seen[MEMORY_SIZE];        // last window each word was accessed in
+static int window_words = 0;
+static int windows = 0;
+static long long window_word_total = 0;
+static int window_peak = 0;
+
+
+
+
+static void tree_add(int stamp, int delta) {
+	for (int i = stamp + 1; i <= REUSE_STAMPS; i += i & -i)
+		tree[i] += delta;
+}
+
+
+// Number of marked timestamps in [0, stamp]
+static int tree_sum(int stamp) {
+	int sum = 0;
+
+	for (int i = stamp + 1; i > 0; i -= i & -i)
+		sum += tree[i];
+	return sum;
+}
+
+
+static int compare_stamps(const void *a, const void *b) {
+	return last_stamp[*(const int *)a] - last_stamp[*(const int *)b];
+}
+
+
+// Renumbers the live timestamps 0..k-1 in the same order
+static void renumber() {
+	int words[MEMORY_SIZE];
+	int k = 0;
+
+	for (int w = 0; w < MEMORY_SIZE; w++) {
+		if (last_stamp[w] >= 0)
+			words[k++] = w;
+	}
+
+	qsort(words, k, sizeof(int), compare_stamps);
+
+	memset(tree, 0, sizeof(tree));
+	for (int i = 0; i < k; i++) {
+		last_stamp[words[i]] = i;
+		tree_add(i, 1);
+	}
+	next_stamp = k;
+}
+
+
+static int bucket(int distance) {
+	int b = 0;
+
+	while (distance > 0) {
+		distance >>= 1;
+		b++;
+	}
+	return (b < REUSE_BUCKETS) ? b : REUSE_BUCKETS - 1;
+}
+
+
+static void close_window() {
+	windows++;
+	window_word_total += window_words;
+	if (window_words > window_peak)
+		window_peak = window_words;
+
+	window_words = 0;
+	window_id++;
+}
+
+
+
+
+void start_reuse_analysis(int window) {
+
+	for (int w = 0; w < MEMORY_SIZE; w++)
+		last_stamp[w] = -1;
+
+	window_length = (window > 0) ? window : DEFAULT_REUSE_WINDOW;
+	window_end = (total_inst_count / window_length + 1) * window_length;
+	schedule_inst_event(window_end);
+
+	reuse_analysis = true;
+}
+
+
+void reuse_access(int32_t address) {
+	int w = MEMORY_INDEX(address);
+
+	if (next_stamp == REUSE_STAMPS)
+		renumber();
+
+	accesses++;
+
+	if (last_stamp[w] >= 0) {
+		histogram[bucket(tree_sum(next_stamp - 1) - tree_sum(last_stamp[w]))]++;
+		tree_add(last_stamp[w], -1);
+	}
+	else
+		cold_accesses++;
+
+	tree_add(next_stamp, 1);
+	last_stamp[w] = next_stamp++;
+
+	if (window_seen[w] != window_id) {
+		window_seen[w] = window_id;
+		window_words++;
+	}
+}
+
+
+void reuse_inst_event() {
+	if (!reuse_analysis)
+		return;
+
+	if (total_inst_count >= window_end) {
+		close_window();
+		window_end = (total_inst_count / window_length + 1) * window_length;
+	}
+
+	schedule_inst_event(window_end);
+}
+
+
+
+
+void print_reuse_stats() {
+	long long reuses = accesses - cold_accesses;
+	long long hits = 0;
+	int footprint = 0;
+
+	// Count the last window if any of it ran
+	if (total_inst_count > window_end - window_length)
+		close_window();
+
+	for (int w = 0; w < MEMORY_SIZE; w++) {
+		if (last_stamp[w] >= 0)
+			footprint++;
+	}
+
+	printf("\n\n\n Reuse Distance (memory words):\n");
+	printf("================================================\n");
+	printf(" Accesses:		%lld\n", accesses);
+	printf(" Cold (first touch):	%lld\n", cold_accesses);
+	printf(" Footprint:		%d words\n", footprint);
+	printf("------------------------------------------------\n");
+	printf(" Distance      Accesses   Cache  LRU Hit Rate\n");
+
+	for (int b = 0; b < REUSE_BUCKETS; b++) {
+		int low = (b == 0) ? 0 : 1 << (b - 1);
+		int high = (1 << b) - 1;
+		char range[24];
+
+		hits += histogram[b];
+		if (low == high)
+			snprintf(range, sizeof(range), "%d", low);
+		else
+			snprintf(range, sizeof(range), "%d-%d", low, high);
+
+		printf(" %-9s  %11lld  %6d  %11.2f%%\n", range, histogram[b], 1 << b,
+			(accesses > 0) ? 100.0 * hits / accesses : 0.0);
+	}
+
+	printf("------------------------------------------------\n");
+	printf(" Reuses:		%lld\n", reuses);
+	printf(" Working Set:		%.1f words avg, %d peak\n", (windows > 0) ? (double)window_word_total / windows : 0.0, window_peak);
+	printf(" (per %d instructions, %d windows)\n", window_length, windows);
+	printf("================================================\n");
+}
@@ -0,0 +1,262 @@
+/**
+ * sampling.c - SMARTS-style sampled timing for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Instead of running the whole program through the NO_FWD/FWD pipeline, the
+ * sampler repeats:
+ *
+ *				WINDOW:			Start the pipeline empty at the current PC,
+ *								run 'warmup' instructions unmeasured, then
+ *								measure cycles/stalls/hazards over the next
+ *								'window' instructions and stop.
+ *
+ *				FAST-FORWARD:	Execute 'interval' instructions with
+ *								functional_step() (no pipeline, no cycles).
+ *
+ * The pipeline resolves every branch the way run_nopipe() does, so the
+ * functional steps carry on exactly where the window left off, the program
+ * follows the path of a full run and the instruction count is exact.
+ * Each window gives a CPI sample. The mean CPI times the total instruction
+ * count estimates the cycles of a full detailed run, and the spread of the
+ * samples gives a 95% confidence interval. Stalls and hazards are
+ * extrapolated the same way.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include "mips.h"
+
+
+// z-value of a two-sided 95% confidence interval
+#define CONFIDENCE_Z 1.96
+
+
+bool sampling = false;
+
+static samplingConfig config;
+static unsigned random_state;
+
+// Window currently running in the pipeline
+static bool in_window = false;
+static bool measuring = false;
+static bool window_stopped = false;
+static int mark_count, stop_count;
+static int mark_insts, mark_cycle, mark_hazards, mark_stalls;
+static int stop_insts, stop_cycle, stop_hazards, stop_stalls;
+
+// Per-window samples
+static int windows = 0;
+static double cpi_sum = 0, cpi_squares = 0;
+static double stall_sum = 0, stall_squares = 0;
+static double hazard_sum = 0, hazard_squares = 0;
+static long long detailed_insts = 0;
+static long long measured_insts = 0;
+static long long functional_insts = 0;
+
+// Final estimates, per instruction and as totals
+static int total_insts = 0;
+static double cpi_mean, cpi_error;
+static double stall_mean, stall_error;
+static double hazard_mean, hazard_error;
+
+
+
+
+static int next_interval() {
+	if (config.policy == SAMPLE_RANDOM) {
+		random_state = random_state * 1103515245u + 12345u;
+		return config.interval / 2 + (int)((random_state >> 8) % (unsigned)(config.interval + 1));
+	}
+	return config.interval;
+}
+
+
+// Mean and 95% confidence half-width of n samples
+static void summarise(double sum, double squares, double *mean, double *error) {
+	*mean = (windows > 0) ? sum / windows : 0.0;
+	*error = -1.0;
+
+	if (windows > 1) {
+		double variance = (squares - windows * (*mean) * (*mean)) / (windows - 1);
+		if (variance < 0)
+			variance = 0;
+		*error = CONFIDENCE_Z * sqrt(variance / windows);
+	}
+}
+
+
+
+
+void sample_inst_event() {
+	if (!in_window)
+		return;
+
+	if (!measuring) {
+		// Warm-up done: start measuring
+		measuring = true;
+		mark_insts = total_inst_count;
+		mark_cycle = cycle_counter;
+		mark_hazards = hazard_count;
+		mark_stalls = total_stalls;
+		schedule_inst_event(stop_count);
+	}
+
+	else if (!window_stopped) {
+		// Window done: stop, leaving the lines in flight unexecuted
+		window_stopped = true;
+		stop_insts = total_inst_count;
+		stop_cycle = cycle_counter;
+		stop_hazards = hazard_count;
+		stop_stalls = total_stalls;
+		ready_to_end = true;
+	}
+}
+
+
+// Runs one detailed window from the current PC.
+// Returns false if the program ended inside it.
+static bool detailed_window() {
+	int start_insts = total_inst_count;
+
+	in_window = true;
+	measuring = false;
+	window_stopped = false;
+	mark_count = start_insts + config.warmup;
+	stop_count = mark_count + config.window;
+
+	reset_pipeline(pc);
+	schedule_inst_event(mark_count);
+	run_pipeline();
+
+	in_window = false;
+	detailed_insts += total_inst_count - start_insts;
+
+	if (measuring) {
+		// The program ended before the window was full: measure what ran
+		if (!window_stopped) {
+			stop_insts = total_inst_count;
+			stop_cycle = cycle_counter;
+			stop_hazards = hazard_count;
+			stop_stalls = total_stalls;
+		}
+
+		int insts = stop_insts - mark_insts;
+		if (insts > 0) {
+			double cpi = (double)(stop_cycle - mark_cycle) / insts;
+			double stalls = (double)(stop_stalls - mark_stalls) / insts;
+			double hazards = (double)(stop_hazards - mark_hazards) / insts;
+
+			windows++;
+			cpi_sum += cpi;				cpi_squares += cpi * cpi;
+			stall_sum += stalls;		stall_squares += stalls * stalls;
+			hazard_sum += hazards;		hazard_squares += hazards * hazards;
+			measured_insts += insts;
+		}
+	}
+
+	if (!window_stopped || halt_executed)
+		return false;
+
+	// Carry on after the last line the pipeline executed
+	pc = next_line();
+	ready_to_end = false;
+
+	return true;
+}
+
+
+
+
+void run_sampled(const samplingConfig *sample_config) {
+
+	config = *sample_config;
+	if (config.interval < 0)
+		config.interval = 0;
+	if (config.warmup < 0)
+		config.warmup = 0;
+	if (config.window < 1)
+		config.window = 1;
+	random_state = config.seed;
+
+	pc = 0;
+
+	while (detailed_window()) {
+		int n = next_interval();
+		int start_insts = total_inst_count;
+		bool running = true;
+
+		for (int i = 0; i < n && running; i++)
+			running = functional_step();
+
+		functional_insts += total_inst_count - start_insts;
+		if (!running)
+			break;
+	}
+
+	ready_to_end = true;
+
+	// Replace the detailed-only totals with full-run estimates
+	total_insts = total_inst_count;
+	summarise(cpi_sum, cpi_squares, &cpi_mean, &cpi_error);
+	summarise(stall_sum, stall_squares, &stall_mean, &stall_error);
+	summarise(hazard_sum, hazard_squares, &hazard_mean, &hazard_error);
+
+	if (windows > 0) {
+		cycle_counter = (int)llround(cpi_mean * total_insts);
+		total_stalls = (int)llround(stall_mean * total_insts);
+		hazard_count = (int)llround(hazard_mean * total_insts);
+	}
+}
+
+
+
+
+static void print_estimate(const char *name, double mean, double error, const char *unit) {
+	if (error >= 0)
+		printf(" %s\t%.0f +/- %.0f %s (%.3f +/- %.3f per instruction)\n", name, mean * total_insts, error * total_insts, unit, mean, error);
+	else
+		printf(" %s\t%.0f %s (%.3f per instruction, one window: no interval)\n", name, mean * total_insts, unit, mean);
+}
+
+
+void print_sample_stats() {
+
+	printf("\n\n\n Sampling Statistics:\n");
+	printf("================================\n");
+	printf(" Policy:		%s\n", (config.policy == SAMPLE_RANDOM) ? "random" : "periodic");
+	printf(" Interval:		%d\n", config.interval);
+	printf(" Warm-up:		%d\n", config.warmup);
+	printf(" Window:		%d\n", config.window);
+	printf(" Windows Measured:	%d\n", windows);
+	printf("--------------------------------\n");
+	printf(" Detailed Instr.:	%lld (%lld measured)\n", detailed_insts, measured_insts);
+	printf(" Functional Instr.:	%lld\n", functional_insts);
+	printf("--------------------------------\n");
+
+	if (windows == 0)
+		printf(" No window was measured; cycles are not estimated.\n");
+	else {
+		if (cpi_error >= 0)
+			printf(" CPI:			%.3f +/- %.3f\n", cpi_mean, cpi_error);
+		else
+			printf(" CPI:			%.3f\n", cpi_mean);
+		print_estimate("Est. Cycles:", cpi_mean, cpi_error, "cycles");
+		print_estimate("Est. Stalls:", stall_mean, stall_error, "stalls");
+		print_estimate("Est. Hazards:", hazard_mean, hazard_error, "hazards");
+		printf(" (95%% confidence, %d windows)\n", windows);
+	}
+
+	printf("================================\n");
+}
@@ -0,0 +1,686 @@
+/**
+ * server.c - Long-lived simulation server for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Listens on a UNIX domain socket and runs the jobs clients send it, so a
+ * batch of runs doesn't pay for a process start and a trace file decode
+ * each time:
+ *
+ *				REQUESTS:	One line per job of space separated key=value
+ *							pairs: id, mode (NO_PIPE/NO_FWD/FWD), image
+ *							(a trace file path) or hex (the image inline,
+ *							comma separated words), max-insts and
+ *							max-cycles.
+ *
+ *				RESULTS:	One line of JSON per job, on the connection
+ *							that sent it, echoing its id. Jobs finish in
+ *							any order.
+ *
+ *				CACHE:		The last 'cache_size' decoded images, most
+ *							recently used kept. A cached trace file is
+ *							decoded again if its size or time changes.
+ *
+ * Every connection has a reader thread that queues its requests; the
+ * worker threads take jobs off the queue, each with its own registers,
+ * memory and program, and answer them.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/sysinfo.h>
+#include "mips.h"
+
+
+// Longest error message sent back
+#define SERVER_ERROR 256
+
+// Longest job id echoed back
+#define SERVER_ID 64
+
+
+// struct to hold one client connection
+typedef struct server_connection {
+	int fd;
+	FILE *in;                       // read side; closing it closes the socket
+	pthread_mutex_t write_lock;     // one result line at a time
+	int refs;                       // the reader plus every unanswered job
+} serverConnection;
+
+// struct to hold a queued job
+typedef struct server_job {
+	struct server_job *next;
+	serverConnection *conn;
+	char *request;
+} serverJob;
+
+// struct to hold a parsed request
+typedef struct server_request {
+	char id[SERVER_ID];
+	bool has_id;
+	int mode;
+	char *image;                    // trace file path, or NULL
+	char *hex;                      // inline image, or NULL
+	int max_insts;                  // 0 for no budget
+	int max_cycles;
+} serverRequest;
+
+// struct to hold a cached decoded image
+typedef struct cached_image {
+	char *key;                      // the path, or the inline hex
+	bool is_file;
+	off_t size;                     // the trace file's, when it was decoded
+	struct timespec mtime;
+	unsigned long long last_used;   // 0 if the slot is empty
+	int program_length;
+	decodedLine *program;           // program_length + 1 lines, EOP last
+	uint32_t *raw;
+} cachedImage;
+
+
+bool serving = false;
+
+static serverJob *queue_head = NULL;
+static serverJob *queue_tail = NULL;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static cachedImage *cache = NULL;
+static int cache_slots = 0;
+static unsigned long long cache_clock = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The running job's budgets, and the one that stopped it (NULL if none)
+static SIM_LOCAL int job_max_insts;
+static SIM_LOCAL int job_max_cycles;
+static SIM_LOCAL const char *budget_stop;
+
+
+
+
+static double seconds() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// Writes text as a JSON string
+static void write_string(FILE *out, const char *text) {
+	fputc('"', out);
+	for (const unsigned char *c = (const unsigned char *)text; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\')
+			fprintf(out, "\\%c", *c);
+		else if (*c < 0x20)
+			fprintf(out, "\\u%04x", *c);
+		else
+			fputc(*c, out);
+	}
+	fputc('"', out);
+}
+
+
+
+
+static void connection_release(serverConnection *conn) {
+	if (__atomic_sub_fetch(&conn->refs, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+
+	fclose(conn->in);
+	pthread_mutex_destroy(&conn->write_lock);
+	free(conn);
+}
+
+
+// Sends one result line. A client that has gone away just misses it
+static void reply(serverConnection *conn, const char *text, size_t length) {
+	pthread_mutex_lock(&conn->write_lock);
+
+	while (length > 0) {
+		ssize_t n = send(conn->fd, text, length, MSG_NOSIGNAL);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		text += n;
+		length -= n;
+	}
+
+	pthread_mutex_unlock(&conn->write_lock);
+}
+
+
+static void enqueue(serverConnection *conn, char *request) {
+	serverJob *job = malloc(sizeof(serverJob));
+
+	if (job == NULL || request == NULL) {
+		perror("Error queueing job");
+		exit(EXIT_FAILURE);
+	}
+
+	job->next = NULL;
+	job->conn = conn;
+	job->request = request;
+	__atomic_add_fetch(&conn->refs, 1, __ATOMIC_ACQ_REL);
+
+	pthread_mutex_lock(&queue_lock);
+	if (queue_tail == NULL)
+		queue_head = job;
+	else
+		queue_tail->next = job;
+	queue_tail = job;
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+
+static serverJob *dequeue() {
+	serverJob *job;
+
+	pthread_mutex_lock(&queue_lock);
+	while (queue_head == NULL)
+		pthread_cond_wait(&queue_cond, &queue_lock);
+
+	job = queue_head;
+	queue_head = job->next;
+	if (queue_head == NULL)
+		queue_tail = NULL;
+	pthread_mutex_unlock(&queue_lock);
+
+	return job;
+}
+
+
+static void *connection_main(void *arg) {
+	serverConnection *conn = arg;
+	char *line = NULL;
+	size_t capacity = 0;
+
+	while (getline(&line, &capacity, conn->in) > 0) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] != '\0')
+			enqueue(conn, strdup(line));
+	}
+
+	free(line);
+	connection_release(conn);
+	return NULL;
+}
+
+
+
+
+static bool same_file(const cachedImage *image, const struct stat *st) {
+	return image->size == st->st_size
+		&& image->mtime.tv_sec == st->st_mtim.tv_sec
+		&& image->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+
+// Copies a cached image into the calling thread's program. Returns false
+// if it isn't cached (or the trace file has changed since)
+static bool cache_fetch(const char *key, bool is_file, const struct stat *st) {
+	bool hit = false;
+
+	pthread_mutex_lock(&cache_lock);
+
+	for (int i = 0; i < cache_slots; i++) {
+		cachedImage *image = &cache[i];
+
+		if (image->last_used == 0 || image->is_file != is_file || strcmp(image->key, key) != 0)
+			continue;
+		if (is_file && !same_file(image, st))
+			break;
+
+		memcpy(program_store, image->program, (image->program_length + 1) * sizeof(decodedLine));
+		memcpy(rawHex_array, image->raw, image->program_length * sizeof(uint32_t));
+		program_length = image->program_length;
+		image->last_used = ++cache_clock;
+		hit = true;
+		break;
+	}
+
+	pthread_mutex_unlock(&cache_lock);
+	return hit;
+}
+
+
+// Caches the calling thread's program, in place of an older copy of the
+// same image or else the least recently used one
+static void cache_store(const char *key, bool is_file, const struct stat *st) {
+	decodedLine *program;
+	uint32_t *raw;
+	char *key_copy;
+	cachedImage *slot = NULL;
+
+	if (cache_slots == 0)
+		return;
+
+	program = malloc((program_length + 1) * sizeof(decodedLine));
+	raw = malloc((program_length + 1) * sizeof(uint32_t));
+	key_copy = strdup(key);
+	if (program == NULL || raw == NULL || key_copy == NULL) {
+		free(program);
+		free(raw);
+		free(key_copy);
+		return;
+	}
+	memcpy(program, program_store, (program_length + 1) * sizeof(decodedLine));
+	memcpy(raw, rawHex_array, program_length * sizeof(uint32_t));
+
+	pthread_mutex_lock(&cache_lock);
+
+	for (int i = 0; i < cache_slots && slot == NULL; i++) {
+		if (cache[i].last_used > 0 && cache[i].is_file == is_file && strcmp(cache[i].key, key) == 0)
+			slot = &cache[i];
+	}
+	for (int i = 0; i < cache_slots && slot == NULL; i++) {
+		if (cache[i].last_used == 0)
+			slot = &cache[i];
+	}
+	if (slot == NULL) {
+		slot = &cache[0];
+		for (int i = 1; i < cache_slots; i++) {
+			if (cache[i].last_used < slot->last_used)
+				slot = &cache[i];
+		}
+	}
+
+	free(slot->key);
+	free(slot->program);
+	free(slot->raw);
+
+	slot->key = key_copy;
+	slot->is_file = is_file;
+	if (is_file) {
+		slot->size = st->st_size;
+		slot->mtime = st->st_mtim;
+	}
+	slot->program_length = program_length;
+	slot->program = program;
+	slot->raw = raw;
+	slot->last_used = ++cache_clock;
+
+	pthread_mutex_unlock(&cache_lock);
+}
+
+
+
+
+// Reads "key=value key=value ..." into request. Returns false, with the
+// reason in error, if it isn't a valid job
+static bool parse_request(char *text, serverRequest *request, char *error) {
+	char *item, *save;
+
+	memset(request, 0, sizeof(serverRequest));
+	request->mode = NO_PIPE;
+
+	for (item = strtok_r(text, " \t", &save); item != NULL; item = strtok_r(NULL, " \t", &save)) {
+		char *value = strchr(item, '=');
+		char *end;
+
+		if (value == NULL) {
+			snprintf(error, SERVER_ERROR, "expected key=value, got %s", item);
+			return false;
+		}
+		*value++ = '\0';
+
+		if (strcmp(item, "id") == 0) {
+			snprintf(request->id, sizeof(request->id), "%s", value);
+			request->has_id = true;
+		}
+		else if (strcmp(item, "mode") == 0) {
+			if (strcmp(value, "NO_PIPE") == 0)
+				request->mode = NO_PIPE;
+			else if (strcmp(value, "NO_FWD") == 0)
+				request->mode = NO_FWD;
+			else if (strcmp(value, "FWD") == 0)
+				request->mode = FWD;
+			else {
+				snprintf(error, SERVER_ERROR, "unknown mode %s (use NO_PIPE, NO_FWD or FWD)", value);
+				return false;
+			}
+		}
+		else if (strcmp(item, "image") == 0)
+			request->image = value;
+		else if (strcmp(item, "hex") == 0)
+			request->hex = value;
+		else if (strcmp(item, "max-insts") == 0 || strcmp(item, "max-cycles") == 0) {
+			long n = strtol(value, &end, 10);
+
+			if (end == value || *end != '\0' || n < 0 || n > INT_MAX) {
+				snprintf(error, SERVER_ERROR, "%s must be a count, got %s", item, value);
+				return false;
+			}
+			if (item[4] == 'i')
+				request->max_insts = (int)n;
+			else
+				request->max_cycles = (int)n;
+		}
+		else {
+			snprintf(error, SERVER_ERROR, "unknown key %s", item);
+			return false;
+		}
+	}
+
+	if ((request->image == NULL) == (request->hex == NULL)) {
+		snprintf(error, SERVER_ERROR, "a job needs one of image=PATH or hex=WORDS");
+		return false;
+	}
+
+	return true;
+}
+
+
+// Decodes the inline image, one comma separated word per line
+static bool load_hex(const char *hex, char *error) {
+	size_t length = strlen(hex);
+	char *lines = malloc(length + 2);
+	FILE *fp;
+	int words = 1;
+	bool loaded;
+
+	if (lines == NULL) {
+		snprintf(error, SERVER_ERROR, "out of memory");
+		return false;
+	}
+
+	for (size_t i = 0; i < length; i++) {
+		lines[i] = (hex[i] == ',') ? '\n' : hex[i];
+		if (hex[i] == ',')
+			words++;
+	}
+	lines[length] = '\n';
+	lines[length + 1] = '\0';
+
+	if (words > MEMORY_SIZE) {
+		snprintf(error, SERVER_ERROR, "inline image has %d words, more than %d", words, MEMORY_SIZE);
+		free(lines);
+		return false;
+	}
+
+	fp = fmemopen(lines, length + 1, "r");
+	loaded = (fp != NULL && load_program(fp) >= 0);
+	if (!loaded)
+		snprintf(error, SERVER_ERROR, "inline image has a word that isn't %d hex digits", HEX_STRING_LENGTH);
+
+	free(lines);
+	return loaded;
+}
+
+
+// Puts the job's image in the calling thread's program, from the cache if
+// it can. Returns false, with the reason in error, if it can't be loaded
+static bool load_image(const serverRequest *request, bool *cached, char *error) {
+	bool is_file = (request->image != NULL);
+	const char *key = is_file ? request->image : request->hex;
+	struct stat st;
+	FILE *fp;
+
+	memset(&st, 0, sizeof(st));
+
+	if (is_file && stat(request->image, &st) != 0) {
+		snprintf(error, SERVER_ERROR, "cannot open image %s: %s", request->image, strerror(errno));
+		return false;
+	}
+
+	*cached = cache_fetch(key, is_file, &st);
+	if (*cached) {
+		load_memory_image();
+		return true;
+	}
+
+	if (is_file) {
+		fp = open_image(request->image);
+		if (fp == NULL) {
+			snprintf(error, SERVER_ERROR, "cannot open image %s: %s", request->image, strerror(errno));
+			return false;
+		}
+		if (load_program(fp) < 0) {
+			snprintf(error, SERVER_ERROR, "image %s has a line that isn't %d hex digits", request->image, HEX_STRING_LENGTH);
+			return false;
+		}
+	}
+	else if (!load_hex(request->hex, error))
+		return false;
+
+	cache_store(key, is_file, &st);
+	load_memory_image();
+	return true;
+}
+
+
+
+
+static void run_job(serverJob *job) {
+	serverRequest request;
+	char error[SERVER_ERROR];
+	bool cached = false;
+	bool ok;
+	char *text = NULL;
+	size_t length = 0;
+	FILE *out;
+	double start;
+
+	reset_simulation();
+
+	ok = parse_request(job->request, &request, error) && load_image(&request, &cached, error);
+
+	out = open_memstream(&text, &length);
+	if (out == NULL) {
+		perror("Error formatting result");
+		exit(EXIT_FAILURE);
+	}
+
+	fprintf(out, "{\"id\": ");
+	if (request.has_id)
+		write_string(out, request.id);
+	else
+		fprintf(out, "null");
+
+	if (!ok) {
+		fprintf(out, ", \"status\": \"error\", \"error\": ");
+		write_string(out, error);
+	}
+	else {
+		functional_mode = request.mode;
+		job_max_insts = request.max_insts;
+		job_max_cycles = request.max_cycles;
+		budget_stop = NULL;
+		if (job_max_insts > 0)
+			schedule_inst_event(job_max_insts);
+		if (job_max_cycles > 0)
+			schedule_cycle_event(job_max_cycles);
+
+		start = seconds();
+		run_simulation(0);
+
+		fprintf(out, ", \"status\": \"ok\", \"image\": ");
+		write_string(out, (request.image != NULL) ? request.image : "inline");
+		fprintf(out, ", \"cached\": %s, \"stopped\": \"%s\", \"seconds\": %.6f, \"stats\": ",
+			cached ? "true" : "false",
+			(budget_stop != NULL) ? budget_stop : halt_executed ? "halt" : "end",
+			seconds() - start);
+		write_stats_record(out);
+	}
+
+	fprintf(out, "}\n");
+	fclose(out);
+
+	reply(job->conn, text, length);
+	free(text);
+}
+
+
+static void *worker_main(void *arg) {
+	int32_t *own_memory = calloc(MEMORY_SIZE, sizeof(int32_t));
+	bool *own_memory_used = calloc(MEMORY_SIZE, sizeof(bool));
+	dirtyMap *own_dirty_map = calloc(1, sizeof(dirtyMap));
+
+	(void)arg;
+
+	if (own_memory == NULL || own_memory_used == NULL || own_dirty_map == NULL) {
+		perror("Error allocating worker memory");
+		exit(EXIT_FAILURE);
+	}
+
+	// Every worker runs its jobs in its own memory
+	memory = own_memory;
+	memory_used = own_memory_used;
+	dirty_map = own_dirty_map;
+
+	for (;;) {
+		serverJob *job = dequeue();
+
+		run_job(job);
+
+		connection_release(job->conn);
+		free(job->request);
+		free(job);
+	}
+
+	return NULL;
+}
+
+
+
+
+void server_inst_event() {
+	if (job_max_insts <= 0)
+		return;
+
+	if (total_inst_count >= job_max_insts) {
+		budget_stop = "max-insts";
+		ready_to_end = true;
+	}
+	else
+		schedule_inst_event(job_max_insts);
+}
+
+
+void server_cycle_event() {
+	if (job_max_cycles <= 0)
+		return;
+
+	if (cycle_counter >= job_max_cycles) {
+		budget_stop = "max-cycles";
+		ready_to_end = true;
+	}
+	else
+		schedule_cycle_event(job_max_cycles);
+}
+
+
+int run_server(const char *path, int workers, int cache_size) {
+	struct sockaddr_un address;
+	struct stat st;
+	pthread_t thread;
+	int listener;
+
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		printf("\nSocket path %s is too long.\n", path);
+		return EXIT_FAILURE;
+	}
+
+	if (workers <= 0)
+		workers = get_nprocs();
+	if (workers > MAX_SERVER_WORKERS)
+		workers = MAX_SERVER_WORKERS;
+
+	cache_slots = (cache_size > 0) ? cache_size : 0;
+	cache = calloc(cache_slots + 1, sizeof(cachedImage));
+	if (cache == NULL) {
+		perror("Error allocating image cache");
+		return EXIT_FAILURE;
+	}
+
+	// A socket left behind by an earlier server is replaced; anything
+	// else at the path is left alone
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		remove(path);
+
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		perror("Error creating socket");
+		return EXIT_FAILURE;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+
+	if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+		perror("Error listening on socket");
+		return EXIT_FAILURE;
+	}
+
+	serving = true;
+
+	for (int i = 0; i < workers; i++) {
+		if (pthread_create(&thread, NULL, worker_main, NULL) != 0) {
+			perror("Error starting worker thread");
+			exit(EXIT_FAILURE);
+		}
+		pthread_detach(thread);
+	}
+
+	printf("\nServing on %s (%d workers, %d cached images).\n", path, workers, cache_slots);
+	fflush(stdout);
+
+	for (;;) {
+		serverConnection *conn;
+		int fd = accept(listener, NULL, NULL);
+
+		if (fd < 0) {
+			if (errno != EINTR)
+				perror("Error accepting connection");
+			continue;
+		}
+
+		conn = malloc(sizeof(serverConnection));
+		if (conn == NULL) {
+			perror("Error allocating connection");
+			exit(EXIT_FAILURE);
+		}
+
+		conn->fd = fd;
+		conn->in = fdopen(fd, "r");
+		conn->refs = 1;
+		pthread_mutex_init(&conn->write_lock, NULL);
+
+		if (conn->in == NULL) {
+			perror("Error reading connection");
+			shutdown(fd, SHUT_RDWR);
+			free(conn);
+			continue;
+		}
+
+		if (pthread_create(&thread, NULL, connection_main, conn) != 0) {
+			perror("Error starting connection thread");
+			exit(EXIT_FAILURE);
+		}
+		pthread_detach(thread);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,414 @@
+/**
+ * slicing.c - Parallel interval simulation of one long MIPS-lite run
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * A NO_FWD/FWD run is cut into intervals of 'length' instructions, and
+ * the intervals are timed in parallel:
+ *
+ *				FUNCTIONAL PASS:	Run the whole program with
+ *									functional_step(), saving the machine
+ *									state 'warmup' instructions before the
+ *									start of every interval.
+ *
+ *				DETAILED PASS:		Worker threads each take the next
+ *									interval, load its state into their own
+ *									registers and memory, start the pipeline
+ *									empty there, run the warm-up unmeasured,
+ *									then measure the interval and stop.
+ *
+ * The pipeline resolves every branch the way functional_step() does, so
+ * every interval starts at the very instruction a full run reaches it at,
+ * and the run ends with the registers, memory and instruction count of a
+ * full run. Adding up the intervals' cycles, stalls, hazards and CPI
+ * stacks gives those of a full detailed run, except at the boundaries:
+ * interval k+1 starts from an empty pipeline, and if the warm-up didn't
+ * bring it to the state interval k stopped in, the cycles around that
+ * boundary are uncertain. Every boundary whose pipeline states differ
+ * adds BOUNDARY_ERROR_CYCLES to the error bound.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/sysinfo.h>
+#include "mips.h"
+
+
+// Most a mismatched boundary can be off by: refilling the stages in
+// front of EX plus the longest RAW stall
+#define BOUNDARY_ERROR_CYCLES ((NUMPIPES - 1) + 2)
+
+
+// struct to hold the counters an interval is timed by
+typedef struct slice_counters {
+	int insts;
+	int cycles;
+	int stalls;
+	int hazards;
+	cpiStack cpi;
+} sliceCounters;
+
+// struct to hold the pipeline state at an interval boundary
+typedef struct slice_boundary {
+	int insts;                          // total_inst_count when it was read
+	int stage_line[NUMPIPES + 1];       // line in each stage, -1 if empty
+	int next_fetch;                     // line fetch loads next
+} sliceBoundary;
+
+// struct to hold one interval
+typedef struct slice_interval {
+	void *state;                // machine state at the start of the warm-up
+	int start;                  // first measured instruction
+	sliceCounters counts;
+	sliceBoundary at_mark, at_stop;
+	bool stopped;               // false if the program ended inside it
+	double seconds;             // CPU time spent on it
+} sliceInterval;
+
+
+bool slicing = false;
+
+static sliceConfig config;
+static const char *trace_path;
+static int run_mode;                // functional mode, copied into each worker
+
+static sliceInterval *intervals = NULL;
+static int num_intervals = 0;
+static int next_interval = 0;
+static void *final_state = NULL;
+
+// Results
+static int threads_used = 0;
+static int inexact_boundaries = 0;
+static double functional_seconds = 0;
+static double detailed_seconds = 0;
+static double interval_seconds = 0;
+
+// Interval the calling worker is running
+static SIM_LOCAL sliceInterval *current = NULL;
+static SIM_LOCAL bool current_last;         // it runs on to the end of the program
+static SIM_LOCAL bool measuring;
+static SIM_LOCAL sliceCounters mark;
+
+
+
+
+static double seconds(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void read_counters(sliceCounters *c) {
+	c->insts = total_inst_count;
+	c->cycles = cycle_counter;
+	c->stalls = total_stalls;
+	c->hazards = hazard_count;
+	c->cpi = cpi;
+}
+
+
+// *c = *c - *since
+static void counters_since(sliceCounters *c, const sliceCounters *since) {
+	c->insts -= since->insts;
+	c->cycles -= since->cycles;
+	c->stalls -= since->stalls;
+	c->hazards -= since->hazards;
+	for (int i = 0; i < CPI_CAUSES; i++)
+		c->cpi.cycles[i] -= since->cpi.cycles[i];
+}
+
+
+static void read_boundary(sliceBoundary *b) {
+	const decodedLine *slots[5] = {&pipe.pipe1, &pipe.pipe2, &pipe.pipe3, &pipe.pipe4, &pipe.pipe5};
+
+	memset(b, 0, sizeof(*b));
+	for (int s = 0; s <= NUMPIPES; s++)
+		b->stage_line[s] = -1;
+	for (int i = 0; i < 5; i++) {
+		if (slots[i]->pipe_stage >= IF && slots[i]->pipe_stage <= WB)
+			b->stage_line[slots[i]->pipe_stage] = slots[i]->line_index;
+	}
+	b->insts = total_inst_count;
+	b->next_fetch = (newInstAdded || was_control_flow) ? pc + newInstAdded : newinst.line_index;
+}
+
+
+static bool same_boundary(const sliceBoundary *a, const sliceBoundary *b) {
+	for (int s = IF; s <= WB; s++) {
+		if (a->stage_line[s] != b->stage_line[s])
+			return false;
+	}
+	return a->insts == b->insts && a->next_fetch == b->next_fetch;
+}
+
+
+
+
+void slice_inst_event() {
+	if (current == NULL)
+		return;
+
+	if (!measuring) {
+		// Warm-up done: start measuring
+		measuring = true;
+		read_counters(&mark);
+		read_boundary(&current->at_mark);
+		if (!current_last)
+			schedule_inst_event(current->start + config.length);
+	}
+
+	else if (!current->stopped) {
+		// Interval done: the next one carries on from here
+		current->stopped = true;
+		read_counters(&current->counts);
+		counters_since(&current->counts, &mark);
+		read_boundary(&current->at_stop);
+		ready_to_end = true;
+	}
+}
+
+
+static void run_interval(sliceInterval *interval, bool last) {
+	double start = seconds(CLOCK_THREAD_CPUTIME_ID);
+
+	apply_state(interval->state);
+	reset_pipeline(pc);
+	inst_event_count = INT_MAX;
+
+	current = interval;
+	current_last = last;
+	measuring = false;
+	interval->stopped = false;
+
+	if (interval->start <= total_inst_count)
+		slice_inst_event();
+	else
+		schedule_inst_event(interval->start);
+
+	run_pipeline();
+
+	// The program ended inside the interval: measure up to the end
+	if (!interval->stopped) {
+		read_counters(&interval->counts);
+		counters_since(&interval->counts, &mark);
+		read_boundary(&interval->at_stop);
+	}
+
+	if (last)
+		capture_state(final_state);
+
+	current = NULL;
+	interval->seconds = seconds(CLOCK_THREAD_CPUTIME_ID) - start;
+}
+
+
+static void *slice_worker(void *arg) {
+	int32_t *own_memory = calloc(MEMORY_SIZE, sizeof(int32_t));
+	bool *own_memory_used = calloc(MEMORY_SIZE, sizeof(bool));
+	dirtyMap *own_dirty_map = calloc(1, sizeof(dirtyMap));
+	FILE *fp;
+	int k;
+
+	(void)arg;
+
+	if (own_memory == NULL || own_memory_used == NULL || own_dirty_map == NULL) {
+		perror("Error allocating interval memory");
+		exit(EXIT_FAILURE);
+	}
+
+	// Every worker gets its own copy of the program and its own memory
+	functional_mode = run_mode;
+	memory = own_memory;
+	memory_used = own_memory_used;
+	dirty_map = own_dirty_map;
+
+	fp = open_image(trace_path);
+	if (fp == NULL || load_program(fp) < 0) {
+		perror("Error opening trace file");
+		exit(EXIT_FAILURE);
+	}
+
+	while ((k = __atomic_fetch_add(&next_interval, 1, __ATOMIC_RELAXED)) < num_intervals)
+		run_interval(&intervals[k], k == num_intervals - 1);
+
+	memory = shared_memory;
+	memory_used = shared_memory_used;
+	dirty_map = &shared_dirty_map;
+	free(own_memory);
+	free(own_memory_used);
+	free(own_dirty_map);
+
+	return NULL;
+}
+
+
+
+
+// Saves the current state as the start of a new interval measured from 'start'
+static void add_interval(int start) {
+	sliceInterval *grown = realloc(intervals, (num_intervals + 1) * sizeof(sliceInterval));
+
+	if (grown == NULL) {
+		perror("Error allocating intervals");
+		exit(EXIT_FAILURE);
+	}
+	intervals = grown;
+
+	memset(&intervals[num_intervals], 0, sizeof(sliceInterval));
+	intervals[num_intervals].start = start;
+	intervals[num_intervals].state = malloc(state_size());
+	if (intervals[num_intervals].state == NULL) {
+		perror("Error allocating intervals");
+		exit(EXIT_FAILURE);
+	}
+	capture_state(intervals[num_intervals].state);
+	num_intervals++;
+}
+
+
+// First instruction interval k is warmed up from
+static long long warmup_start(int k) {
+	long long start = (long long)k * config.length - config.warmup;
+	return (start > 0) ? start : 0;
+}
+
+
+
+
+void run_sliced(const char *trace_file, const sliceConfig *slice_config) {
+	pthread_t threads[MAX_SLICE_THREADS];
+	sliceCounters total;
+	double start;
+	bool running = true;
+
+	config = *slice_config;
+	trace_path = trace_file;
+	if (config.length < 1)
+		config.length = DEFAULT_SLICE_LENGTH;
+	if (config.warmup < 0)
+		config.warmup = 0;
+	if (config.threads < 1)
+		config.threads = get_nprocs();
+	if (config.threads > MAX_SLICE_THREADS)
+		config.threads = MAX_SLICE_THREADS;
+
+	// DEBUG output from several workers would interleave
+	if (mode == DEBUG)
+		config.threads = 1;
+
+
+
+	// Functional pass: save the state where each interval's warm-up starts
+	start = seconds(CLOCK_MONOTONIC);
+	pc = 0;
+
+	while (running) {
+		while (total_inst_count == warmup_start(num_intervals))
+			add_interval(num_intervals * config.length);
+		running = functional_step();
+	}
+
+	// Drop intervals whose warm-up began but which start after the end
+	while (num_intervals > 1 && intervals[num_intervals - 1].start >= total_inst_count) {
+		num_intervals--;
+		free(intervals[num_intervals].state);
+	}
+
+	functional_seconds = seconds(CLOCK_MONOTONIC) - start;
+
+
+
+	// Detailed pass: time every interval on the worker threads
+	final_state = malloc(state_size());
+	if (final_state == NULL) {
+		perror("Error allocating intervals");
+		exit(EXIT_FAILURE);
+	}
+
+	threads_used = (config.threads < num_intervals) ? config.threads : num_intervals;
+	run_mode = functional_mode;
+	start = seconds(CLOCK_MONOTONIC);
+
+	for (int i = 0; i < threads_used; i++) {
+		if (pthread_create(&threads[i], NULL, slice_worker, NULL) != 0) {
+			perror("Error starting interval thread");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (int i = 0; i < threads_used; i++)
+		pthread_join(threads[i], NULL);
+
+	detailed_seconds = seconds(CLOCK_MONOTONIC) - start;
+
+
+
+	// Finish with the last interval's state, and the timing of all the
+	// intervals added together
+	apply_state(final_state);
+	memset(&total, 0, sizeof(total));
+
+	for (int k = 0; k < num_intervals; k++) {
+		const sliceCounters *c = &intervals[k].counts;
+
+		total.cycles += c->cycles;
+		total.stalls += c->stalls;
+		total.hazards += c->hazards;
+		for (int i = 0; i < CPI_CAUSES; i++)
+			total.cpi.cycles[i] += c->cpi.cycles[i];
+		interval_seconds += intervals[k].seconds;
+
+		if (k + 1 < num_intervals && !same_boundary(&intervals[k].at_stop, &intervals[k + 1].at_mark))
+			inexact_boundaries++;
+	}
+
+	cycle_counter = total.cycles;
+	total_stalls = total.stalls;
+	hazard_count = total.hazards;
+	memcpy(cpi.cycles, total.cpi.cycles, sizeof(cpi.cycles));
+
+	for (int k = 0; k < num_intervals; k++)
+		free(intervals[k].state);
+	free(intervals);
+	free(final_state);
+	intervals = NULL;
+	final_state = NULL;
+
+	ready_to_end = true;
+}
+
+
+
+
+void print_slice_stats() {
+	int error = inexact_boundaries * BOUNDARY_ERROR_CYCLES;
+
+	printf("\n\n\n Interval Slicing Statistics:\n");
+	printf("================================\n");
+	printf(" Interval Length:	%d\n", config.length);
+	printf(" Warm-up:		%d\n", config.warmup);
+	printf(" Intervals:		%d\n", num_intervals);
+	printf(" Threads:		%d\n", threads_used);
+	printf("--------------------------------\n");
+	printf(" Inexact Boundaries:	%d of %d\n", inexact_boundaries, (num_intervals > 0) ? num_intervals - 1 : 0);
+	printf(" Cycles:		%d +/- %d\n", cycle_counter, error);
+	printf("--------------------------------\n");
+	printf(" Functional Pass:	%.3f s\n", functional_seconds);
+	printf(" Detailed Pass:		%.3f s (%.3f s of intervals, %.2fx)\n", detailed_seconds, interval_seconds,
+		(detailed_seconds > 0) ? interval_seconds / detailed_seconds : 0.0);
+	printf("================================\n");
+}
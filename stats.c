@@ -0,0 +1,363 @@
+/**
+ * stats.c - Machine-readable statistics for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Writes what print_stats() prints, in a form scripts can read:
+ *
+ *				FINAL STATS:	Every counter, the CPI stack, and the used
+ *								registers and memory, as one JSON object
+ *								or as section,name,value CSV rows.
+ *
+ *				TIME SERIES:	Every 'interval' cycles, one row with the
+ *								cycles, instructions, IPC, stalls, hazards
+ *								and instruction mix since the last row
+ *								(CSV, or one JSON object per line).
+ *
+ * Rows go through a writer that formats straight into a large buffer and
+ * only touches the file when it fills up.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <limits.h>
+#include "mips.h"
+
+
+// Bytes the writer holds before it writes them out
+#define WRITER_BUFFER (64 * 1024)
+
+// Longest single row the writer formats
+#define WRITER_ROW 512
+
+
+// struct to hold a buffered output file
+typedef struct stats_writer {
+	FILE *fp;
+	size_t used;
+	char buf[WRITER_BUFFER];
+} statsWriter;
+
+// struct to hold the counters a time series row is measured from
+typedef struct series_mark {
+	int cycles;
+	int insts;
+	int stalls;
+	int hazards;
+	int arith;
+	int logic;
+	int memacc;
+	int cflow;
+} seriesMark;
+
+
+int stats_format = STATS_TEXT;
+
+static statsConfig config;
+static statsWriter *series = NULL;
+static seriesMark last_row;
+static int next_row = INT_MAX;
+static int rows_written = 0;
+
+
+static const char *cpi_keys[CPI_CAUSES] = {
+	"base", "raw_fwd", "raw_no_fwd", "load_use", "control", "memory", "fill", "drain", "front_end"
+};
+
+
+
+
+static statsWriter *writer_open(const char *path) {
+	statsWriter *w = malloc(sizeof(statsWriter));
+
+	if (w == NULL) {
+		perror("Error allocating stats writer");
+		return NULL;
+	}
+
+	w->fp = (path == NULL) ? stdout : fopen(path, "w");
+	if (w->fp == NULL) {
+		perror("Error opening stats file");
+		free(w);
+		return NULL;
+	}
+
+	w->used = 0;
+	return w;
+}
+
+
+static void writer_flush(statsWriter *w) {
+	if (w->used > 0)
+		fwrite(w->buf, 1, w->used, w->fp);
+	w->used = 0;
+}
+
+
+static void writer_printf(statsWriter *w, const char *format, ...) {
+	va_list args;
+	int n;
+
+	if (WRITER_BUFFER - w->used < WRITER_ROW)
+		writer_flush(w);
+
+	va_start(args, format);
+	n = vsnprintf(w->buf + w->used, WRITER_BUFFER - w->used, format, args);
+	va_end(args);
+
+	if (n > 0)
+		w->used += ((size_t)n < WRITER_BUFFER - w->used) ? (size_t)n : WRITER_BUFFER - w->used - 1;
+}
+
+
+static bool writer_close(statsWriter *w) {
+	bool ok;
+
+	writer_flush(w);
+	ok = (w->fp == stdout) ? fflush(stdout) == 0 : fclose(w->fp) == 0;
+	if (!ok)
+		perror("Error writing stats file");
+	free(w);
+	return ok;
+}
+
+
+
+
+static const char *mode_name(int m) {
+	switch (m) {
+		case NO_PIPE:	return "NO_PIPE";
+		case NO_FWD:	return "NO_FWD";
+		case FWD:		return "FWD";
+		default:		return "?";
+	}
+}
+
+
+static const char *run_kind() {
+	if (sampling)
+		return "sampled";
+	if (slicing)
+		return "sliced";
+	return "full";
+}
+
+
+static void read_mark(seriesMark *m) {
+	tally_instruction_mix();
+	m->cycles = cycle_counter;
+	m->insts = total_inst_count;
+	m->stalls = total_stalls;
+	m->hazards = hazard_count;
+	m->arith = arith_count;
+	m->logic = logic_count;
+	m->memacc = memacc_count;
+	m->cflow = cflow_count;
+}
+
+
+// Writes the row covering everything since the last one
+static void series_row() {
+	seriesMark now;
+	int cycles, insts;
+	double ipc;
+
+	read_mark(&now);
+	cycles = now.cycles - last_row.cycles;
+	insts = now.insts - last_row.insts;
+	ipc = (cycles > 0) ? (double)insts / cycles : 0.0;
+
+	if (stats_format == STATS_JSON)
+		writer_printf(series, "{\"cycle\":%d,\"cycles\":%d,\"instructions\":%d,\"ipc\":%.4f,\"stalls\":%d,\"hazards\":%d,"
+			"\"arithmetic\":%d,\"logical\":%d,\"memory_access\":%d,\"control_flow\":%d}\n",
+			now.cycles, cycles, insts, ipc, now.stalls - last_row.stalls, now.hazards - last_row.hazards,
+			now.arith - last_row.arith, now.logic - last_row.logic, now.memacc - last_row.memacc, now.cflow - last_row.cflow);
+	else
+		writer_printf(series, "%d,%d,%d,%.4f,%d,%d,%d,%d,%d,%d\n",
+			now.cycles, cycles, insts, ipc, now.stalls - last_row.stalls, now.hazards - last_row.hazards,
+			now.arith - last_row.arith, now.logic - last_row.logic, now.memacc - last_row.memacc, now.cflow - last_row.cflow);
+
+	last_row = now;
+	rows_written++;
+}
+
+
+
+
+bool start_stats(const statsConfig *stats_config) {
+
+	config = *stats_config;
+	stats_format = config.format;
+
+	if (stats_format == STATS_TEXT || config.interval < 1)
+		return true;
+
+	if (config.series_path == NULL)
+		config.series_path = (stats_format == STATS_JSON) ? DEFAULT_SERIES_JSON : DEFAULT_SERIES_CSV;
+
+	series = writer_open(config.series_path);
+	if (series == NULL)
+		return false;
+
+	if (stats_format == STATS_CSV)
+		writer_printf(series, "cycle,cycles,instructions,ipc,stalls,hazards,arithmetic,logical,memory_access,control_flow\n");
+
+	read_mark(&last_row);
+	next_row = (cycle_counter / config.interval + 1) * config.interval;
+	schedule_cycle_event(next_row);
+
+	return true;
+}
+
+
+void stats_cycle_event() {
+	if (series == NULL)
+		return;
+
+	if (cycle_counter >= next_row) {
+		series_row();
+		next_row = (cycle_counter / config.interval + 1) * config.interval;
+	}
+
+	schedule_cycle_event(next_row);
+}
+
+
+bool text_report() {
+	return stats_format == STATS_TEXT || config.path != NULL;
+}
+
+
+
+
+// Compact output is all on one line, with no newline at the end
+static void write_json(statsWriter *w, bool compact) {
+	const char *in = compact ? " " : "  ";
+	const char *nl = compact ? "" : "\n";
+	bool first;
+
+	writer_printf(w, "{%s", nl);
+	writer_printf(w, "%s\"mode\": \"%s\",%s", in, mode_name(functional_mode), nl);
+	writer_printf(w, "%s\"run\": \"%s\",%s", in, run_kind(), nl);
+	writer_printf(w, "%s\"instructions\": {\"total\": %d, \"r_type\": %d, \"i_type\": %d, \"arithmetic\": %d, "
+		"\"logical\": %d, \"memory_access\": %d, \"control_flow\": %d},%s", in,
+		total_inst_count, rtype_count, itype_count, arith_count, logic_count, memacc_count, cflow_count, nl);
+	writer_printf(w, "%s\"cycles\": %d,%s", in, cycle_counter, nl);
+	writer_printf(w, "%s\"hazards\": %d,%s", in, hazard_count, nl);
+	writer_printf(w, "%s\"stalls\": %d,%s", in, total_stalls, nl);
+	writer_printf(w, "%s\"pc\": %d,%s", in, pc, nl);
+
+	if (functional_mode != NO_PIPE && !sampling) {
+		writer_printf(w, "%s\"cpi_stack\": {", in);
+		for (int c = 0; c < CPI_CAUSES; c++)
+			writer_printf(w, "%s\"%s\": %d", (c > 0) ? ", " : "", cpi_keys[c], cpi.cycles[c]);
+		writer_printf(w, "},%s", nl);
+	}
+
+	writer_printf(w, "%s\"registers\": {", in);
+	first = true;
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		if (register_used[i]) {
+			writer_printf(w, "%s\"R%d\": %" PRIi32, first ? "" : ", ", i, registers[i]);
+			first = false;
+		}
+	}
+	writer_printf(w, "},%s", nl);
+
+	writer_printf(w, "%s\"memory\": {", in);
+	first = true;
+	for (int i = next_used_word(0); i >= 0; i = next_used_word(i + 1)) {
+		writer_printf(w, "%s\"%d\": %" PRIi32, first ? "" : ", ", i * 4, memory[i]);
+		first = false;
+	}
+	writer_printf(w, "}%s", nl);
+	writer_printf(w, "}%s", nl);
+}
+
+
+static void write_csv(statsWriter *w) {
+
+	writer_printf(w, "section,name,value\n");
+	writer_printf(w, "run,mode,%s\n", mode_name(functional_mode));
+	writer_printf(w, "run,kind,%s\n", run_kind());
+	writer_printf(w, "instructions,total,%d\n", total_inst_count);
+	writer_printf(w, "instructions,r_type,%d\n", rtype_count);
+	writer_printf(w, "instructions,i_type,%d\n", itype_count);
+	writer_printf(w, "instructions,arithmetic,%d\n", arith_count);
+	writer_printf(w, "instructions,logical,%d\n", logic_count);
+	writer_printf(w, "instructions,memory_access,%d\n", memacc_count);
+	writer_printf(w, "instructions,control_flow,%d\n", cflow_count);
+	writer_printf(w, "counts,cycles,%d\n", cycle_counter);
+	writer_printf(w, "counts,hazards,%d\n", hazard_count);
+	writer_printf(w, "counts,stalls,%d\n", total_stalls);
+	writer_printf(w, "counts,pc,%d\n", pc);
+
+	if (functional_mode != NO_PIPE && !sampling) {
+		for (int c = 0; c < CPI_CAUSES; c++)
+			writer_printf(w, "cpi_stack,%s,%d\n", cpi_keys[c], cpi.cycles[c]);
+	}
+
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		if (register_used[i])
+			writer_printf(w, "register,R%d,%" PRIi32 "\n", i, registers[i]);
+	}
+
+	for (int i = next_used_word(0); i >= 0; i = next_used_word(i + 1))
+		writer_printf(w, "memory,%d,%" PRIi32 "\n", i * 4, memory[i]);
+}
+
+
+bool write_stats() {
+	statsWriter *w;
+	bool ok = true;
+
+	// Finish the time series with whatever ran since its last row
+	if (series != NULL) {
+		if (cycle_counter > last_row.cycles || rows_written == 0)
+			series_row();
+		ok = writer_close(series);
+		series = NULL;
+	}
+
+	if (stats_format == STATS_TEXT)
+		return ok;
+
+	w = writer_open(config.path);
+	if (w == NULL)
+		return false;
+
+	tally_instruction_mix();
+	if (stats_format == STATS_JSON)
+		write_json(w, false);
+	else
+		write_csv(w);
+
+	return writer_close(w) && ok;
+}
+
+
+void write_stats_record(FILE *fp) {
+	statsWriter *w = writer_open(NULL);
+
+	if (w == NULL)
+		return;
+	w->fp = fp;
+
+	tally_instruction_mix();
+	write_json(w, true);
+
+	writer_flush(w);
+	free(w);
+}
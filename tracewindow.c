@@ -0,0 +1,275 @@
+/**
+ * tracewindow.c - Windowed DEBUG tracing for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Runs a DEBUG run in NORMAL mode and only switches to DEBUG between a
+ * start and a stop trigger. A trigger is one of:
+ *
+ *				cycle:N		cycle_counter reaches N
+ *
+ *				inst:N		N instructions have executed
+ *
+ *				pc:N		line N of the trace file is executed
+ *
+ *				R<r><op>V	register r compared with V, checked before
+ *							every instruction (e.g. R5==3, R2>=100)
+ *
+ *				mem[A]<op>V	memory word at address A compared with V
+ *							(e.g. mem[400]!=0)
+ *
+ * where <op> is one of ==, !=, <, <=, >, >=. Cycle and instruction
+ * triggers use the simulator's cycle/instruction events, so they cost
+ * nothing until they fire. The others are checked from opcode_master(),
+ * but only while one of them is armed.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mips.h"
+
+
+// Window states
+#define WINDOW_OFF 0            // no window was asked for
+#define WINDOW_WAITING 1        // waiting on the start trigger
+#define WINDOW_OPEN 2           // tracing, waiting on the stop trigger
+#define WINDOW_CLOSED 3         // done; the rest of the run is NORMAL
+
+
+bool window_checking = false;
+
+static traceTrigger start_trigger;
+static traceTrigger stop_trigger;
+static int window_state = WINDOW_OFF;
+
+static const char *compare_ops[] = {"==", "!=", "<", "<=", ">", ">="};
+
+
+
+
+// Reads the "<op>V" part of a register/memory trigger
+static bool parse_compare(const char *s, traceTrigger *t) {
+	char *end;
+	int op = -1;
+
+	// Two-character operators first so "<=" isn't read as "<"
+	if (strncmp(s, "==", 2) == 0) op = CMP_EQ;
+	else if (strncmp(s, "!=", 2) == 0) op = CMP_NE;
+	else if (strncmp(s, "<=", 2) == 0) op = CMP_LE;
+	else if (strncmp(s, ">=", 2) == 0) op = CMP_GE;
+	else if (s[0] == '<') op = CMP_LT;
+	else if (s[0] == '>') op = CMP_GT;
+
+	if (op < 0)
+		return false;
+
+	s += strlen(compare_ops[op]);
+	t->compare = op;
+	t->value = (int32_t)strtol(s, &end, 0);
+	return end != s && *end == '\0';
+}
+
+
+bool parse_trigger(const char *spec, traceTrigger *t) {
+	char *end;
+	long n;
+
+	t->kind = TRIGGER_NONE;
+	if (spec == NULL)
+		return true;
+
+	if (strncmp(spec, "cycle:", 6) == 0 || strncmp(spec, "inst:", 5) == 0 || strncmp(spec, "pc:", 3) == 0) {
+		const char *number = strchr(spec, ':') + 1;
+
+		n = strtol(number, &end, 0);
+		if (end == number || *end != '\0' || n < 0)
+			return false;
+
+		if (spec[0] == 'c')
+			t->kind = TRIGGER_CYCLE;
+		else if (spec[0] == 'i')
+			t->kind = TRIGGER_INST;
+		else {
+			// Lines are numbered from 1, like the DEBUG output
+			if (n < 1 || n > MEMORY_SIZE)
+				return false;
+			t->kind = TRIGGER_PC;
+			n--;
+		}
+		t->target = (int)n;
+		return true;
+	}
+
+	if (spec[0] == 'R' || spec[0] == 'r') {
+		n = strtol(spec + 1, &end, 10);
+		if (end == spec + 1 || n < 0 || n >= NUM_REGISTERS)
+			return false;
+		t->kind = TRIGGER_REG;
+		t->target = (int)n;
+		return parse_compare(end, t);
+	}
+
+	if (strncmp(spec, "mem[", 4) == 0) {
+		n = strtol(spec + 4, &end, 0);
+		if (end == spec + 4 || *end != ']')
+			return false;
+		t->kind = TRIGGER_MEM;
+		t->target = MEMORY_INDEX(n);
+		return parse_compare(end + 1, t);
+	}
+
+	return false;
+}
+
+
+// Trigger the window is waiting on right now
+static const traceTrigger *armed() {
+	if (window_state == WINDOW_WAITING)
+		return &start_trigger;
+	if (window_state == WINDOW_OPEN)
+		return &stop_trigger;
+	return NULL;
+}
+
+
+// Schedules the event (or turns on the per-instruction check) the armed
+// trigger needs
+static void arm() {
+	const traceTrigger *t = armed();
+
+	window_checking = false;
+	if (t == NULL)
+		return;
+
+	switch (t->kind) {
+		case TRIGGER_CYCLE:	schedule_cycle_event(t->target); break;
+		case TRIGGER_INST:	schedule_inst_event(t->target); break;
+		case TRIGGER_PC:
+		case TRIGGER_REG:
+		case TRIGGER_MEM:	window_checking = true; break;
+		default:			break;
+	}
+}
+
+
+// The armed trigger fired: open or close the window
+static void fire() {
+
+	if (window_state == WINDOW_WAITING) {
+		mode = DEBUG;
+		window_state = WINDOW_OPEN;
+		debug_log("\n\n[TRACE] Window opened at cycle %d, instruction %d\n", cycle_counter, total_inst_count);
+
+		// With no stop trigger the window stays open to the end of the run
+		if (stop_trigger.kind == TRIGGER_NONE)
+			window_state = WINDOW_CLOSED;
+	}
+	else if (window_state == WINDOW_OPEN) {
+		debug_log("\n\n[TRACE] Window closed at cycle %d, instruction %d\n", cycle_counter, total_inst_count);
+		mode = NORMAL;
+		window_state = WINDOW_CLOSED;
+	}
+
+	arm();
+}
+
+
+
+
+bool start_trace_window(const char *start, const char *stop) {
+
+	if (!parse_trigger(start, &start_trigger)) {
+		printf("\nUnknown trace trigger %s.\n", start);
+		return false;
+	}
+	if (!parse_trigger(stop, &stop_trigger)) {
+		printf("\nUnknown trace trigger %s.\n", stop);
+		return false;
+	}
+
+	if (start_trigger.kind == TRIGGER_NONE && stop_trigger.kind == TRIGGER_NONE)
+		return true;
+
+	// The run goes the NORMAL way until the window opens
+	mode = NORMAL;
+	window_state = WINDOW_WAITING;
+
+	// No start trigger: trace from the beginning up to the stop trigger
+	if (start_trigger.kind == TRIGGER_NONE)
+		fire();
+	else
+		arm();
+
+	return true;
+}
+
+
+void trace_window_inst_event() {
+	const traceTrigger *t = armed();
+
+	if (t == NULL || t->kind != TRIGGER_INST)
+		return;
+
+	if (total_inst_count >= t->target)
+		fire();
+	else
+		schedule_inst_event(t->target);
+}
+
+
+void trace_window_cycle_event() {
+	const traceTrigger *t = armed();
+
+	if (t == NULL || t->kind != TRIGGER_CYCLE)
+		return;
+
+	if (cycle_counter >= t->target)
+		fire();
+	else
+		schedule_cycle_event(t->target);
+}
+
+
+void trace_window_step(int line) {
+	const traceTrigger *t = armed();
+
+	if (t == NULL)
+		return;
+
+	if (trigger_holds(t, line))
+		fire();
+}
+
+
+
+
+static bool compare(int32_t a, int op, int32_t b) {
+	switch (op) {
+		case CMP_EQ:	return a == b;
+		case CMP_NE:	return a != b;
+		case CMP_LT:	return a < b;
+		case CMP_LE:	return a <= b;
+		case CMP_GT:	return a > b;
+		default:		return a >= b;
+	}
+}
+
+
+bool trigger_holds(const traceTrigger *t, int line) {
+	switch (t->kind) {
+		case TRIGGER_PC:	return line == t->target;
+		case TRIGGER_REG:	return compare(registers[t->target], t->compare, t->value);
+		case TRIGGER_MEM:	return compare(memory[t->target], t->compare, t->value);
+		default:			return false;
+	}
+}
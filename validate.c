@@ -0,0 +1,396 @@
+/**
+ * validate.c - Differential validation of an execution engine for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Runs every trace file through two engines at once, each on its own host
+ * thread with its own registers, program and memory:
+ *
+ *				REFERENCE:	functional_step(), one opcode_master() call
+ *							per line.
+ *
+ *				ENGINE:		The engine the functional mode picks
+ *							(run_nopipe() or run_pipeline()).
+ *
+ * Each thread keeps a rolling hash: every executed line folds in its line
+ * index, and every 'interval' instructions the registers and the memory
+ * words stored to since the last check are folded in too. At that point
+ * the threads meet and compare instruction counts and hashes.
+ *
+ * When they differ, the first divergent instruction is somewhere in the
+ * last interval. The engines are deterministic, so the file is run again
+ * checking every instruction from the last check that agreed, and the
+ * state of both engines at the first one that differs is printed.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include "mips.h"
+
+
+// FNV-1a, 64 bit
+#define HASH_OFFSET 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+
+// struct to hold one engine's thread and the state it last checked in with
+typedef struct validate_engine {
+	const char *name;
+	bool reference;
+	pthread_t thread;
+	bool loaded;
+	bool finished;                  // the run has ended
+	int insts;
+	int cycles;
+	int line;                       // last line executed, -1 if none
+	int32_t instruction;            // its opcode
+	int next;                       // line the program carries on at
+	uint64_t hash;
+	int32_t registers[NUM_REGISTERS];
+	bool register_used[NUM_REGISTERS];
+	int32_t memory[MEMORY_SIZE];    // the engine's own data memory
+	bool memory_used[MEMORY_SIZE];
+	dirtyMap dirty_map;
+} validateEngine;
+
+
+bool validating = false;
+
+static const char *trace_path;
+static int engine_mode;             // functional mode, copied into both threads
+static int interval;
+static int fine_from;               // check every instruction from here on
+
+static validateEngine engines[2];
+
+static pthread_mutex_t validate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t validate_cond = PTHREAD_COND_INITIALIZER;
+static int arrived;
+static unsigned generation;
+static bool stop;
+static bool diverged;
+static int checks;
+static int last_agreed;             // instruction count of the last check that agreed
+
+// Per-thread hash state
+static SIM_LOCAL validateEngine *self;
+static SIM_LOCAL int check_at;
+static SIM_LOCAL uint64_t rolling = HASH_OFFSET;
+static SIM_LOCAL int dirty[MEMORY_SIZE];
+static SIM_LOCAL bool is_dirty[MEMORY_SIZE];
+static SIM_LOCAL int dirty_count;
+
+
+
+
+static uint64_t fold(uint64_t h, uint32_t word) {
+	for (int b = 0; b < 4; b++) {
+		h ^= (word >> (8 * b)) & 0xFF;
+		h *= HASH_PRIME;
+	}
+	return h;
+}
+
+
+// Instruction count the calling thread next checks in at
+static int next_check() {
+	int next;
+
+	if (total_inst_count >= fine_from)
+		return total_inst_count + 1;
+
+	next = (total_inst_count / interval + 1) * interval;
+	return (next > fine_from) ? fine_from : next;
+}
+
+
+// Folds the registers and stored-to memory into the hash and copies the
+// calling thread's state into its engine
+static void publish(bool finished) {
+
+	for (int r = 0; r < NUM_REGISTERS; r++)
+		rolling = fold(rolling, (uint32_t)registers[r]);
+
+	for (int i = 0; i < dirty_count; i++) {
+		rolling = fold(rolling, (uint32_t)dirty[i]);
+		rolling = fold(rolling, (uint32_t)memory[dirty[i]]);
+		is_dirty[dirty[i]] = false;
+	}
+	dirty_count = 0;
+
+	self->finished = finished;
+	self->insts = total_inst_count;
+	self->cycles = cycle_counter;
+	self->line = last_executed_line;
+	self->instruction = (last_executed_line >= 0) ? program_store[last_executed_line].instruction : NOP;
+	self->next = next_line();
+	self->hash = rolling;
+	memcpy(self->registers, registers, sizeof(self->registers));
+	memcpy(self->register_used, register_used, sizeof(self->register_used));
+}
+
+
+// Both engines compare what they published. Caller holds validate_lock
+static void compare() {
+	const validateEngine *a = &engines[0], *b = &engines[1];
+
+	checks++;
+
+	if (a->insts != b->insts || a->hash != b->hash) {
+		diverged = true;
+		stop = true;
+		return;
+	}
+
+	last_agreed = a->insts;
+	if (a->finished && b->finished)
+		stop = true;
+}
+
+
+// Waits for the other engine to check in. Returns true once the run
+// should stop
+static bool rendezvous(bool finished) {
+	bool done;
+
+	publish(finished);
+
+	pthread_mutex_lock(&validate_lock);
+
+	if (++arrived == 2) {
+		compare();
+		arrived = 0;
+		generation++;
+		pthread_cond_broadcast(&validate_cond);
+	}
+	else {
+		unsigned g = generation;
+		while (g == generation)
+			pthread_cond_wait(&validate_cond, &validate_lock);
+	}
+
+	done = stop;
+	pthread_mutex_unlock(&validate_lock);
+
+	return done;
+}
+
+
+static void *engine_main(void *arg) {
+	FILE *fp;
+
+	self = arg;
+	functional_mode = engine_mode;
+	memory = self->memory;
+	memory_used = self->memory_used;
+	dirty_map = &self->dirty_map;
+
+	fp = open_image(trace_path);
+	self->loaded = (fp != NULL && load_program(fp) >= 0);
+
+	if (self->loaded) {
+		load_memory_image();
+		check_at = next_check();
+		schedule_inst_event(check_at);
+
+		if (self->reference) {
+			do {
+				if (total_inst_count >= inst_event_count)
+					inst_event();
+			} while (functional_step());
+		}
+		else
+			run_simulation(0);
+	}
+
+	// A finished engine keeps checking in with its final state until
+	// the other one finishes or differs from it
+	while (!rendezvous(true))
+		;
+
+	return NULL;
+}
+
+
+// Runs both engines over trace_path. Returns false if either couldn't load it
+static bool run_engines() {
+	for (int e = 0; e < 2; e++) {
+		memset(&engines[e], 0, sizeof(validateEngine));
+		engines[e].reference = (e == 0);
+		engines[e].name = (e == 0) ? "Reference" : (functional_mode == NO_PIPE) ? "NO_PIPE" : (functional_mode == NO_FWD) ? "NO_FWD" : "FWD";
+	}
+
+	engine_mode = functional_mode;
+	arrived = 0;
+	stop = false;
+	diverged = false;
+	checks = 0;
+	last_agreed = 0;
+
+	for (int e = 0; e < 2; e++) {
+		if (pthread_create(&engines[e].thread, NULL, engine_main, &engines[e]) != 0) {
+			perror("Error starting validation thread");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (int e = 0; e < 2; e++)
+		pthread_join(engines[e].thread, NULL);
+
+	return engines[0].loaded && engines[1].loaded;
+}
+
+
+
+
+static void print_line(const validateEngine *e) {
+	printf("   %-10s %d instructions, ", e->name, e->insts);
+	if (!e->reference)
+		printf("%d cycles, ", e->cycles);
+	if (e->line < 0)
+		printf("no line executed");
+	else
+		printf("last line %d (%s)", e->line + 1, opcode_name(e->instruction));
+	printf(", next line %d%s\n", e->next + 1, e->finished ? ", finished" : "");
+}
+
+
+// A memory word, or '-' if the engine never touched it
+static void print_word(const validateEngine *e, int w) {
+	if (e->memory_used[w])
+		printf(" %11d", e->memory[w]);
+	else
+		printf(" %11s", "-");
+}
+
+
+// Prints both engines' state at the first divergent instruction
+static void print_divergence() {
+	const validateEngine *a = &engines[0], *b = &engines[1];
+	int words = 0;
+
+	// With different counts, the first instruction only one engine ran
+	printf(" First divergence at instruction %d:\n", (a->insts == b->insts) ? a->insts : ((a->insts < b->insts) ? a->insts : b->insts) + 1);
+	print_line(a);
+	print_line(b);
+
+	printf("   Register    %11s %11s\n", a->name, b->name);
+	for (int r = 0; r < NUM_REGISTERS; r++) {
+		if (!a->register_used[r] && !b->register_used[r] && a->registers[r] == b->registers[r])
+			continue;
+		printf("   R[%d]%*s  %11d %11d%s\n", r, (r < 10) ? 6 : 5, "", a->registers[r], b->registers[r],
+			(a->registers[r] != b->registers[r]) ? "  <--" : "");
+	}
+
+	for (int w = 0; w < MEMORY_SIZE; w++) {
+		if (a->memory[w] == b->memory[w] && a->memory_used[w] == b->memory_used[w])
+			continue;
+		if (words++ == 0)
+			printf("   Address     %11s %11s\n", a->name, b->name);
+		printf("   %-10d ", w * 4);
+		print_word(a, w);
+		print_word(b, w);
+		printf("  <--\n");
+	}
+	if (words == 0)
+		printf("   Memory matches.\n");
+}
+
+
+// Validates one trace file. Returns false if it diverged or couldn't be loaded
+static bool validate_file(const char *path) {
+	trace_path = path;
+	fine_from = INT_MAX;
+
+	if (!run_engines()) {
+		printf(" %s: could not be loaded\n", path);
+		return false;
+	}
+
+	if (!diverged) {
+		printf(" %s: PASS (%d instructions, %d checks)\n", path, engines[0].insts, checks);
+		return true;
+	}
+
+	// Run it again, checking every instruction after the last check that
+	// agreed, to find the first one that differs
+	printf(" %s: DIVERGED (checks agreed up to instruction %d)\n", path, last_agreed);
+	fine_from = last_agreed;
+	run_engines();
+	print_divergence();
+
+	return false;
+}
+
+
+
+
+void validate_execute(int line) {
+	rolling = fold(rolling, (uint32_t)line);
+}
+
+
+void validate_store(int32_t address) {
+	int w = MEMORY_INDEX(address);
+
+	if (!is_dirty[w]) {
+		is_dirty[w] = true;
+		dirty[dirty_count++] = w;
+	}
+}
+
+
+void validate_inst_event() {
+	if (!validating)
+		return;
+
+	if (total_inst_count >= check_at) {
+		if (rendezvous(false))
+			pthread_exit(NULL);
+		check_at = next_check();
+	}
+
+	schedule_inst_event(check_at);
+}
+
+
+int run_validation(const char **trace_files, int trace_count, int check_interval) {
+	int passed = 0;
+
+	if (mode == DEBUG) {
+		printf("\nValidation runs two engines at once; turning DEBUG output off.\n");
+		mode = NORMAL;
+	}
+
+	interval = (check_interval > 0) ? check_interval : DEFAULT_VALIDATE_INTERVAL;
+	validating = true;
+
+	printf("\n\n\n Validation (%s engine against the reference, checked every %d instructions):\n",
+		(functional_mode == NO_PIPE) ? "NO_PIPE" : (functional_mode == NO_FWD) ? "NO_FWD" : "FWD", interval);
+	printf("================================================\n");
+
+	for (int t = 0; t < trace_count; t++) {
+		if (validate_file(trace_files[t]))
+			passed++;
+	}
+
+	printf("================================================\n");
+	printf(" Files:			%d\n", trace_count);
+	printf(" Passed:		%d\n", passed);
+	printf(" Diverged or failed:	%d\n", trace_count - passed);
+	printf("================================================\n");
+
+	validating = false;
+	return (passed == trace_count) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
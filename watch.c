@@ -0,0 +1,322 @@
+/**
+ * watch.c - Breakpoints and watchpoints for the MIPS-lite simulation
+ *
+ * @authors:    Evan Brown (evbr2@pdx.edu)
+ * 				Louis-David Gendron-Herndon (loge2@pdx.edu)
+ *				Ameer Melli (amelli@pdx.edu)
+ *				Anthony Le (anthle@pdx.edu)
+ *
+ *
+ *
+ * Stops a run (or reports and carries on) when a chosen line is about to
+ * execute or a chosen register or memory word is accessed:
+ *
+ *				BREAKPOINT:	line N of the trace file is about to execute
+ *
+ *				WRITE:		R5 or mem[400] is written
+ *
+ *				READ:		R5:read or mem[400]:read, it is read
+ *
+ *				VALUE:		R5==3 or mem[400]>=1 (any of ==, !=, <, <=,
+ *							>, >=) becomes true when it is written
+ *
+ * Every line, register and memory word carries a tag with one bit per
+ * watch that looks at it, set when the watches are added. opcode_master()
+ * only calls in here while a watch is set, and then an untagged line
+ * costs a few table lookups: the memory word of a LDW/STW is worked out
+ * from the line's fields before it executes, so ldwfunc() and stwfunc()
+ * are never touched.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mips.h"
+
+
+// Most watches and breakpoints at once (one tag bit each)
+#define MAX_WATCHES 32
+
+// Watch kinds
+#define WATCH_BREAK 0
+#define WATCH_WRITE 1
+#define WATCH_READ 2
+#define WATCH_VALUE 3
+
+
+// struct to hold one breakpoint or watchpoint
+typedef struct watch_point {
+	const char *spec;
+	int kind;
+	traceTrigger what;      // TRIGGER_PC, TRIGGER_REG or TRIGGER_MEM, and the VALUE comparison
+	long long hits;
+} watchPoint;
+
+
+bool watching = false;
+
+static watchPoint watches[MAX_WATCHES];
+static int watch_count;
+static bool keep_going;
+
+// Which watches look at each line, register and memory word
+static uint32_t line_tags[MEMORY_SIZE];
+static uint32_t register_tags[NUM_REGISTERS];
+static uint32_t word_tags[MEMORY_SIZE];
+
+// What the line being executed is about to write, noted before it runs
+static int written_register;        // -1 if none is watched
+static int32_t old_register;
+static int written_word;            // -1 if none is watched
+static int32_t old_word;
+static bool stop;
+
+
+
+
+static void add_watch(const char *spec, int kind, const traceTrigger *what) {
+	watchPoint *w;
+
+	if (watch_count == MAX_WATCHES) {
+		printf("\nOnly %d breakpoints and watchpoints can be set; ignoring %s.\n", MAX_WATCHES, spec);
+		return;
+	}
+
+	w = &watches[watch_count];
+	w->spec = spec;
+	w->kind = kind;
+	w->what = *what;
+	w->hits = 0;
+
+	if (what->kind == TRIGGER_PC)
+		line_tags[what->target] |= 1u << watch_count;
+	else if (what->kind == TRIGGER_REG)
+		register_tags[what->target] |= 1u << watch_count;
+	else
+		word_tags[what->target] |= 1u << watch_count;
+
+	watch_count++;
+}
+
+
+// Reads R<r> or mem[A], then nothing (WRITE), ":read" (READ) or a
+// comparison (VALUE)
+static bool parse_watch(const char *spec) {
+	traceTrigger what = {.kind=TRIGGER_NONE};
+	const char *rest;
+	char *end;
+	long n;
+
+	if (spec[0] == 'R' || spec[0] == 'r') {
+		n = strtol(spec + 1, &end, 10);
+		if (end == spec + 1 || n < 0 || n >= NUM_REGISTERS)
+			return false;
+		what.kind = TRIGGER_REG;
+		what.target = (int)n;
+		rest = end;
+	}
+	else if (strncmp(spec, "mem[", 4) == 0) {
+		n = strtol(spec + 4, &end, 0);
+		if (end == spec + 4 || *end != ']')
+			return false;
+		what.kind = TRIGGER_MEM;
+		what.target = MEMORY_INDEX(n);
+		rest = end + 1;
+	}
+	else
+		return false;
+
+	if (*rest == '\0')
+		add_watch(spec, WATCH_WRITE, &what);
+	else if (strcmp(rest, ":read") == 0)
+		add_watch(spec, WATCH_READ, &what);
+	else if (parse_trigger(spec, &what))
+		add_watch(spec, WATCH_VALUE, &what);
+	else
+		return false;
+	return true;
+}
+
+
+
+
+bool start_watches(const char **breaks, int break_count, const char **specs, int spec_count, bool carry_on) {
+	traceTrigger what = {.kind=TRIGGER_PC};
+	char *end;
+	long n;
+
+	for (int i = 0; i < break_count; i++) {
+		// Lines are numbered from 1, like the DEBUG output
+		n = strtol(breaks[i], &end, 0);
+		if (end == breaks[i] || *end != '\0' || n < 1 || n > MEMORY_SIZE) {
+			printf("\nUnknown breakpoint %s.\n", breaks[i]);
+			return false;
+		}
+		what.target = (int)n - 1;
+		add_watch(breaks[i], WATCH_BREAK, &what);
+	}
+
+	for (int i = 0; i < spec_count; i++) {
+		if (!parse_watch(specs[i])) {
+			printf("\nUnknown watchpoint %s.\n", specs[i]);
+			return false;
+		}
+	}
+
+	keep_going = carry_on;
+	watching = (watch_count > 0);
+	return true;
+}
+
+
+
+
+static bool compare_value(const traceTrigger *t, int32_t value) {
+	switch (t->compare) {
+		case CMP_EQ:	return value == t->value;
+		case CMP_NE:	return value != t->value;
+		case CMP_LT:	return value < t->value;
+		case CMP_LE:	return value <= t->value;
+		case CMP_GT:	return value > t->value;
+		default:		return value >= t->value;
+	}
+}
+
+
+// Reports a hit. 'line' is the line executing (or about to), and
+// 'detail' what the watched register or word held
+static void hit(watchPoint *w, int line, const char *detail) {
+
+	w->hits++;
+	flush_debug_log();
+
+	if (w->kind == WATCH_BREAK)
+		printf("\n\n Breakpoint at line %s hit at instruction %d, cycle %d\n", w->spec, total_inst_count, cycle_counter);
+	else
+		printf("\n\n Watchpoint %s (%s) hit at instruction %d, cycle %d, line %d: %s\n", w->spec,
+			(w->kind == WATCH_WRITE) ? "write" : (w->kind == WATCH_READ) ? "read" : "value",
+			total_inst_count, cycle_counter, line + 1, detail);
+
+	if (keep_going) {
+		print_registers();
+		print_memory();
+	}
+	else
+		stop = true;
+}
+
+
+// Read watches on everything in 'tags', which holds 'value'
+static void check_reads(uint32_t tags, int line, int32_t value) {
+	char detail[32];
+
+	for (int i = 0; tags != 0; i++, tags >>= 1) {
+		if ((tags & 1) && watches[i].kind == WATCH_READ) {
+			snprintf(detail, sizeof(detail), "%d", value);
+			hit(&watches[i], line, detail);
+		}
+	}
+}
+
+
+// Write and value watches on everything in 'tags', which went from 'old'
+// to 'now'
+static void check_writes(uint32_t tags, int line, int32_t old, int32_t now) {
+	char detail[32];
+
+	for (int i = 0; tags != 0; i++, tags >>= 1) {
+		if (!(tags & 1))
+			continue;
+		if (watches[i].kind == WATCH_WRITE
+		  || (watches[i].kind == WATCH_VALUE && compare_value(&watches[i].what, now) && !compare_value(&watches[i].what, old))) {
+			snprintf(detail, sizeof(detail), "%d -> %d", old, now);
+			hit(&watches[i], line, detail);
+		}
+	}
+}
+
+
+static void stop_here() {
+	stop = false;
+	printf("\n Stopping the run here.\n");
+	end_program();
+}
+
+
+
+
+void watch_step(const decodedLine *line) {
+	const opcodeInfo *info = OPCODE_INFO(line->instruction);
+	uint32_t tags;
+
+	written_register = -1;
+	written_word = -1;
+
+	tags = line_tags[line->line_index];
+	for (int i = 0; tags != 0; i++, tags >>= 1) {
+		if (tags & 1)
+			hit(&watches[i], line->line_index, NULL);
+	}
+
+	if (info->usage & READS_FIRST)
+		check_reads(register_tags[line->first_reg_val], line->line_index, registers[line->first_reg_val]);
+	if (info->usage & READS_SECOND)
+		check_reads(register_tags[line->second_reg_val], line->line_index, registers[line->second_reg_val]);
+	if (info->usage & READS_DEST)
+		check_reads(register_tags[line->dest_register], line->line_index, registers[line->dest_register]);
+
+	if ((info->usage & WRITES_DEST) && register_tags[line->dest_register] != 0) {
+		written_register = line->dest_register;
+		old_register = registers[written_register];
+	}
+
+	// The word a LDW/STW is about to access, from its fields
+	if (info->class == CLASS_MEMORY) {
+		int w = MEMORY_INDEX((uint32_t)registers[line->first_reg_val] + (int16_t)line->immediate);
+
+		if (word_tags[w] != 0) {
+			if (info->usage & WRITES_DEST)
+				check_reads(word_tags[w], line->line_index, memory[w]);
+			else {
+				written_word = w;
+				old_word = memory[w];
+			}
+		}
+	}
+
+	// A breakpoint stops before its line runs
+	if (stop)
+		stop_here();
+}
+
+
+void watch_executed(const decodedLine *line) {
+
+	if (written_register >= 0)
+		check_writes(register_tags[written_register], line->line_index, old_register, registers[written_register]);
+	if (written_word >= 0)
+		check_writes(word_tags[written_word], line->line_index, old_word, memory[written_word]);
+
+	if (stop)
+		stop_here();
+}
+
+
+void print_watch_stats() {
+	char label[64];
+
+	printf("\n\n\n Breakpoints and Watchpoints:\n");
+	printf("================================================\n");
+	for (int i = 0; i < watch_count; i++) {
+		if (watches[i].kind == WATCH_BREAK)
+			snprintf(label, sizeof(label), "Line %s hits:", watches[i].spec);
+		else
+			snprintf(label, sizeof(label), "%s hits:", watches[i].spec);
+		printf(" %-24s%lld\n", label, watches[i].hits);
+	}
+	printf("================================================\n");
+}